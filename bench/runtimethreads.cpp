@@ -0,0 +1,149 @@
+// Потоки и переключения контекста у множества HTTP клиентов: у каждого свой io_context и поток (как до ClientRuntime)
+// или общий runtime процесса (Client по умолчанию). Сервер работает в дочернем процессе и в замеры не входит.
+//
+// network-bench-runtimethreads [shared|private] [число клиентов = 500] [запросов на клиента = 10] [порт = 18102]
+
+#include <Components/Network/ClientHTTP.h>
+#include <Components/Network/ServerHTTP.h>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+long threadCount()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) {
+            return std::stol(line.substr(8));
+        }
+    }
+    return 0;
+}
+
+long contextSwitches()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// Клиент со своим io_context и потоком
+struct PrivateClient
+{
+    boost::asio::io_context ioc;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work {boost::asio::make_work_guard(ioc)};
+    std::thread ioThread;
+    std::unique_ptr<HTTP::Client> client;
+
+    PrivateClient() {
+        client = std::make_unique<HTTP::Client>(ioc);
+        ioThread = std::thread([this]() {
+            ioc.run();
+        });
+    }
+
+    ~PrivateClient() {
+        client.reset();
+        work.reset();
+        ioc.stop();
+        ioThread.join();
+    }
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode = (argc > 1 ? argv[1] : "shared");
+    int clientCount = (argc > 2 ? std::stoi(argv[2]) : 500);
+    int requestsPerClient = (argc > 3 ? std::stoi(argv[3]) : 10);
+    uint16_t port = static_cast<uint16_t>(argc > 4 ? std::stoi(argv[4]) : 18102);
+    if (mode != "shared" && mode != "private") {
+        std::fprintf(stderr, "usage: %s [shared|private] [clients] [requests per client] [port]\n", argv[0]);
+        return 1;
+    }
+
+    auto serverPid = fork();
+    if (serverPid == 0) {
+        HTTP::Server server("bench");
+        server.setGetHandler("/fast", [](HTTP::Packet&& packet, const HTTP::RequestProcessor& reply) {
+            packet.statusCode = 200;
+            packet.body = "ok";
+            reply(std::move(packet));
+        });
+        server.start(port, 1);
+        return 0;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto threadsBefore = threadCount();
+    std::vector<std::unique_ptr<PrivateClient> > privateClients;
+    std::vector<std::unique_ptr<HTTP::Client> > sharedClients;
+    std::vector<HTTP::Client*> clients;
+    for (int i = 0; i < clientCount; ++i) {
+        if (mode == "private") {
+            privateClients.push_back(std::make_unique<PrivateClient>());
+            clients.push_back(privateClients.back()->client.get());
+        } else {
+            sharedClients.push_back(std::make_unique<HTTP::Client>());
+            clients.push_back(sharedClients.back().get());
+        }
+        clients.back()->setHost("127.0.0.1", port);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto threadsWithClients = threadCount();
+
+    // Простой: клиенты ничего не делают
+    auto switches = contextSwitches();
+    auto startTime = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    auto idleRate = (contextSwitches() - switches) / std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Нагрузка: каждый клиент отправляет requestsPerClient асинхронных запросов
+    std::atomic<int> doneCount {0};
+    std::atomic<int> okCount {0};
+    switches = contextSwitches();
+    startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < requestsPerClient; ++i) {
+        for (auto client : clients) {
+            HTTP::Packet packet;
+            packet.target = "/fast";
+            client->requestAsync(HTTP::Get, std::move(packet), [&](std::optional<HTTP::Packet>&& response) {
+                okCount += (response && response->statusCode == 200);
+                ++doneCount;
+            });
+        }
+    }
+    auto totalCount = clientCount * requestsPerClient;
+    while (doneCount < totalCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    auto loadSwitches = contextSwitches() - switches;
+
+    std::printf("%s: %d clients, threads %ld -> %ld, idle %.0f ctx switches/s, "
+                "load %d/%d ok in %.0f ms, %ld ctx switches (%.0f/s)\n",
+                mode.c_str(), clientCount, threadsBefore, threadsWithClients, idleRate,
+                okCount.load(), totalCount, loadTime * 1000, loadSwitches, loadSwitches / loadTime);
+
+    kill(serverPid, SIGKILL);
+    waitpid(serverPid, nullptr, 0);
+    return (okCount == totalCount ? 0 : 1);
+}
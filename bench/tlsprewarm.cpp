@@ -0,0 +1,130 @@
+// Проверка на loopback: прогретое TLS 1.3 соединение используется первым запросом. Сервер TLS 1.3 сразу после
+// рукопожатия присылает билеты сессий, и свободное соединение не должно считаться из-за них закрытым.
+// Сертификат для сервера создаётся здесь же, сервер работает в дочернем процессе.
+//
+// network-bench-tlsprewarm [порт = 18443]
+
+#include <Components/Network/ClientHTTP.h>
+#include <Components/Network/ServerHTTP.h>
+
+#include <csignal>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Самоподписанный сертификат localhost
+bool writeCertificate(const std::string& certFile, const std::string& keyFile)
+{
+    EVP_PKEY* key {nullptr};
+    auto keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    auto isKeyReady = (keyContext && EVP_PKEY_keygen_init(keyContext) > 0 &&
+                       EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048) > 0 &&
+                       EVP_PKEY_keygen(keyContext, &key) > 0);
+    EVP_PKEY_CTX_free(keyContext);
+    if (!isKeyReady) {
+        return false;
+    }
+
+    auto cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    auto name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    auto isWritten = (X509_sign(cert, key, EVP_sha256()) > 0);
+
+    if (isWritten) {
+        auto certOutput = std::fopen(certFile.c_str(), "w");
+        auto keyOutput = std::fopen(keyFile.c_str(), "w");
+        isWritten = (certOutput && keyOutput &&
+                     PEM_write_X509(certOutput, cert) > 0 &&
+                     PEM_write_PrivateKey(keyOutput, key, nullptr, nullptr, 0, nullptr, nullptr) > 0);
+        if (certOutput) {
+            std::fclose(certOutput);
+        }
+        if (keyOutput) {
+            std::fclose(keyOutput);
+        }
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return isWritten;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t port = static_cast<uint16_t>(argc > 1 ? std::stoi(argv[1]) : 18443);
+
+    auto filePrefix = std::string("/tmp/network-bench-tlsprewarm-") + std::to_string(getpid());
+    HTTP::SecureConnectionParameters secureParameters;
+    secureParameters.certFile = filePrefix + "-cert.pem";
+    secureParameters.privKeyFile = filePrefix + "-key.pem";
+    if (!writeCertificate(secureParameters.certFile, secureParameters.privKeyFile)) {
+        std::fprintf(stderr, "Failed to create certificate\n");
+        return 1;
+    }
+
+    auto serverPid = fork();
+    if (serverPid == 0) {
+        HTTP::Server server("bench", secureParameters);
+        server.setGetHandler("/", [](HTTP::Packet&& packet, const HTTP::RequestProcessor& reply) {
+            packet.statusCode = 200;
+            packet.body = "ok";
+            reply(std::move(packet));
+        });
+        server.start(port, 1);
+        return 0;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto isPassed {true};
+    const int roundCount {5};
+    for (int round = 0; round < roundCount; ++round) {
+        HTTP::Client client(true, false);
+        client.setHost("127.0.0.1", port);
+
+        std::promise<std::size_t> connected;
+        client.prewarm(1, [&connected](std::size_t count) {
+            connected.set_value(count);
+        });
+        auto connectedCount = connected.get_future().get();
+
+        // Билеты сессий приходят вслед за рукопожатием: даём им дойти до свободного соединения
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        HTTP::Packet packet;
+        packet.target = "/";
+        auto response = client.request(HTTP::Get, packet);
+        auto isReused = (response.statusCode == 200 && response.timing.isConnectionReused &&
+                         response.timing.tlsHandshake.count() == 0);
+        std::printf("round %d: prewarmed %zu, status %u, connection reused %d, TLS handshake %lld us\n",
+                    round, connectedCount, response.statusCode, response.timing.isConnectionReused,
+                    static_cast<long long>(response.timing.tlsHandshake.count()));
+        isPassed = isPassed && connectedCount == 1 && isReused;
+    }
+
+    kill(serverPid, SIGKILL);
+    waitpid(serverPid, nullptr, 0);
+    std::remove(secureParameters.certFile.c_str());
+    std::remove(secureParameters.privKeyFile.c_str());
+
+    std::printf("%s\n", isPassed ? "PASSED" : "FAILED");
+    return (isPassed ? 0 : 1);
+}
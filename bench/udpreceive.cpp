@@ -0,0 +1,126 @@
+// Приём UDP::Server по одной датаграмме и пачками через recvmmsg. Пока обработчик задержан, в буфер сокета
+// складывается очередь датаграмм, затем замеряется время и процессорное время её разбора.
+//
+// network-bench-udpreceive [размер пачки = 1] [views|vectors] [датаграмм = 80000] [размер датаграммы = 64]
+//
+// Очередь должна поместиться в буфер сокета сервера, например: sysctl -w net.core.rmem_default=67108864
+
+#include <Components/Network/ServerUDP.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+
+double cpuTime()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t batchSize = (argc > 1 ? std::stoul(argv[1]) : 1);
+    bool isViews = (argc > 2 && std::string(argv[2]) == "views");
+    long datagramCount = (argc > 3 ? std::stol(argv[3]) : 80000);
+    std::size_t datagramSize = (argc > 4 ? std::stoul(argv[4]) : 64);
+
+    UDP::Server server;
+    std::atomic<long> receivedCount {0};
+    std::atomic<bool> isReleased {false};
+    std::atomic<long> checksum {0};
+    auto holdFirst = [&]() {
+        while (!isReleased) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+    if (isViews) {
+        server.setBatchProcessor([&](const std::vector<UDP::DatagramView>& batch) {
+            if (receivedCount == 0) {
+                holdFirst();
+            }
+            for (const auto& datagram : batch) {
+                checksum += datagram.data[0];
+            }
+            receivedCount += batch.size();
+        });
+    } else {
+        server.setRequestProcessor([&](std::vector<uint8_t>&& datagram) {
+            if (receivedCount == 0) {
+                holdFirst();
+            }
+            checksum += datagram[0];
+            ++receivedCount;
+        });
+    }
+    server.setReceiveBatchSize(batchSize, 2048);
+    if (!server.start(0)) {
+        std::fprintf(stderr, "Failed to start server\n");
+        return 1;
+    }
+
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto fd = socket(AF_INET, SOCK_DGRAM, 0);
+    connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+
+    const std::size_t sendBatchSize {64};
+    std::vector<uint8_t> payload(datagramSize, 1);
+    std::vector<iovec> iovecs(sendBatchSize, iovec{payload.data(), payload.size()});
+    std::vector<mmsghdr> messages(sendBatchSize);
+    for (std::size_t i = 0; i < sendBatchSize; ++i) {
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (long sent = 0; sent < datagramCount;) {
+        auto count = sendmmsg(fd, messages.data(), std::min<long>(sendBatchSize, datagramCount - sent), 0);
+        if (count <= 0) {
+            break;
+        }
+        sent += count;
+    }
+    close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto startCpu = cpuTime();
+    auto startTime = std::chrono::steady_clock::now();
+    isReleased = true;
+
+    // Остаток, не поместившийся в буфер, ядро отбросило: ждём, пока приём не остановится
+    long lastCount {-1};
+    auto lastProgress = std::chrono::steady_clock::now();
+    while (receivedCount < datagramCount) {
+        auto now = std::chrono::steady_clock::now();
+        if (receivedCount != lastCount) {
+            lastCount = receivedCount;
+            lastProgress = now;
+        } else if (now - lastProgress > std::chrono::milliseconds(100)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    auto finishTime = (receivedCount < datagramCount ? lastProgress : std::chrono::steady_clock::now());
+    auto elapsed = std::chrono::duration<double>(finishTime - startTime).count();
+    auto cpu = cpuTime() - startCpu;
+
+    std::printf("batch %zu, %s: received %ld/%ld, %.0f datagrams/s, %.3f us CPU per datagram\n",
+                batchSize, isViews ? "views" : "vectors", receivedCount.load(), datagramCount,
+                receivedCount / elapsed, cpu * 1e6 / std::max<long>(receivedCount, 1));
+    server.stop();
+    return 0;
+}
@@ -0,0 +1 @@
+#include "../../../src/UDP/reliable.hpp"
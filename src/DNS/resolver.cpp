@@ -0,0 +1,220 @@
+#include "resolver.hpp"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace DNS
+{
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+struct Resolver::Impl
+{
+    struct CacheEntry
+    {
+        boost::system::error_code ec;
+        Addresses addresses;
+        std::chrono::steady_clock::time_point expireTime;
+    };
+
+    // Asio выполняет getaddrinfo одного io_context в одном внутреннем потоке, поэтому у каждого
+    // исполнителя свой io_context: зависшее разрешение занимает только его
+    struct Worker
+    {
+        net::io_context ioc {1};
+        net::executor_work_guard<net::io_context::executor_type> work {net::make_work_guard(ioc)};
+        tcp::resolver resolver {ioc};
+        std::thread ioThread;
+        std::size_t activeCount {0};    // Под мьютексом резолвера
+    };
+
+    static constexpr std::size_t workerCount {4};
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, CacheEntry> cache;
+    std::unordered_map<std::string, std::vector<ResolveCallback> > pending;
+
+    std::chrono::milliseconds positiveTtl {60000};
+    std::chrono::milliseconds negativeTtl {5000};
+    std::size_t maxCacheSize {1024};
+
+    Impl() {
+        for (std::size_t i = 0; i < workerCount; ++i) {
+            auto worker = std::make_unique<Worker>();
+            worker->ioThread = std::thread([pWorker = worker.get()](){
+                pWorker->ioc.run();
+            });
+            workers.push_back(std::move(worker));
+        }
+    }
+
+    ~Impl() {
+        for (auto& worker : workers) {
+            worker->work.reset();
+            worker->ioc.stop();
+        }
+        for (auto& worker : workers) {
+            if (worker->ioThread.joinable()) {
+                worker->ioThread.join();
+            }
+        }
+    }
+
+    // Вызывается под мьютексом
+    Worker& leastBusyWorker() {
+        auto worker = std::min_element(workers.begin(), workers.end(), [](const auto& lhs, const auto& rhs){
+            return lhs->activeCount < rhs->activeCount;
+        });
+        return **worker;
+    }
+
+    // Вызывается под мьютексом
+    void store(const std::string& host, const CacheEntry& entry) {
+        if (maxCacheSize == 0) {
+            return;
+        }
+        if (cache.size() >= maxCacheSize && cache.count(host) == 0) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = cache.begin(); it != cache.end();) {
+                it = (it->second.expireTime <= now ? cache.erase(it) : std::next(it));
+            }
+        }
+        if (cache.size() >= maxCacheSize && cache.count(host) == 0) {
+            cache.erase(std::min_element(cache.begin(), cache.end(), [](const auto& lhs, const auto& rhs){
+                return lhs.second.expireTime < rhs.second.expireTime;
+            }));
+        }
+        cache[host] = entry;
+    }
+
+    void onResolved(Worker& worker, const std::string& host, const boost::system::error_code& ec, const tcp::resolver::results_type& results) {
+        CacheEntry entry;
+        entry.ec = ec;
+        for (const auto& result : results) {
+            entry.addresses.push_back(result.endpoint().address());
+        }
+        if (!ec && entry.addresses.empty()) {
+            entry.ec = net::error::host_not_found;
+        }
+
+        std::vector<ResolveCallback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --worker.activeCount;
+            entry.expireTime = std::chrono::steady_clock::now() + (entry.ec ? negativeTtl : positiveTtl);
+            store(host, entry);
+
+            auto pendingIt = pending.find(host);
+            if (pendingIt != pending.end()) {
+                callbacks = std::move(pendingIt->second);
+                pending.erase(pendingIt);
+            }
+        }
+
+        for (auto& cbk : callbacks) {
+            cbk(entry.ec, entry.addresses);
+        }
+    }
+};
+
+Resolver &Resolver::instance()
+{
+    static Resolver resolver;
+    return resolver;
+}
+
+Resolver::Resolver() :
+    d {std::make_unique<Impl>()}
+{
+
+}
+
+Resolver::~Resolver() = default;
+
+void Resolver::setPositiveTtl(std::chrono::milliseconds ttl)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->positiveTtl = ttl;
+}
+
+void Resolver::setNegativeTtl(std::chrono::milliseconds ttl)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->negativeTtl = ttl;
+}
+
+void Resolver::setMaxCacheSize(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->maxCacheSize = size;
+    while (d->cache.size() > size) {
+        d->cache.erase(d->cache.begin());
+    }
+}
+
+void Resolver::resolve(const std::string &host, ResolveCallback &&cbk)
+{
+    boost::system::error_code ec;
+    auto address = net::ip::make_address(host, ec);
+    if (!ec) {
+        cbk(ec, {address});
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(d->mutex);
+    auto cached = d->cache.find(host);
+    if (cached != d->cache.end()) {
+        if (cached->second.expireTime > std::chrono::steady_clock::now()) {
+            auto entry = cached->second;
+            lock.unlock();
+            cbk(entry.ec, entry.addresses);
+            return;
+        }
+        d->cache.erase(cached);
+    }
+
+    // Если имя уже разрешается, ждём тот же результат
+    auto& callbacks = d->pending[host];
+    callbacks.push_back(std::move(cbk));
+    if (callbacks.size() > 1) {
+        return;
+    }
+
+    auto& worker = d->leastBusyWorker();
+    ++worker.activeCount;
+    lock.unlock();
+
+    net::post(worker.ioc, [this, &worker, host](){
+        worker.resolver.async_resolve(host, "",
+            [this, &worker, host](const boost::system::error_code& ec, tcp::resolver::results_type results) {
+            d->onResolved(worker, host, ec, results);
+        });
+    });
+}
+
+boost::system::error_code Resolver::resolve(const std::string &host, Addresses &addresses)
+{
+    std::promise<boost::system::error_code> result;
+    auto resultFuture = result.get_future();
+    resolve(host, [&result, &addresses](const boost::system::error_code& ec, const Addresses& resolved){
+        addresses = resolved;
+        result.set_value(ec);
+    });
+    return resultFuture.get();
+}
+
+void Resolver::clear()
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->cache.clear();
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace DNS
+{
+
+/**
+ * @brief The Resolver class Общий для клиентов асинхронный резолвер имён.
+ *        Результаты кешируются (удачные и неудачные со своими TTL), одновременные запросы
+ *        одного и того же имени объединяются в одно обращение к DNS. Имена разрешаются в нескольких потоках:
+ *        медленный или не отвечающий DNS одного имени не задерживает остальные
+ */
+class Resolver
+{
+public:
+    using Addresses = std::vector<boost::asio::ip::address>;
+    using ResolveCallback = std::function<void(const boost::system::error_code&, const Addresses&)>;
+
+    /**
+     * @brief instance  Резолвер процесса. Разрешение идёт в его собственных потоках
+     */
+    static Resolver& instance();
+    ~Resolver();
+
+    /**
+     * @brief setPositiveTtl    Сколько хранить удачный результат разрешения
+     * @param ttl
+     */
+    void setPositiveTtl(std::chrono::milliseconds ttl);
+
+    /**
+     * @brief setNegativeTtl    Сколько хранить ошибку разрешения
+     * @param ttl
+     */
+    void setNegativeTtl(std::chrono::milliseconds ttl);
+
+    /**
+     * @brief setMaxCacheSize   Сколько имён хранить в кеше. При переполнении сначала удаляются устаревшие,
+     *                          затем те, что устареют раньше других
+     * @param size
+     */
+    void setMaxCacheSize(std::size_t size);
+
+    /**
+     * @brief resolve   Разрешить имя хоста. При попадании в кеш (и для IP адресов) колбек вызывается сразу
+     *                  в вызывающем потоке, иначе -- из одного из потоков резолвера
+     * @param host
+     * @param cbk
+     */
+    void resolve(const std::string& host, ResolveCallback&& cbk);
+
+    /**
+     * @brief resolve   Синхронный вариант: ждёт результат, если его нет в кеше
+     * @param host
+     * @param addresses Адреса хоста
+     * @return          Код ошибки разрешения
+     */
+    boost::system::error_code resolve(const std::string& host, Addresses& addresses);
+
+    /**
+     * @brief clear Сбросить кеш
+     */
+    void clear();
+
+private:
+    Resolver();
+
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
+
+}
@@ -1,125 +1,1693 @@
 #include "client.hpp"
 
-#include <variant>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <future>
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/asio/ssl.hpp>
 
 #include <Components/Logger/Logger.h>
-#include <boost/asio/read_until.hpp>
 
-#include <thread>
+#include "connectionpool.hpp"
+#include "contentdecoder.hpp"
+#include "downloadbody.hpp"
+#include "loadbalancer.hpp"
+#include "preparedbody.hpp"
+#include "responsecache.hpp"
+#include "tlssessioncache.hpp"
+#include "uploadbody.hpp"
+#include "../DNS/resolver.hpp"
+
+#ifdef COMPONENTS_NETWORK_HTTP2
+#include "http2session.hpp"
+#endif
+
+#include <random>
+#include <unordered_set>
 
 namespace HTTP
 {
 
-namespace beast = boost::beast;
-namespace http = beast::http;
-namespace net = boost::asio;
-namespace ssl = net::ssl;
-using tcp = net::ip::tcp;
+namespace
+{
+
+// Ошибки, которыми заканчивается запрос в соединение, закрытое сервером пока оно лежало в пуле
+bool isStaleConnectionError(const beast::error_code& ec)
+{
+    return (ec == net::error::eof ||
+            ec == net::error::connection_reset ||
+            ec == net::error::connection_aborted ||
+            ec == net::error::broken_pipe ||
+            ec == http::error::end_of_stream ||
+            ec == ssl::error::stream_truncated);
+}
+
+template <typename Body>
+bool rewindBody(http::request<Body>&)
+{
+    return true;
+}
+
+bool rewindBody(http::request<UploadBody>& req)
+{
+    return req.body()->rewind();
+}
+
+template <typename Body>
+void writeRequest(ClientConnection& conn, const std::shared_ptr<http::request<Body> >& req, ClientConnection::WriteHandler&& handler)
+{
+    conn.visit([&](auto& stream){
+        http::async_write(stream, *req, [handler = std::move(handler)](beast::error_code ec, std::size_t) {
+            handler(ec);
+        });
+    });
+}
+
+// Файл известной длины без TLS уходит через sendfile: заголовок пишет сериализатор, тело копирует ядро
+void writeRequest(ClientConnection& conn, const std::shared_ptr<http::request<UploadBody> >& req, ClientConnection::WriteHandler&& handler)
+{
+    conn.visit([&](auto& stream){
+        if constexpr (std::is_same_v<std::decay_t<decltype(stream)>, beast::tcp_stream>) {
+            if (req->body()->fileDescriptor() != -1 && !req->chunked()) {
+                auto serializer = std::make_shared<http::request_serializer<UploadBody> >(*req);
+                serializer->split(true);
+                http::async_write_header(stream, *serializer,
+                    [&stream, req, serializer, handler = std::move(handler)](beast::error_code ec, std::size_t) mutable {
+                    if (ec) {
+                        handler(ec);
+                        return;
+                    }
+                    UploadBody::asyncSendFile(stream.socket(), req->body(), std::move(handler));
+                });
+                return;
+            }
+        }
+
+        http::async_write(stream, *req, [handler = std::move(handler)](beast::error_code ec, std::size_t) {
+            handler(ec);
+        });
+    });
+}
+
+// Заголовок заготовки сериализован заранее: запрос уходит одной записью из готового заголовка,
+// строки Content-Length и тела, без сериализатора и копирования тела
+void writeRequest(ClientConnection& conn, const std::shared_ptr<http::request<PreparedBody> >& req, ClientConnection::WriteHandler&& handler)
+{
+    const auto& body = req->body();
+    auto contentLength = body.contentLength();
+    std::array<net::const_buffer, 3> buffers {
+        net::buffer(body.requestTemplate->head),
+        net::buffer(contentLength.data(), contentLength.size()),
+        (body.data ? net::buffer(*body.data) : net::const_buffer())
+    };
+    conn.visit([&](auto& stream){
+        net::async_write(stream, buffers, [req, handler = std::move(handler)](beast::error_code ec, std::size_t) {
+            handler(ec);
+        });
+    });
+}
+
+#ifdef COMPONENTS_NETWORK_HTTP2
+
+// Заголовки запроса: у запроса по заготовке они хранятся в заготовке
+template <typename Body>
+const http::fields& requestFields(const http::request<Body>& req)
+{
+    return req;
+}
+
+const http::fields& requestFields(const http::request<PreparedBody>& req)
+{
+    return req.body().requestTemplate->fields;
+}
+
+// Заголовки соединения HTTP/1.1 в HTTP/2 запрещены (RFC 9113, 8.2.2)
+bool isConnectionSpecific(http::field field)
+{
+    return (field == http::field::host ||
+            field == http::field::connection ||
+            field == http::field::keep_alive ||
+            field == http::field::proxy_connection ||
+            field == http::field::transfer_encoding ||
+            field == http::field::upgrade);
+}
+
+// Чтение тела запроса для потока HTTP/2 через writer тела Beast
+template <typename Body>
+std::function<std::size_t(uint8_t*, std::size_t, bool&, beast::error_code&)> http2BodySource(const std::shared_ptr<http::request<Body> >& req)
+{
+    struct Source
+    {
+        std::shared_ptr<http::request<Body> > req;
+        typename Body::writer writer;
+        bool isInitialized {false};
+        bool isLastChunk {false};
+        std::string chunk;
+        std::size_t chunkOffset {0};
+
+        explicit Source(const std::shared_ptr<http::request<Body> >& req) :
+            req {req},
+            writer {*req, req->body()} {
+
+        }
+    };
+    auto source = std::make_shared<Source>(req);
+
+    return [source](uint8_t* data, std::size_t size, bool& isEof, beast::error_code& ec) -> std::size_t {
+        if (!source->isInitialized) {
+            source->writer.init(ec);
+            if (ec) {
+                return 0;
+            }
+            source->isInitialized = true;
+        }
+
+        while (source->chunkOffset == source->chunk.size() && !source->isLastChunk) {
+            auto result = source->writer.get(ec);
+            if (ec) {
+                return 0;
+            }
+            if (!result) {
+                source->isLastChunk = true;
+                break;
+            }
+            source->chunk = beast::buffers_to_string(result->first);
+            source->chunkOffset = 0;
+            source->isLastChunk = !result->second;
+        }
+
+        auto readSize = std::min(size, source->chunk.size() - source->chunkOffset);
+        std::memcpy(data, source->chunk.data() + source->chunkOffset, readSize);
+        source->chunkOffset += readSize;
+        isEof = (source->isLastChunk && source->chunkOffset == source->chunk.size());
+        return readSize;
+    };
+}
+
+#endif
+
+// Запросы, которые можно отправлять в конвейер: повтор не меняет состояние сервера (RFC 7230, 6.3.2)
+bool isIdempotent(http::verb method)
+{
+    switch (method)
+    {
+    case http::verb::get:
+    case http::verb::head:
+    case http::verb::put:
+    case http::verb::delete_:
+    case http::verb::options:
+    case http::verb::trace:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Ответы перегруженного или недоступного upstream: идемпотентный запрос стоит повторить
+bool isRetryableStatus(http::status status)
+{
+    return (status == http::status::bad_gateway ||
+            status == http::status::service_unavailable ||
+            status == http::status::gateway_timeout);
+}
+
+/**
+ * Одна попытка выполнения запроса. Её отменяют по истечении срока запроса
+ * или когда ответ пришёл на параллельную попытку: отмена закрывает соединение
+ * или сбрасывает поток HTTP/2, на котором попытка сейчас выполняется
+ */
+class RequestAttempt
+{
+public:
+    // Задать способ отмены для соединения или потока target. false, если попытка уже отменена
+    bool attach(const void* target, std::function<void()>&& cancelHandler) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_isCancelled) {
+            return false;
+        }
+        m_target = target;
+        m_cancelHandler = std::move(cancelHandler);
+        return true;
+    }
+
+    void detach() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_target = nullptr;
+        m_cancelHandler = {};
+    }
+
+    bool isAttachedTo(const void* target) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (m_target == target);
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isCancelled = true;
+        if (m_cancelHandler) {
+            m_cancelHandler();
+        }
+    }
+
+    bool isCancelled() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_isCancelled;
+    }
+
+    // Время этапов и хост попытки. Этапы идут друг за другом в обработчиках одной цепочки операций, блокировка не нужна
+    RequestTiming& timing() {
+        return m_timing;
+    }
+
+    void startPhase() {
+        m_phaseStart = std::chrono::steady_clock::now();
+    }
+
+    // Длительность этапа с прошлой отметки, следующий этап отсчитывается от этого момента
+    std::chrono::microseconds finishPhase() {
+        auto now = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(now - m_phaseStart);
+        m_phaseStart = now;
+        return duration;
+    }
+
+    void setAddress(const HostAddress& address) {
+        m_address = address;
+    }
+
+    const HostAddress& address() const {
+        return m_address;
+    }
+
+private:
+    std::mutex              m_mutex;
+    bool                    m_isCancelled {false};
+    const void*             m_target {nullptr};
+    std::function<void()>   m_cancelHandler;
+
+    RequestTiming           m_timing;
+    std::chrono::steady_clock::time_point m_phaseStart;
+    HostAddress             m_address;
+};
+
+// Задержка повтора с полным случайным разбросом (full jitter): повторы разных клиентов не совпадают по времени
+std::chrono::milliseconds retryDelay(const RequestPolicy& policy, unsigned retryNumber)
+{
+    thread_local std::mt19937 generator {std::random_device{}()};
+
+    auto maxDelay = policy.retryBackoff.count() << std::min(retryNumber, 16u);
+    maxDelay = std::min<std::chrono::milliseconds::rep>(maxDelay, policy.maxRetryBackoff.count());
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(0, std::max<std::chrono::milliseconds::rep>(maxDelay, 0));
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+// Время ответа последних запросов к хосту, по нему выбирается задержка дубля запроса
+class LatencyWindow
+{
+public:
+    void add(std::chrono::microseconds latency) {
+        m_samples.push_back(latency);
+        if (m_samples.size() > maxSampleCount) {
+            m_samples.pop_front();
+        }
+    }
+
+    std::optional<std::chrono::microseconds> percentile(unsigned percent) const {
+        if (m_samples.size() < minSampleCount) {
+            return std::nullopt;
+        }
+        std::vector<std::chrono::microseconds> samples(m_samples.begin(), m_samples.end());
+        auto position = samples.begin() + (samples.size() - 1) * percent / 100;
+        std::nth_element(samples.begin(), position, samples.end());
+        return *position;
+    }
+
+private:
+    static constexpr std::size_t maxSampleCount {256};
+    static constexpr std::size_t minSampleCount {20};
+
+    std::deque<std::chrono::microseconds> m_samples;
+};
+
+}
+
+// Обработчики асинхронных операций держат Impl (pSelf): io_context общий и продолжает работать после удаления клиента
+struct Client::Impl : public std::enable_shared_from_this<Client::Impl>
+{
+    net::io_context& ioc;
+
+    std::shared_ptr<ssl::context> ctx;
+    std::shared_ptr<ConnectionPool> pool;
+    std::shared_ptr<LoadBalancer> balancer {std::make_shared<LoadBalancer>()};
+
+    std::string host;
+    std::string port;
+    bool isSecure {false};
+    bool isLoggingEnabled {false};
+
+    std::string clientName {"TestApp"};
+    uint32_t maxFileSize {1024 * 1024 * 1024};
+    std::chrono::milliseconds connectionAttemptDelay {250};
+    RequestPolicy requestPolicy;
+    bool isCompressionEnabled {true};
+    ResponseCache responseCache;
+
+    std::mutex latencyMutex;
+    std::unordered_map<std::string, LatencyWindow> hostLatencies;
+    std::map<std::string, HostTimingStats> hostTimings;
+
+    // io_context передан пользователем: его могут не обслуживать, синхронные вызовы выполняют обработчики сами
+    bool canDriveContext {false};
+    std::mutex driveMutex;
+
+    bool isHttp2Enabled {false};
+#ifdef COMPONENTS_NETWORK_HTTP2
+    std::mutex http2Mutex;
+    std::unordered_map<std::string, std::shared_ptr<Http2Session> > http2Sessions;
+    std::unordered_set<std::string> http1Hosts;
+#endif
+
+    Impl(net::io_context& ioc, bool isSecure, bool verifyCertificate) :
+        ioc {ioc},
+        ctx {std::make_shared<ssl::context>(ssl::context::tls_client)},
+        pool {std::make_shared<ConnectionPool>(ioc, ctx)},
+        isSecure {isSecure} {
+        ctx->set_verify_mode(verifyCertificate ? ssl::verify_peer : ssl::verify_none);
+        TlsSessionCache::install(*ctx);
+    }
+
+    template <typename...Args>
+    void logInfo(Args&&...args) {
+        if (!isLoggingEnabled) {
+            return;
+        }
+        COMPLOG_INFO("[HTTP CLIENT", this, "]", args...);
+    }
+
+    template <typename...Args>
+    void logWarning(Args&&...args) {
+        if (!isLoggingEnabled) {
+            return;
+        }
+        COMPLOG_WARNING("[HTTP CLIENT", this, "]", args...);
+    }
+
+    template <typename...Args>
+    void logError(Args&&...args) {
+        if (!isLoggingEnabled) {
+            return;
+        }
+        COMPLOG_ERROR("[HTTP CLIENT", this, "]", args...);
+    }
+
+    template <typename...Args>
+    void logOk(Args&&...args) {
+        if (!isLoggingEnabled) {
+            return;
+        }
+        COMPLOG_OK("[HTTP CLIENT", this, "]", args...);
+    }
+
+    // Адрес хоста для target. Абсолютный URL в target заменяется на путь
+    HostAddress targetAddress(std::string& target) const {
+        HostAddress address {isSecure, host, port};
+
+        auto schemeEnd = target.find("://");
+        if (schemeEnd == std::string::npos) {
+            return address;
+        }
+        address.isSecure = (target.compare(0, schemeEnd, "https") == 0);
+
+        auto hostBegin = schemeEnd + 3;
+        auto pathBegin = std::min(target.find_first_of("/?", hostBegin), target.size());
+        auto hostPort = target.substr(hostBegin, pathBegin - hostBegin);
+        auto portBegin = hostPort.rfind(':');
+        if (portBegin != std::string::npos && hostPort.find(']', portBegin) == std::string::npos) {
+            address.port = hostPort.substr(portBegin + 1);
+            hostPort.resize(portBegin);
+        } else {
+            address.port = address.isSecure ? "443" : "80";
+        }
+        if (hostPort.size() > 1 && hostPort.front() == '[' && hostPort.back() == ']') {
+            hostPort = hostPort.substr(1, hostPort.size() - 2);
+        }
+        address.host = hostPort;
+
+        target = (pathBegin < target.size() ? target.substr(pathBegin) : "/");
+        if (target.front() != '/') {
+            target.insert(target.begin(), '/');
+        }
+        return address;
+    }
+
+    std::shared_ptr<http::request<http::dynamic_body> > createRequest(http::verb method,
+                                                                      const std::string& target,
+                                                                      const std::string& hostName,
+                                                                      const Packet& pkt) {
+        auto req = std::make_shared<http::request<http::dynamic_body> >(method, target, 11);
+        req->set(http::field::user_agent, clientName);
+        req->set(http::field::host, hostName);
+        req->set(http::field::content_type, pkt.toString(pkt.bodyType));
+        beast::ostream(req->body()) << pkt.body;
+        req->set(http::field::accept, pkt.toString(pkt.acceptableType));
+        if (isCompressionEnabled && !ContentDecoder::acceptEncoding().empty()) {
+            req->set(http::field::accept_encoding, ContentDecoder::acceptEncoding());
+        }
+        req->prepare_payload();
+        return req;
+    }
+
+    // Запрос по заготовке: заголовки уже сериализованы, тело не копируется
+    std::shared_ptr<http::request<PreparedBody> > createRequest(const std::shared_ptr<const RequestTemplate::Data>& requestTemplate,
+                                                                const std::shared_ptr<const std::string>& body) {
+        auto req = std::make_shared<http::request<PreparedBody> >(requestTemplate->method, requestTemplate->target, 11);
+        req->body().requestTemplate = requestTemplate;
+        req->body().setData(body);
+        return req;
+    }
+
+    // Ответ в Packet. Сжатое тело распаковывается, false -- распаковать не удалось
+    bool fillResponse(const http::response<http::dynamic_body>& res, Packet& resp) {
+        resp.statusCode = res.result_int();
+        if (resp.statusCode != 200) {
+            logWarning("Response status:", http::obsolete_reason(res.result()));
+        }
+
+        if (res.count(http::field::content_type)) {
+            resp.bodyType = resp.fromString(to_string(res.at(http::field::content_type)));
+            if (resp.bodyType != resp.acceptableType) {
+                logWarning("Got packet of inacceptable type (", resp.toString(resp.bodyType), "!=", resp.toString(resp.acceptableType), ")");
+            }
+        }
+        resp.body = beast::buffers_to_string(res.body().data());
+
+        if (res.count(http::field::content_encoding)) {
+            auto contentEncoding = res[http::field::content_encoding];
+            if (!ContentDecoder::decode(std::string_view(contentEncoding.data(), contentEncoding.size()), resp.body, maxFileSize)) {
+                logError("Failed to decode response body:", contentEncoding);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Порядок попыток подключения: сначала адрес, выигравший в прошлый раз, дальше семейства адресов чередуются (RFC 8305)
+    std::vector<tcp::endpoint> orderEndpoints(const HostAddress& address,
+                                              const DNS::Resolver::Addresses& addresses,
+                                              uint16_t port) {
+        std::vector<tcp::endpoint> firstFamily;
+        std::vector<tcp::endpoint> secondFamily;
+        for (const auto& hostAddress : addresses) {
+            auto& familyEndpoints = (hostAddress.is_v6() == addresses.front().is_v6()) ? firstFamily : secondFamily;
+            familyEndpoints.emplace_back(hostAddress, port);
+        }
+
+        std::vector<tcp::endpoint> endpoints;
+        for (std::size_t i = 0; i < std::max(firstFamily.size(), secondFamily.size()); ++i) {
+            if (i < firstFamily.size()) {
+                endpoints.push_back(firstFamily[i]);
+            }
+            if (i < secondFamily.size()) {
+                endpoints.push_back(secondFamily[i]);
+            }
+        }
+
+        auto preferred = pool->preferredEndpoint(address);
+        if (preferred) {
+            auto preferredIt = std::find(endpoints.begin(), endpoints.end(), *preferred);
+            if (preferredIt != endpoints.end()) {
+                std::rotate(endpoints.begin(), preferredIt, preferredIt + 1);
+            }
+        }
+        return endpoints;
+    }
+
+    void connect(const ConnectionPool::ConnectionPtr& conn, std::function<void(beast::error_code)>&& cbk) {
+        const auto& address = conn->address();
+        logInfo("Connecting to host:", address.host, address.port);
+
+        auto resolveStartTime = std::chrono::steady_clock::now();
+        DNS::Resolver::instance().resolve(address.host,
+            [this, pSelf = shared_from_this(), conn, resolveStartTime, cbk = std::move(cbk)](const beast::error_code& ec, const DNS::Resolver::Addresses& addresses) mutable {
+            conn->setResolveTime(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - resolveStartTime));
+            if (ec) {
+                logError("Error resolving host:", ec.message());
+                cbk(ec);
+                return;
+            }
+
+            const auto& portString = conn->address().port;
+            uint16_t port {0};
+            if (std::from_chars(portString.data(), portString.data() + portString.size(), port).ec != std::errc()) {
+                logError("Invalid port:", portString);
+                cbk(net::error::invalid_argument);
+                return;
+            }
+
+            auto endpoints = orderEndpoints(conn->address(), addresses, port);
+            conn->asyncConnect(endpoints, connectionAttemptDelay, [this, pSelf = shared_from_this(), conn, cbk = std::move(cbk)](beast::error_code ec) {
+                if (ec) {
+                    logError("Error connecting:", ec.message());
+                } else {
+                    logOk("Connected to", conn->address().host, "(", conn->remoteEndpoint().address().to_string(), ")",
+                          conn->isSessionReused() ? "TLS session resumed" : "");
+                    pool->setPreferredEndpoint(conn->address(), conn->remoteEndpoint());
+                }
+                cbk(ec);
+            });
+        });
+    }
+
+    static void setConnectTiming(RequestTiming& timing, const ClientConnection::ConnectTiming& connectTiming) {
+        timing.dns = connectTiming.dns;
+        timing.connect = connectTiming.connect;
+        timing.tlsHandshake = connectTiming.tlsHandshake;
+    }
+
+    // Отмена попытки закрывает её соединение. Проверка повторяется в strand соединения:
+    // к этому моменту обмен мог завершиться, а соединение -- вернуться в пул
+    bool attachAttempt(const std::shared_ptr<RequestAttempt>& attempt, const ConnectionPool::ConnectionPtr& conn) {
+        return attempt->attach(conn.get(), [pWeakAttempt = std::weak_ptr<RequestAttempt>(attempt), conn](){
+            net::post(conn->executor(), [pWeakAttempt, conn](){
+                auto attempt = pWeakAttempt.lock();
+                if (attempt && attempt->isAttachedTo(conn.get())) {
+                    conn->abort();
+                }
+            });
+        });
+    }
+
+    // Запрос к хосту. Запросы к хосту по умолчанию при заданных upstream уходят на хост, выбранный балансировщиком
+    template <typename RequestBody, typename ResponseBody>
+    void performRequest(const HostAddress& address,
+                        const std::shared_ptr<http::request<RequestBody> >& req,
+                        const std::shared_ptr<http::response_parser<ResponseBody> >& res,
+                        std::function<void(beast::error_code)>&& cbk,
+                        const std::shared_ptr<RequestAttempt>& attempt = nullptr) {
+        std::optional<HostAddress> upstream;
+        if (address.isSecure == isSecure && address.host == host && address.port == port) {
+            upstream = balancer->pick();
+        }
+        if (!upstream) {
+            performHostRequest(address, req, res, std::move(cbk), 1, attempt);
+            return;
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        performHostRequest(*upstream, req, res,
+            [this, pSelf = shared_from_this(), upstream = *upstream, res, startTime, cbk = std::move(cbk)](beast::error_code ec) {
+            // Отменённая попытка (проигравший hedge, дедлайн, прерывание) ничего не говорит о состоянии хоста,
+            // но выбор хоста всё равно завершается
+            if (ec == net::error::operation_aborted) {
+                balancer->release(upstream);
+            } else {
+                auto isSuccess = (!ec && res->get().result_int() < 500);
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+                if (balancer->report(upstream, isSuccess, latency)) {
+                    logWarning("Upstream ejected after consecutive failures:", upstream.toString());
+                }
+            }
+            cbk(ec);
+        }, 1, attempt);
+    }
+
+    // Запрос на соединении из пула: соединение возвращается в пул до вызова колбека.
+    // Если переиспользованное соединение оказалось закрытым сервером, запрос один раз повторяется.
+    // Запросы, которые сервер не обработал из-за закрытия конвейера, повторяются всегда.
+    // Отменённая попытка (attempt) завершается с operation_aborted
+    template <typename RequestBody, typename ResponseBody>
+    void performHostRequest(const HostAddress& address,
+                            const std::shared_ptr<http::request<RequestBody> >& req,
+                            const std::shared_ptr<http::response_parser<ResponseBody> >& res,
+                            std::function<void(beast::error_code)>&& cbk,
+                            unsigned retriesLeft,
+                            const std::shared_ptr<RequestAttempt>& attempt) {
+        logInfo("Request:", req->method_string(), req->target(), "to", address.toString());
+        if (attempt) {
+            attempt->setAddress(address);
+            attempt->timing() = RequestTiming{};
+        }
+#ifdef COMPONENTS_NETWORK_HTTP2
+        if (isHttp2Enabled) {
+            auto session = http2Session(address);
+            if (session) {
+                performHttp2Request(session, address, req, res, std::move(cbk), attempt);
+                return;
+            }
+        }
+#endif
+        pool->acquire(address, [this, pSelf = shared_from_this(), address, req, res, cbk = std::move(cbk), retriesLeft, attempt](ConnectionPool::ConnectionPtr conn) mutable {
+            if (attempt && !attachAttempt(attempt, conn)) {
+                pool->release(conn, true);
+                cbk(net::error::operation_aborted);
+                return;
+            }
+
+            if (conn->isOpen()) {
+                if (attempt) {
+                    attempt->timing().isConnectionReused = true;
+                }
+                exchange(std::move(conn), address, req, res, std::move(cbk), retriesLeft, attempt);
+                return;
+            }
+
+            connect(conn, [this, pSelf = shared_from_this(), conn, address, req, res, cbk = std::move(cbk), attempt](beast::error_code ec) mutable {
+                if (!ec && attempt && attempt->isCancelled()) {
+                    ec = net::error::operation_aborted;
+                }
+                if (ec) {
+                    if (attempt) {
+                        attempt->detach();
+                    }
+                    pool->release(conn, false);
+                    cbk(ec);
+                    return;
+                }
+                if (attempt) {
+                    setConnectTiming(attempt->timing(), conn->connectTiming());
+                }
+                exchange(conn, address, req, res, std::move(cbk), 0, attempt);
+                pool->dispatchWaiters(conn);
+            });
+        }, isIdempotent(req->method()));
+    }
+
+    template <typename RequestBody, typename ResponseBody>
+    void exchange(ConnectionPool::ConnectionPtr conn,
+                  const HostAddress& address,
+                  const std::shared_ptr<http::request<RequestBody> >& req,
+                  const std::shared_ptr<http::response_parser<ResponseBody> >& res,
+                  std::function<void(beast::error_code)>&& cbk,
+                  unsigned retriesLeft,
+                  const std::shared_ptr<RequestAttempt>& attempt) {
+        conn->enqueue(
+            [req, attempt](ClientConnection& conn, ClientConnection::WriteHandler&& handler) {
+            if (!attempt) {
+                writeRequest(conn, req, std::move(handler));
+                return;
+            }
+            attempt->startPhase();
+            writeRequest(conn, req, [attempt, handler = std::move(handler)](beast::error_code ec) {
+                attempt->timing().requestWrite = attempt->finishPhase();
+                handler(ec);
+            });
+        },
+            [req, res, attempt](ClientConnection& conn, ClientConnection::ReadHandler&& handler) {
+            conn.visit([&](auto& stream){
+                auto onRead = [req, res, handler = std::move(handler)](beast::error_code ec, std::size_t) {
+                    handler(ec, !ec && req->keep_alive() && res->get().keep_alive());
+                };
+                if (!attempt) {
+                    http::async_read(stream, conn.buffer(), *res, std::move(onRead));
+                    return;
+                }
+
+                // Заголовки читаются отдельно от тела, чтобы разделить ожидание ответа и приём тела.
+                // Поток и буфер живут, пока жив обработчик чтения: он держит соединение
+                http::async_read_header(stream, conn.buffer(), *res,
+                    [&stream, &buffer = conn.buffer(), res, attempt, onRead = std::move(onRead)](beast::error_code ec, std::size_t size) mutable {
+                    attempt->timing().timeToFirstByte = attempt->finishPhase();
+                    if (ec) {
+                        onRead(ec, size);
+                        return;
+                    }
+                    http::async_read(stream, buffer, *res, [attempt, onRead = std::move(onRead)](beast::error_code ec, std::size_t size) mutable {
+                        attempt->timing().bodyTransfer = attempt->finishPhase();
+                        onRead(ec, size);
+                    });
+                });
+            });
+        },
+            [this, pSelf = shared_from_this(), address, req, res, cbk = std::move(cbk), retriesLeft, attempt](const ConnectionPool::ConnectionPtr& conn, beast::error_code ec) mutable {
+            // До возврата в пул: отмена попытки больше не должна закрывать это соединение
+            if (attempt) {
+                attempt->detach();
+            }
+            if (!ec) {
+                pool->release(conn, req->keep_alive() && res->get().keep_alive());
+                cbk(ec);
+                return;
+            }
+
+            pool->release(conn, false);
+            if (attempt && attempt->isCancelled()) {
+                cbk(net::error::operation_aborted);
+                return;
+            }
+            if (ec == net::error::try_again && rewindBody(*req)) {
+                logWarning("Request was not processed by host, resending");
+                performHostRequest(address, req, res, std::move(cbk), retriesLeft, attempt);
+                return;
+            }
+            if (retriesLeft > 0 && isStaleConnectionError(ec) && !res->got_some() && rewindBody(*req)) {
+                logWarning("Pooled connection was closed by host, retrying request:", ec.message());
+                performHostRequest(address, req, res, std::move(cbk), retriesLeft - 1, attempt);
+                return;
+            }
+            logError("Request failed:", ec.message());
+            cbk(ec);
+        });
+    }
+
+#ifdef COMPONENTS_NETWORK_HTTP2
+    // Общая HTTP/2 сессия до хоста. nullptr, если хост не согласовал h2 и запросы идут по HTTP/1.1.
+    // onConnected вызывается, когда сессия начнёт обмен: для уже подключённой -- сразу, для подключающейся --
+    // по завершении подключения. try_again -- хост не поддерживает h2
+    std::shared_ptr<Http2Session> http2Session(const HostAddress& address, std::function<void(beast::error_code)>&& onConnected = {}) {
+        std::unique_lock<std::mutex> lock(http2Mutex);
+        auto hostKey = address.toString();
+        if (http1Hosts.count(hostKey)) {
+            return nullptr;
+        }
+
+        auto& session = http2Sessions[hostKey];
+        if (session && !session->isClosed()) {
+            auto existingSession = session;
+            lock.unlock();
+            if (onConnected) {
+                existingSession->whenStarted(std::move(onConnected));
+            }
+            return existingSession;
+        }
+
+        auto conn = std::make_shared<ClientConnection>(ioc, address, ctx);
+        conn->setAlpnProtocols({"h2", "http/1.1"});
+        session = std::make_shared<Http2Session>(conn);
+        if (onConnected) {
+            session->whenStarted(std::move(onConnected));
+        }
+
+        connect(conn, [this, pSelf = shared_from_this(), session, hostKey](beast::error_code ec) {
+            if (ec) {
+                session->fail(ec);
+                return;
+            }
+
+            // Без TLS используется h2c с заранее известной поддержкой (prior knowledge)
+            const auto& conn = session->connection();
+            if (conn->address().isSecure && conn->negotiatedProtocol() != "h2") {
+                logWarning("Host does not support HTTP/2, using HTTP/1.1:", hostKey);
+                {
+                    std::lock_guard<std::mutex> lock(http2Mutex);
+                    http1Hosts.insert(hostKey);
+                }
+                session->fail(net::error::try_again);
+                return;
+            }
+            logInfo("Using HTTP/2 for host:", hostKey);
+            session->start();
+        });
+        return session;
+    }
+
+    // Поток, открытый до установки сессии, ждал подключения: его этапы вычитаются из ожидания ответа
+    static void recordHttp2Timing(RequestAttempt& attempt, const ClientConnection::ConnectTiming& connectTiming) {
+        auto& timing = attempt.timing();
+        timing.bodyTransfer = attempt.finishPhase();
+        if (timing.isConnectionReused) {
+            return;
+        }
+        setConnectTiming(timing, connectTiming);
+        auto connectDuration = timing.dns + timing.connect + timing.tlsHandshake;
+        timing.timeToFirstByte = std::max(timing.timeToFirstByte - connectDuration, std::chrono::microseconds(0));
+    }
+
+    // Запрос потоком HTTP/2. Ответ собирается в тот же парсер, что и для HTTP/1.1,
+    // поэтому вызывающий код не различает версии протокола
+    template <typename RequestBody, typename ResponseBody>
+    void performHttp2Request(const std::shared_ptr<Http2Session>& session,
+                             const HostAddress& address,
+                             const std::shared_ptr<http::request<RequestBody> >& req,
+                             const std::shared_ptr<http::response_parser<ResponseBody> >& res,
+                             std::function<void(beast::error_code)>&& cbk,
+                             const std::shared_ptr<RequestAttempt>& attempt) {
+        auto isDefaultPort = (address.port == (address.isSecure ? "443" : "80"));
+        Http2Session::HeaderList headers {
+            {":method", std::string(req->method_string())},
+            {":scheme", address.isSecure ? "https" : "http"},
+            {":authority", isDefaultPort ? address.host : address.host + ":" + address.port},
+            {":path", std::string(req->target())}
+        };
+        for (const auto& field : requestFields(*req)) {
+            if (isConnectionSpecific(field.name())) {
+                continue;
+            }
+            auto name = std::string(field.name_string());
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+            headers.emplace_back(std::move(name), std::string(field.value()));
+        }
+
+        struct ResponseSink
+        {
+            typename ResponseBody::reader reader;
+            bool isInitialized {false};
+            std::uint64_t bodySize {0};
+
+            explicit ResponseSink(http::response<ResponseBody>& res) :
+                reader {res, res.body()} {
+
+            }
+        };
+        auto sink = std::make_shared<ResponseSink>(res->get());
+
+        // Отправка потока не отделима от других потоков сессии: первый этап длится до заголовков ответа
+        if (attempt) {
+            attempt->timing().isConnectionReused = session->connection()->isAlive();
+            attempt->startPhase();
+        }
+
+        Http2Session::StreamHandler handler;
+        handler.onHeader = [res, attempt](const std::string& name, const std::string& value) {
+            if (name != ":status") {
+                res->get().insert(name, value);
+                return;
+            }
+            if (attempt && attempt->timing().timeToFirstByte.count() == 0) {
+                attempt->timing().timeToFirstByte = attempt->finishPhase();
+            }
+            unsigned status {0};
+            std::from_chars(value.data(), value.data() + value.size(), status);
+            res->get().result(status);
+        };
+
+        // Ограничение на тело ответа: у HTTP/1.1 его проверяет парсер, здесь -- по наибольшему допустимому размеру файла
+        handler.onData = [sink, limit = maxFileSize](const uint8_t* data, std::size_t size) {
+            beast::error_code ec;
+            if (!sink->isInitialized) {
+                sink->reader.init(boost::none, ec);
+                sink->isInitialized = true;
+            }
+            sink->bodySize += size;
+            if (ec || sink->bodySize > limit) {
+                return false;
+            }
+            sink->reader.put(net::buffer(data, size), ec);
+            return !ec;
+        };
+
+        handler.onClose = [this, pSelf = shared_from_this(), conn = session->connection(), address, req, res, sink, cbk = std::move(cbk), attempt](beast::error_code ec) mutable {
+            if (attempt) {
+                attempt->detach();
+                if (attempt->isCancelled()) {
+                    cbk(net::error::operation_aborted);
+                    return;
+                }
+                recordHttp2Timing(*attempt, conn->connectTiming());
+            }
+            if (ec == net::error::try_again && rewindBody(*req)) {
+                performHostRequest(address, req, res, std::move(cbk), 1, attempt);
+                return;
+            }
+            if (!ec && !sink->isInitialized) {
+                sink->reader.init(boost::none, ec);
+            }
+            if (!ec) {
+                sink->reader.finish(ec);
+            }
+            if (ec) {
+                logError("Request failed:", ec.message());
+            }
+            cbk(ec);
+        };
+
+        auto payloadSize = req->payload_size();
+        if (!payloadSize || *payloadSize > 0) {
+            handler.readBody = http2BodySource(req);
+        }
+        auto requestId = session->submit(std::move(headers), std::move(handler));
+        if (attempt && !attempt->attach(session.get(), [session, requestId](){ session->cancel(requestId); })) {
+            session->cancel(requestId);
+        }
+    }
+#endif
+
+    using DownloadCallback = std::function<void(beast::error_code, const http::response<DownloadBody>&)>;
+
+    // Загрузка диапазона first-last (или до конца, если last не задан) прямо в файл
+    void downloadRange(const HostAddress& address,
+                       const std::string& target,
+                       const std::shared_ptr<DownloadBody::File>& file,
+                       std::uint64_t first,
+                       std::optional<std::uint64_t> last,
+                       bool isFullResponseAccepted,
+                       DownloadCallback&& cbk) {
+        auto req = std::make_shared<http::request<http::empty_body> >(http::verb::get, target, 11);
+        req->set(http::field::user_agent, clientName);
+        req->set(http::field::host, address.host);
+        req->set(http::field::accept, Packet::toString(Packet::BodyType::Bytes));
+        if (first > 0 || last) {
+            req->set(http::field::range, "bytes=" + std::to_string(first) + "-" + (last ? std::to_string(*last) : std::string()));
+        }
+        req->prepare_payload();
+
+        auto res = std::make_shared<http::response_parser<DownloadBody> >();
+        res->body_limit(maxFileSize);
+        auto& body = res->get().body();
+        body.file = file;
+        body.offset = first;
+        body.isFullResponseAccepted = isFullResponseAccepted;
+
+        performRequest(address, req, res, [res, cbk = std::move(cbk)](beast::error_code ec) {
+            cbk(ec, res->get());
+        });
+    }
+
+    // Размер файла, если сервер отдаёт его диапазонами
+    std::optional<std::uint64_t> rangedContentLength(const HostAddress& address, const std::string& target) {
+        auto req = std::make_shared<http::request<http::empty_body> >(http::verb::head, target, 11);
+        req->set(http::field::user_agent, clientName);
+        req->set(http::field::host, address.host);
+        req->prepare_payload();
+
+        // Некоторые серверы отвечают на HEAD с телом (например, ошибкой): такое соединение не переиспользуем
+        req->keep_alive(false);
+
+        auto res = std::make_shared<http::response_parser<http::empty_body> >();
+        res->skip(true);
+        auto ec = performRequestSync(address, req, res);
+        if (ec || res->get().result() != http::status::ok ||
+            res->get()[http::field::accept_ranges] != "bytes" || !res->get().count(http::field::content_length)) {
+            return std::nullopt;
+        }
+
+        auto contentLength = res->get()[http::field::content_length];
+        std::uint64_t size {0};
+        if (std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), size).ec != std::errc()) {
+            return std::nullopt;
+        }
+        return size;
+    }
+
+    bool downloadWhole(const HostAddress& address, const std::string& target, const std::string& saveFilePath, bool isResume) {
+        beast::error_code ec;
+        auto file = std::make_shared<DownloadBody::File>();
+        file->open(saveFilePath, !isResume, ec);
+        auto first = (ec ? 0 : file->size(ec));
+        if (ec) {
+            logError("Error opening savefile by path: [", saveFilePath, "] reason:", ec.message());
+            return false;
+        }
+        if (first > 0) {
+            logInfo("Resuming download from byte", first);
+        }
+
+        std::promise<bool> result;
+        auto resultFuture = result.get_future();
+        downloadRange(address, target, file, first, std::nullopt, true,
+            [this, &result, first](beast::error_code ec, const http::response<DownloadBody>& res) {
+            if (ec) {
+                logError("Failed to download file:", ec.message());
+                result.set_value(false);
+                return;
+            }
+
+            // Файл уже загружен целиком: Content-Range: bytes */size
+            if (res.result() == http::status::range_not_satisfiable && first > 0 &&
+                    std::string(res[http::field::content_range]) == "bytes */" + std::to_string(first)) {
+                result.set_value(true);
+                return;
+            }
+            if (res.result() != http::status::ok && res.result() != http::status::partial_content) {
+                logError("Response status:", http::obsolete_reason(res.result()));
+                result.set_value(false);
+                return;
+            }
+            result.set_value(true);
+        });
+        return waitResult(resultFuture);
+    }
+
+    bool downloadSegments(const HostAddress& address,
+                          const std::string& target,
+                          const std::string& saveFilePath,
+                          std::uint64_t fileSize,
+                          const DownloadOptions& options) {
+        beast::error_code ec;
+        auto file = std::make_shared<DownloadBody::File>();
+        file->open(saveFilePath, true, ec);
+        if (!ec) {
+            file->preallocate(fileSize, ec);
+        }
+        if (ec) {
+            logError("Error preparing savefile by path: [", saveFilePath, "] reason:", ec.message());
+            return false;
+        }
+
+        auto minSegmentSize = std::max<std::uint64_t>(options.minSegmentSize, 1);
+        auto segmentCount = std::clamp<std::uint64_t>(fileSize / minSegmentSize, 1, std::max<std::size_t>(options.segmentCount, 1));
+        auto segmentSize = (fileSize + segmentCount - 1) / segmentCount;
+
+        // После округления размера диапазонов может выйти меньше: 10 байт на 6 частей -- 5 диапазонов по 2 байта
+        segmentCount = (fileSize + segmentSize - 1) / segmentSize;
+        logInfo("Downloading", fileSize, "bytes in", segmentCount, "segments");
+
+        struct SegmentsState
+        {
+            std::mutex mutex;
+            std::size_t segmentsLeft {0};
+            bool isSucceed {true};
+            std::promise<bool> result;
+        };
+        auto state = std::make_shared<SegmentsState>();
+        state->segmentsLeft = segmentCount;
+        auto resultFuture = state->result.get_future();
+
+        for (std::uint64_t first = 0; first < fileSize; first += segmentSize) {
+            auto last = std::min(first + segmentSize, fileSize) - 1;
+            downloadRange(address, target, file, first, last, false,
+                [this, pSelf = shared_from_this(), state, first, last](beast::error_code ec, const http::response<DownloadBody>& res) {
+                auto isSucceed = (!ec && res.result() == http::status::partial_content &&
+                                  res.body().writtenSize == last - first + 1);
+                if (!isSucceed) {
+                    logError("Failed to download bytes", first, "-", last, ":", ec ? ec.message() : std::string(http::obsolete_reason(res.result())));
+                }
+
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->isSucceed = state->isSucceed && isSucceed;
+                if (--state->segmentsLeft == 0) {
+                    state->result.set_value(state->isSucceed);
+                }
+            });
+        }
+        return waitResult(resultFuture);
+    }
+
+    void upload(const std::string& target,
+                const std::shared_ptr<UploadBody::Source>& source,
+                std::function<void(std::optional<Packet>&&)>&& cbk) {
+        auto requestTarget = target;
+        auto address = targetAddress(requestTarget);
+
+        auto req = std::make_shared<http::request<UploadBody> >(http::verb::post, requestTarget, 11);
+        req->set(http::field::user_agent, clientName);
+        req->set(http::field::host, address.host);
+        req->set(http::field::content_type, Packet::toString(Packet::BodyType::Bytes));
+        req->body() = source;
+
+        // Длина источника неизвестна (канал, генератор данных): тело уходит частями
+        auto contentLength = source->size();
+        if (contentLength) {
+            req->content_length(*contentLength);
+        } else {
+            req->chunked(true);
+        }
+
+        auto res = std::make_shared<http::response_parser<http::dynamic_body> >();
+        performRequest(address, req, res, [this, pSelf = shared_from_this(), target, source, res, cbk = std::move(cbk)](beast::error_code ec) {
+            if (ec) {
+                logError("Failed to upload file:", ec.message());
+                cbk(std::nullopt);
+                return;
+            }
+            logOk("Uploaded", source->sentSize(), "bytes");
+
+            Packet resp;
+            resp.target = target;
+            if (!fillResponse(res->get(), resp)) {
+                cbk(std::nullopt);
+                return;
+            }
+            cbk(resp);
+        });
+    }
+
+    // Синхронный вызов из потока клиента или на остановленном io_context не дождался бы завершения
+    bool canWaitSync() {
+        if (ioc.get_executor().running_in_this_thread()) {
+            logError("Synchronous request from the client I/O thread is not supported");
+            return false;
+        }
+        if (canDriveContext && ioc.stopped()) {
+            logError("Synchronous request on a stopped io_context is not supported");
+            return false;
+        }
+        return true;
+    }
+
+    // Ожидание синхронного вызова. Переданный пользователем io_context ожидающий поток обслуживает сам, по одному
+    // потоку за раз. Пока имя разрешается в потоке DNS, работы в контексте нет и он останавливается: перезапускается
+    template <typename T>
+    T waitResult(std::future<T>& future) {
+        static constexpr std::chrono::milliseconds pollInterval {10};
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            std::unique_lock<std::mutex> lock(driveMutex, std::try_to_lock);
+            if (!canDriveContext || !lock.owns_lock()) {
+                future.wait_for(pollInterval);
+                continue;
+            }
+            if (ioc.run_one_for(pollInterval) == 0 && ioc.stopped()) {
+                ioc.restart();
+                future.wait_for(pollInterval);
+            }
+        }
+        return future.get();
+    }
+
+    template <typename RequestBody, typename ResponseBody>
+    beast::error_code performRequestSync(const HostAddress& address,
+                                         const std::shared_ptr<http::request<RequestBody> >& req,
+                                         const std::shared_ptr<http::response_parser<ResponseBody> >& res) {
+        if (!canWaitSync()) {
+            return net::error::operation_not_supported;
+        }
+
+        std::promise<beast::error_code> result;
+        auto resultFuture = result.get_future();
+        performRequest(address, req, res, [&result](beast::error_code ec){
+            result.set_value(ec);
+        });
+        return waitResult(resultFuture);
+    }
+
+    using PacketResponse = std::shared_ptr<http::response_parser<http::dynamic_body> >;
+    using PolicyCallback = std::function<void(beast::error_code, const PacketResponse&, const RequestTiming&)>;
+
+    /**
+     * Запрос с политикой: общий срок, повторы и дубли. Каждая попытка читает ответ в свой парсер,
+     * колбек получает ответ первой успешной попытки. Состояние меняется только в strand запроса
+     */
+    template <typename RequestBody>
+    struct PolicyRequest
+    {
+        explicit PolicyRequest(net::io_context& ioc) :
+            strand {net::make_strand(ioc)},
+            deadlineTimer {strand},
+            hedgeTimer {strand},
+            retryTimer {strand} {
+
+        }
+
+        HostAddress address;
+        std::shared_ptr<http::request<RequestBody> > req;
+        RequestPolicy policy;
+        PolicyCallback callback;
+
+        net::strand<net::io_context::executor_type> strand;
+        net::steady_timer deadlineTimer;
+        net::steady_timer hedgeTimer;
+        net::steady_timer retryTimer;
+
+        std::vector<std::shared_ptr<RequestAttempt> > attempts; // Незавершённые попытки
+        unsigned retryCount {0};
+        bool isHedged {false};
+        bool isFinished {false};
+
+        beast::error_code lastError;
+        PacketResponse lastResponse;
+        RequestTiming lastTiming;
+    };
+
+    template <typename RequestBody>
+    void performPolicyRequest(const HostAddress& address,
+                              const std::shared_ptr<http::request<RequestBody> >& req,
+                              const RequestPolicy& policy,
+                              PolicyCallback&& cbk) {
+        auto state = std::make_shared<PolicyRequest<RequestBody> >(ioc);
+        state->address = address;
+        state->req = req;
+        state->policy = policy;
+        state->callback = std::move(cbk);
+
+        net::dispatch(state->strand, [this, pSelf = shared_from_this(), state](){
+            if (state->policy.timeout.count() > 0) {
+                state->deadlineTimer.expires_after(state->policy.timeout);
+                state->deadlineTimer.async_wait([this, pSelf = shared_from_this(), state](beast::error_code ec) {
+                    if (ec || state->isFinished) {
+                        return;
+                    }
+                    logError("Request timed out:", state->req->method_string(), state->req->target());
+                    finishPolicyRequest(state, net::error::timed_out, nullptr, {});
+                });
+            }
+            startAttempt(state);
+        });
+    }
+
+    template <typename RequestBody>
+    void startAttempt(const std::shared_ptr<PolicyRequest<RequestBody> >& state) {
+        auto attempt = std::make_shared<RequestAttempt>();
+        state->attempts.push_back(attempt);
+
+        auto res = std::make_shared<http::response_parser<http::dynamic_body> >();
+        auto startTime = std::chrono::steady_clock::now();
+        performRequest(state->address, state->req, res, [this, pSelf = shared_from_this(), state, attempt, res, startTime](beast::error_code ec) {
+            net::dispatch(state->strand, [this, pSelf = shared_from_this(), state, attempt, res, startTime, ec](){
+                onAttemptFinished(state, attempt, ec, res, std::chrono::steady_clock::now() - startTime);
+            });
+        }, attempt);
+
+        if (!state->policy.isHedgingEnabled || state->isHedged || !isIdempotent(state->req->method())) {
+            return;
+        }
+        auto delay = hedgeDelay(state->address, state->policy);
+        if (!delay) {
+            return;
+        }
+        state->hedgeTimer.expires_after(*delay);
+        state->hedgeTimer.async_wait([this, pSelf = shared_from_this(), state](beast::error_code ec) {
+            if (ec || state->isFinished || state->attempts.empty()) {
+                return;
+            }
+            logInfo("No response after hedge delay, sending duplicate request");
+            state->isHedged = true;
+            startAttempt(state);
+        });
+    }
+
+    template <typename RequestBody>
+    void onAttemptFinished(const std::shared_ptr<PolicyRequest<RequestBody> >& state,
+                           const std::shared_ptr<RequestAttempt>& attempt,
+                           beast::error_code ec,
+                           const PacketResponse& res,
+                           std::chrono::steady_clock::duration latency) {
+        state->attempts.erase(std::remove(state->attempts.begin(), state->attempts.end(), attempt), state->attempts.end());
+        if (state->isFinished) {
+            return;
+        }
+
+        if (!ec) {
+            attempt->timing().total = std::chrono::duration_cast<std::chrono::microseconds>(latency);
+            std::lock_guard<std::mutex> lock(latencyMutex);
+            hostLatencies[state->address.toString()].add(attempt->timing().total);
+            hostTimings[attempt->address().toString()].add(attempt->timing());
+        }
+        if (!ec && !isRetryableStatus(res->get().result())) {
+            finishPolicyRequest(state, ec, res, attempt->timing());
+            return;
+        }
+
+        state->lastError = ec;
+        state->lastResponse = (ec ? nullptr : res);
+        state->lastTiming = attempt->timing();
+
+        // Параллельная попытка ещё может ответить
+        if (!state->attempts.empty()) {
+            return;
+        }
+
+        auto canRetry = (state->retryCount < state->policy.maxRetries &&
+                         isIdempotent(state->req->method()) &&
+                         ec != net::error::operation_aborted);
+        if (!canRetry) {
+            finishPolicyRequest(state, state->lastError, state->lastResponse, state->lastTiming);
+            return;
+        }
+
+        auto delay = retryDelay(state->policy, state->retryCount++);
+        logWarning("Retrying request in", delay.count(), "ms:", ec ? ec.message() : std::string(http::obsolete_reason(res->get().result())));
+        state->retryTimer.expires_after(delay);
+        state->retryTimer.async_wait([this, pSelf = shared_from_this(), state](beast::error_code ec) {
+            if (ec || state->isFinished) {
+                return;
+            }
+            startAttempt(state);
+        });
+    }
+
+    template <typename RequestBody>
+    void finishPolicyRequest(const std::shared_ptr<PolicyRequest<RequestBody> >& state,
+                             beast::error_code ec,
+                             const PacketResponse& res,
+                             const RequestTiming& timing) {
+        state->isFinished = true;
+        state->deadlineTimer.cancel();
+        state->hedgeTimer.cancel();
+        state->retryTimer.cancel();
+
+        auto attempts = std::move(state->attempts);
+        state->attempts.clear();
+        for (auto& attempt : attempts) {
+            attempt->cancel();
+        }
+
+        auto cbk = std::move(state->callback);
+        cbk(ec, res, timing);
+    }
+
+    std::optional<std::chrono::microseconds> hedgeDelay(const HostAddress& address, const RequestPolicy& policy) {
+        if (policy.hedgeDelay.count() > 0) {
+            return policy.hedgeDelay;
+        }
+
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        auto latencies = hostLatencies.find(address.toString());
+        if (latencies == hostLatencies.end()) {
+            return std::nullopt;
+        }
+        return latencies->second.percentile(95);
+    }
+
+    using PacketCallback = std::function<void(std::optional<Packet>&&)>;
+
+    // Запрос Packet с политикой: распаковка тела, кеш ответов на GET и условные запросы.
+    // Колбек получает std::nullopt, если ответа нет
+    void performPacketRequest(http::verb method, const Packet& pkt, const RequestPolicy& policy, PacketCallback&& cbk);
+
+    // Синхронный запрос Packet, ответ пишется в resp. false, если ответа нет
+    bool requestPacket(MethodType method, const Packet& pkt, const RequestPolicy& policy, Packet& resp);
+
+    using BatchCallback = std::function<void(std::vector<std::optional<Packet> >&&)>;
+
+    // Пакет запросов: следующий запрос запускается по завершении одного из выполняющихся
+    struct BatchRequest
+    {
+        std::mutex mutex;
+        std::vector<std::pair<MethodType, Packet> > requests;
+        std::vector<std::optional<Packet> > responses;
+        std::size_t nextIndex {0};
+        std::size_t activeCount {0};
+        std::size_t finishedCount {0};
+
+        std::size_t maxConcurrency {0};
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        BatchCallback callback;
+    };
+
+    void performBatch(std::vector<std::pair<MethodType, Packet> >&& requests, const BatchOptions& options, BatchCallback&& cbk);
+    void startBatchRequests(const std::shared_ptr<BatchRequest>& batch);
+
+    // Прогрев: соединения открываются заранее, чтобы первые запросы не ждали DNS, TCP и TLS.
+    // pendingCount начинается с 1, чтобы колбек не вызвался, пока подключения ещё запускаются
+    struct PrewarmRequest
+    {
+        std::atomic<std::size_t> pendingCount {1};
+        std::atomic<std::size_t> connectedCount {0};
+        std::function<void(std::size_t)> callback;
+    };
+
+    void prewarm(std::size_t count, std::function<void(std::size_t)>&& cbk);
+    void prewarmHost(const HostAddress& address, std::size_t count, const std::shared_ptr<PrewarmRequest>& prewarmRequest);
+    void prewarmConnections(const HostAddress& address, std::size_t count, const std::shared_ptr<PrewarmRequest>& prewarmRequest);
+    void finishPrewarm(const std::shared_ptr<PrewarmRequest>& prewarmRequest, bool isConnected);
+};
+
+namespace
+{
+
+bool toVerb(MethodType method, http::verb& requestMethod)
+{
+    switch (method)
+    {
+    case Get:       requestMethod = http::verb::get; break;
+    case Put:       requestMethod = http::verb::put; break;
+    case Post:      requestMethod = http::verb::post; break;
+    case Delete:    requestMethod = http::verb::delete_; break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+}
+
+bool Client::Impl::requestPacket(MethodType method, const Packet &pkt, const RequestPolicy &policy, Packet &resp)
+{
+    http::verb requestMethod;
+    if (!toVerb(method, requestMethod)) {
+        logError("Unknown method to request:", static_cast<int>(method));
+        return false;
+    }
+    if (!canWaitSync()) {
+        return false;
+    }
+
+    std::promise<std::optional<Packet> > result;
+    auto resultFuture = result.get_future();
+    performPacketRequest(requestMethod, pkt, policy, [&result](std::optional<Packet>&& response) {
+        result.set_value(std::move(response));
+    });
+
+    auto response = waitResult(resultFuture);
+    if (!response) {
+        return false;
+    }
+    resp.statusCode = response->statusCode;
+    resp.bodyType = response->bodyType;
+    resp.body = std::move(response->body);
+    resp.timing = response->timing;
+    return true;
+}
+
+void Client::Impl::performPacketRequest(http::verb method, const Packet &pkt, const RequestPolicy &policy, PacketCallback &&cbk)
+{
+    auto target = pkt.target;
+    auto address = targetAddress(target);
+    auto req = createRequest(method, target, address.host, pkt);
+
+    // Сохраняются ответы на GET, изменяющий запрос к тому же target делает сохранённый ответ устаревшим
+    std::string cacheKey;
+    std::shared_ptr<const ResponseCache::Entry> cachedEntry;
+    if (responseCache.isEnabled()) {
+        cacheKey = address.toString() + target;
+        if (method == http::verb::get) {
+            cachedEntry = responseCache.find(cacheKey, *req);
+        }
+    }
+
+    if (cachedEntry && cachedEntry->isFresh()) {
+        logOk("Using cached response:", pkt.target);
+        auto resp = cachedEntry->response;
+        resp.target = pkt.target;
+        resp.acceptableType = pkt.acceptableType;
+        resp.timing = RequestTiming{};
+        net::post(ioc, [cbk = std::move(cbk), resp = std::move(resp)]() mutable {
+            cbk(std::move(resp));
+        });
+        return;
+    }
+    if (cachedEntry && !cachedEntry->etag.empty()) {
+        req->set(http::field::if_none_match, cachedEntry->etag);
+    }
+    if (cachedEntry && !cachedEntry->lastModified.empty()) {
+        req->set(http::field::if_modified_since, cachedEntry->lastModified);
+    }
+
+    performPolicyRequest(address, req, policy,
+        [this, pSelf = shared_from_this(), method, req, cacheKey, target = pkt.target, acceptableType = pkt.acceptableType, cbk = std::move(cbk)](beast::error_code ec, const PacketResponse& res, const RequestTiming& timing) {
+        if (ec) {
+            logError("Failed to send or receive data:", ec.message());
+            cbk(std::nullopt);
+            return;
+        }
+
+        const auto& response = res->get();
+        if (!cacheKey.empty() && method == http::verb::get && response.result() == http::status::not_modified) {
+            // Если ответ успели вытеснить, 304 возвращается как есть
+            auto cachedEntry = responseCache.refresh(cacheKey, *req, response);
+            if (cachedEntry) {
+                logOk("Not modified, using cached response:", target);
+                auto resp = cachedEntry->response;
+                resp.target = target;
+                resp.acceptableType = acceptableType;
+                resp.timing = timing;
+                cbk(std::move(resp));
+                return;
+            }
+        }
+
+        Packet resp;
+        resp.target = target;
+        resp.acceptableType = acceptableType;
+        resp.timing = timing;
+        if (!fillResponse(response, resp)) {
+            cbk(std::nullopt);
+            return;
+        }
+
+        if (!cacheKey.empty() && method == http::verb::get) {
+            responseCache.store(cacheKey, *req, response, resp);
+        } else if (!cacheKey.empty() && resp.statusCode < 400) {
+            responseCache.remove(cacheKey);
+        }
+        logOk("Received response (", resp.body.size(), "bytes)");
+        cbk(std::move(resp));
+    });
+}
 
-struct Client::Impl
+void Client::Impl::performBatch(std::vector<std::pair<MethodType, Packet> > &&requests, const BatchOptions &options, BatchCallback &&cbk)
 {
-    net::io_context defaultCtx;
-    std::thread defaultCtxThread;
+    auto batch = std::make_shared<BatchRequest>();
+    batch->requests = std::move(requests);
+    batch->responses.resize(batch->requests.size());
+    batch->maxConcurrency = (options.maxConcurrency > 0 ? options.maxConcurrency : batch->requests.size());
+    if (options.timeout.count() > 0) {
+        batch->deadline = std::chrono::steady_clock::now() + options.timeout;
+    }
+    batch->callback = std::move(cbk);
 
-    tcp::resolver resolver;
-    std::variant<beast::tcp_stream, ssl::stream<tcp::socket> > socket;
-    std::shared_ptr<ssl::context> ctx;
+    if (batch->requests.empty()) {
+        batch->callback({});
+        return;
+    }
+    startBatchRequests(batch);
+}
 
-    net::executor_work_guard<net::io_context::executor_type> defaultCtxWork;
+void Client::Impl::startBatchRequests(const std::shared_ptr<BatchRequest> &batch)
+{
+    // Запросы, не начатые к сроку, сразу завершаются без ответа
+    std::vector<std::size_t> startIndexes;
+    bool isFinished {false};
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        std::size_t skippedCount {0};
+        while (batch->nextIndex < batch->requests.size() && batch->activeCount < batch->maxConcurrency) {
+            auto index = batch->nextIndex++;
+            if (batch->deadline && *batch->deadline <= std::chrono::steady_clock::now()) {
+                ++skippedCount;
+                continue;
+            }
+            ++batch->activeCount;
+            startIndexes.push_back(index);
+        }
+        batch->finishedCount += skippedCount;
+        isFinished = (skippedCount > 0 && batch->finishedCount == batch->requests.size());
+    }
+    if (isFinished) {
+        auto cbk = std::move(batch->callback);
+        cbk(std::move(batch->responses));
+        return;
+    }
 
-    std::string host;
-    std::string port;
-    bool isLoggingEnabled {false};
+    for (auto index : startIndexes) {
+        const auto& [method, pkt] = batch->requests[index];
 
-    std::string clientName {"TestApp"};
-    uint32_t maxFileSize {1024 * 1024 * 1024};
+        auto onFinished = [this, pSelf = shared_from_this(), batch, index](std::optional<Packet>&& resp) {
+            bool isFinished {false};
+            {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->responses[index] = std::move(resp);
+                --batch->activeCount;
+                isFinished = (++batch->finishedCount == batch->requests.size());
+            }
+            if (isFinished) {
+                auto cbk = std::move(batch->callback);
+                cbk(std::move(batch->responses));
+                return;
+            }
+            startBatchRequests(batch);
+        };
+
+        http::verb requestMethod;
+        if (!toVerb(method, requestMethod)) {
+            logError("Unknown method to request:", static_cast<int>(method));
+            onFinished(std::nullopt);
+            continue;
+        }
 
-    Impl(net::io_context& ioc) :
-        resolver{ioc},
-        socket{beast::tcp_stream(ioc)},
-        defaultCtxWork { net::make_work_guard(defaultCtx) } {
+        auto policy = requestPolicy;
+        if (batch->deadline) {
+            auto timeLeft = std::chrono::duration_cast<std::chrono::milliseconds>(*batch->deadline - std::chrono::steady_clock::now());
+            timeLeft = std::max(timeLeft, std::chrono::milliseconds(1));
+            policy.timeout = (policy.timeout.count() > 0 ? std::min(policy.timeout, timeLeft) : timeLeft);
+        }
 
+        performPacketRequest(requestMethod, pkt, policy, std::move(onFinished));
     }
+}
 
-    Impl() :
-        defaultCtx {1},
-        resolver{defaultCtx},
-        socket{beast::tcp_stream(defaultCtx)},
-        defaultCtxWork { net::make_work_guard(defaultCtx) } {
-        defaultCtxThread = std::thread([this](){
-            defaultCtx.run();
-        });
+void Client::Impl::prewarm(std::size_t count, std::function<void (std::size_t)> &&cbk)
+{
+    auto prewarmRequest = std::make_shared<PrewarmRequest>();
+    prewarmRequest->callback = std::move(cbk);
+
+    auto addresses = balancer->upstreams();
+    if (addresses.empty() && !host.empty()) {
+        addresses.push_back(HostAddress{isSecure, host, port});
     }
-    ~Impl() {
-        if (defaultCtxThread.joinable()) {
-            defaultCtxWork.reset();
-            defaultCtx.stop();
-            defaultCtxThread.join();
-        }
+    for (const auto& address : addresses) {
+        prewarmHost(address, count, prewarmRequest);
     }
+    finishPrewarm(prewarmRequest, false);
+}
 
-    template <typename...Args>
-    void logInfo(Args&&...args) {
-        if (!isLoggingEnabled) {
+void Client::Impl::prewarmHost(const HostAddress &address, std::size_t count, const std::shared_ptr<PrewarmRequest> &prewarmRequest)
+{
+#ifdef COMPONENTS_NETWORK_HTTP2
+    if (isHttp2Enabled) {
+        // Запросы к хосту идут потоками одного соединения HTTP/2
+        ++prewarmRequest->pendingCount;
+        auto session = http2Session(address, [this, pSelf = shared_from_this(), address, count, prewarmRequest](beast::error_code ec) {
+            if (ec == net::error::try_again) {
+                prewarmConnections(address, count, prewarmRequest);
+            }
+            finishPrewarm(prewarmRequest, !ec);
+        });
+        if (session) {
             return;
         }
-        COMPLOG_INFO("[HTTP CLIENT", this, "]", args...);
+        --prewarmRequest->pendingCount;
     }
+#endif
+    prewarmConnections(address, count, prewarmRequest);
+}
 
-    template <typename...Args>
-    void logWarning(Args&&...args) {
-        if (!isLoggingEnabled) {
-            return;
+void Client::Impl::prewarmConnections(const HostAddress &address, std::size_t count, const std::shared_ptr<PrewarmRequest> &prewarmRequest)
+{
+    for (auto i = pool->connectionCount(address); i < count; ++i) {
+        auto conn = pool->reserve(address);
+        if (!conn) {
+            break;
         }
-        COMPLOG_WARNING("[HTTP CLIENT", this, "]", args...);
+
+        ++prewarmRequest->pendingCount;
+        connect(conn, [this, pSelf = shared_from_this(), conn, prewarmRequest](beast::error_code ec) {
+            // Подключенное соединение достаётся ожидающему запросу или становится свободным
+            pool->release(conn, !ec);
+            finishPrewarm(prewarmRequest, !ec);
+        });
     }
+}
 
-    template <typename...Args>
-    void logError(Args&&...args) {
-        if (!isLoggingEnabled) {
-            return;
-        }
-        COMPLOG_ERROR("[HTTP CLIENT", this, "]", args...);
+void Client::Impl::finishPrewarm(const std::shared_ptr<PrewarmRequest> &prewarmRequest, bool isConnected)
+{
+    if (isConnected) {
+        ++prewarmRequest->connectedCount;
+    }
+    if (--prewarmRequest->pendingCount > 0) {
+        return;
     }
 
-    template <typename...Args>
-    void logOk(Args&&...args) {
-        if (!isLoggingEnabled) {
-            return;
-        }
-        COMPLOG_OK("[HTTP CLIENT", this, "]", args...);
+    logInfo("Prewarmed connections:", prewarmRequest->connectedCount.load());
+    if (prewarmRequest->callback) {
+        prewarmRequest->callback(prewarmRequest->connectedCount);
     }
-};
+}
 
 Client::Client(boost::asio::io_context &ioc, bool isSecure, bool verifyCertificate) :
-    d {new Impl(ioc)}
+    d {new Impl(ioc, isSecure, verifyCertificate)}
+{
+    d->canDriveContext = true;
+}
+
+Client::Client(ClientRuntime &runtime, bool isSecure, bool verifyCertificate) :
+    d {new Impl(runtime.context(), isSecure, verifyCertificate)}
 {
-    if (isSecure) {
-        d->ctx = std::make_shared<ssl::context>(ssl::context::tls_client);
-        d->ctx->set_verify_mode(verifyCertificate ? ssl::verify_peer : ssl::verify_none);
 
-        d->socket.emplace<net::ssl::stream<tcp::socket> >(std::move(std::get<beast::tcp_stream>(d->socket).socket()), *d->ctx);
-    }
 }
 
 Client::Client(bool isSecure, bool verifyCertificate) :
-    d {new Impl()}
+    Client(ClientRuntime::instance(), isSecure, verifyCertificate)
 {
-    if (isSecure) {
-        d->ctx = std::make_shared<ssl::context>(ssl::context::tls_client);
-        d->ctx->set_verify_mode(verifyCertificate ? ssl::verify_peer : ssl::verify_none);
 
-        d->socket.emplace<net::ssl::stream<tcp::socket> >(std::move(std::get<beast::tcp_stream>(d->socket).socket()), *d->ctx);
-    }
 }
 
 Client::~Client()
 {
-    disconnectFromHost();
+    d->logInfo("Disconnecting from host");
+    d->pool->clear();
+
+    // io_context общий: незавершённые запросы прерываются, а не остаются висеть после клиента
+    d->pool->cancelActive();
+
+#ifdef COMPONENTS_NETWORK_HTTP2
+    std::lock_guard<std::mutex> lock(d->http2Mutex);
+    for (auto& [hostKey, session] : d->http2Sessions) {
+        session->fail(net::error::operation_aborted);
+    }
+#endif
 }
 
 void Client::setLoggingEnabled(bool isEn)
@@ -137,401 +1705,335 @@ void Client::setMaxFileSize(uint32_t fileSizeByte)
     d->maxFileSize = fileSizeByte;
 }
 
-void Client::setHost(const std::string &host, const uint16_t port)
+void Client::setMaxConnectionsPerHost(std::size_t count)
 {
-    d->host = host;
-    d->port = std::to_string(port);
+    d->pool->setMaxConnectionsPerHost(count);
 }
 
-Packet Client::request(MethodType method, Packet &&pkt)
+void Client::setIdleConnectionTimeout(uint32_t timeoutMs)
 {
-    http::verb requestMethod;
-    switch (method)
-    {
-    case Get:       requestMethod = http::verb::get; break;
-    case Put:       requestMethod = http::verb::put; break;
-    case Post:      requestMethod = http::verb::post; break;
-    case Delete:    requestMethod = http::verb::delete_; break;
-    default:
-        d->logError("Unknown method to request:", static_cast<int>(method));
-        return {};
-    }
-
-    http::request<http::dynamic_body> req{requestMethod, pkt.target, 11};
-    req.set(http::field::user_agent, d->clientName);
-    req.set(http::field::host, d->host);
-    req.set(http::field::content_type, pkt.toString(pkt.bodyType));
-    beast::ostream(req.body()) << std::move(pkt.body);
-    req.set(http::field::accept, pkt.toString(pkt.acceptableType));
-    req.prepare_payload();
+    d->pool->setIdleTimeout(std::chrono::milliseconds(timeoutMs));
+}
 
-    if (!connectToHost()) {
-        return {};
+void Client::setHttp2Enabled(bool isEnabled)
+{
+#ifdef COMPONENTS_NETWORK_HTTP2
+    d->isHttp2Enabled = isEnabled;
+#else
+    if (isEnabled) {
+        d->logWarning("HTTP/2 is not supported: library built without nghttp2");
     }
+#endif
+}
 
-    http::response<http::dynamic_body> res;
-    boost::system::error_code ec;
+void Client::setPipelineDepth(std::size_t depth)
+{
+    d->pool->setPipelineDepth(depth);
+}
+
+void Client::setConnectionAttemptDelay(uint32_t delayMs)
+{
+    d->connectionAttemptDelay = std::chrono::milliseconds(delayMs);
+}
 
-    d->logInfo("Request:", req.method_string(), req.target());
-    std::visit([&](auto& sock){
-        http::write(sock, req, ec);
-        if (ec) { return; }
+void Client::setHost(const std::string &host, const uint16_t port)
+{
+    d->host = host;
+    d->port = std::to_string(port);
+}
 
-        beast::flat_buffer buffer;
-        http::read(sock, buffer, res, ec);
-    }, d->socket);
-    if (ec) {
-        d->logError("Failed to send or receive data:", ec.message());
-        return {};
+void Client::setUpstreams(const std::vector<UpstreamHost> &upstreams)
+{
+    std::vector<HostAddress> addresses;
+    for (const auto& upstream : upstreams) {
+        addresses.push_back(HostAddress{d->isSecure, upstream.host, std::to_string(upstream.port)});
     }
-
-    pkt.statusCode = res.result_int();
-    if (pkt.statusCode != 200) {
-        d->logError("Response status:", http::obsolete_reason(res.result()));
+    if (d->host.empty() && !addresses.empty()) {
+        d->host = addresses.front().host;
+        d->port = addresses.front().port;
     }
+    d->balancer->setUpstreams(addresses);
+}
 
-    if (res.count(http::field::content_type)) {
-        pkt.bodyType = pkt.fromString(to_string(res.at(http::field::content_type)));
-        if (pkt.bodyType != pkt.acceptableType) {
-            d->logWarning("Got packet of inacceptable type (", pkt.toString(pkt.bodyType), "!=", pkt.toString(pkt.acceptableType), ")");
-        }
-    }
-    pkt.body = beast::buffers_to_string(res.body().data());
+void Client::setOutlierDetection(std::size_t consecutiveFailures, uint32_t ejectionTimeMs)
+{
+    d->balancer->setOutlierDetection(consecutiveFailures, std::chrono::milliseconds(ejectionTimeMs));
+}
 
-    d->logOk("Received response (", pkt.body.size(), "bytes)");
-    return pkt;
+void Client::setCompressionEnabled(bool isEnabled)
+{
+    d->isCompressionEnabled = isEnabled;
 }
 
-Packet Client::request(MethodType method, const Packet &pkt)
+void Client::setResponseCacheSize(std::size_t maxSizeBytes)
 {
-    http::verb requestMethod;
-    switch (method)
-    {
-    case Get:       requestMethod = http::verb::get; break;
-    case Put:       requestMethod = http::verb::put; break;
-    case Post:      requestMethod = http::verb::post; break;
-    case Delete:    requestMethod = http::verb::delete_; break;
-    default:
-        d->logError("Unknown method to request:", static_cast<int>(method));
-        return {};
-    }
+    d->responseCache.setMaxSize(maxSizeBytes);
+}
 
-    http::request<http::dynamic_body> req{requestMethod, pkt.target, 11};
-    req.set(http::field::user_agent, d->clientName);
-    req.set(http::field::host, d->host);
-    req.set(http::field::content_type, pkt.toString(pkt.bodyType));
-    beast::ostream(req.body()) << pkt.body;
-    req.set(http::field::accept, pkt.toString(pkt.acceptableType));
-    req.prepare_payload();
+void Client::setRequestPolicy(const RequestPolicy &policy)
+{
+    d->requestPolicy = policy;
+}
 
-    if (!connectToHost()) {
+Packet Client::request(MethodType method, Packet &&pkt)
+{
+    if (!d->requestPacket(method, pkt, d->requestPolicy, pkt)) {
         return {};
     }
+    return pkt;
+}
 
-    http::response<http::dynamic_body> res;
-
-    d->logInfo("Request:", req.method_string(), req.target());
-    std::visit([&](auto& sock){
-        http::write(sock, req);
-
-        beast::flat_buffer buffer;
-        http::read(sock, buffer, res);
-    }, d->socket);
+Packet Client::request(MethodType method, const Packet &pkt)
+{
+    return request(method, pkt, d->requestPolicy);
+}
 
+Packet Client::request(MethodType method, const Packet &pkt, const RequestPolicy &policy)
+{
     Packet resp;
     resp.target = pkt.target;
     resp.acceptableType = pkt.acceptableType;
-
-    resp.statusCode = res.result_int();
-    if (resp.statusCode != 200) {
-        d->logWarning("Response status:", http::obsolete_reason(res.result()));
-    }
-
-    if (res.count(http::field::content_type)) {
-        resp.bodyType = resp.fromString(to_string(res.at(http::field::content_type)));
-        if (resp.bodyType != resp.acceptableType) {
-            d->logWarning("Got packet of inacceptable type (", resp.toString(resp.bodyType), "!=", resp.toString(resp.acceptableType), ")");
-        }
+    if (!d->requestPacket(method, pkt, policy, resp)) {
+        return {};
     }
-    resp.body = beast::buffers_to_string(res.body().data());
-
-    d->logOk("Received response (", resp.body.size(), "bytes)");
     return resp;
 }
 
 void Client::requestAsync(MethodType method, Packet &&pkt, std::function<void (std::optional<Packet> &&)> &&cbk)
+{
+    requestAsync(method, std::move(pkt), std::move(cbk), d->requestPolicy);
+}
+
+void Client::requestAsync(MethodType method,
+                          Packet &&pkt,
+                          std::function<void (std::optional<Packet> &&)> &&cbk,
+                          const RequestPolicy &policy)
 {
     http::verb requestMethod;
-    switch (method)
-    {
-    case Get:       requestMethod = http::verb::get; break;
-    case Put:       requestMethod = http::verb::put; break;
-    case Post:      requestMethod = http::verb::post; break;
-    case Delete:    requestMethod = http::verb::delete_; break;
-    default:
+    if (!toVerb(method, requestMethod)) {
         d->logError("Unknown method to request:", static_cast<int>(method));
         return;
     }
 
-    std::shared_ptr<http::request<http::dynamic_body> > req = std::make_shared< http::request<http::dynamic_body> >(requestMethod, pkt.target, 11);
-    req->set(http::field::user_agent, d->clientName);
-    req->set(http::field::host, d->host);
-    req->set(http::field::content_type, pkt.toString(pkt.bodyType));
-    beast::ostream(req->body()) << pkt.body;
-    req->set(http::field::accept, pkt.toString(pkt.acceptableType));
-    req->prepare_payload();
-
-    if (!connectToHost()) {
-        d->logError("Not connected for requesting");
-        return;
-    }
-
-    std::visit([this, cbk = std::move(cbk), req, pkt = std::move(pkt)](auto& sock){
-        d->logInfo("Request:", req->method_string(), req->target());
-        http::async_write(sock, *req, [this, &sock, req, cbk = std::move(cbk), pkt = std::move(pkt)](beast::error_code ec, std::size_t) {
-            if (ec) {
-                d->logError("Send failed:", ec.message());
-                if (cbk) {
-                    cbk(std::nullopt);
-                }
-                return;
-            }
-
-            d->logOk("Async request sent");
-            auto buffer = std::make_shared<beast::flat_buffer>();
-            auto res = std::make_shared<http::response<http::dynamic_body> >();
-            http::async_read(
-                sock, *buffer, *res,
-                [this, res, buffer, cbk = std::move(cbk), pkt = std::move(pkt)](beast::error_code ec, std::size_t respSize) {
-                    if (ec) {
-                        d->logError("Receive failed:", ec.message());
-                        if (cbk) {
-                            cbk(std::nullopt);
-                        }
-                    }
-                    if (cbk) {
-                        Packet resp;
-                        resp.target = pkt.target;
-                        resp.acceptableType = pkt.acceptableType;
-
-                        resp.statusCode = res->result_int();
-                        if (resp.statusCode != 200) {
-                            d->logError(this, http::obsolete_reason(res->result()));
-                        }
-
-                        if (res->count(http::field::content_type)) {
-                            resp.bodyType = resp.fromString(to_string(res->at(http::field::content_type)));
-                            if (resp.bodyType != resp.acceptableType) {
-                                d->logWarning("Got packet of inacceptable type (", resp.toString(resp.bodyType), "!=", resp.toString(resp.acceptableType), ")");
-                            }
-                        }
-                        resp.body = beast::buffers_to_string(res->body().data());
-
-                        d->logOk("Received response (", respSize, "bytes)");
-                        cbk(resp);
-                    }
-                });
-        });
-    }, d->socket);
+    d->performPacketRequest(requestMethod, pkt, policy, [cbk = std::move(cbk)](std::optional<Packet>&& resp) {
+        if (cbk) {
+            cbk(std::move(resp));
+        }
+    });
 }
 
-void Client::interruptRequestProcessing()
+bool RequestTemplate::isValid() const
 {
-    if (std::holds_alternative<beast::tcp_stream>(d->socket)) {
-        std::get<beast::tcp_stream>(d->socket).cancel();
-    } else if (std::holds_alternative<ssl::stream<tcp::socket>>(d->socket)) {
-        std::get<ssl::stream<tcp::socket> >(d->socket).lowest_layer().cancel();
-    }
+    return static_cast<bool>(d);
 }
 
-bool Client::downloadFile(const std::string &target, const std::string &saveFilePath)
+RequestTemplate Client::createRequestTemplate(MethodType method,
+                                              const std::string &target,
+                                              Packet::BodyType bodyType,
+                                              Packet::BodyType acceptableType)
 {
-    d->logInfo("Downloading file: URL", target, "--->", saveFilePath);
+    RequestTemplate requestTemplate;
+    http::verb requestMethod;
+    if (!toVerb(method, requestMethod)) {
+        d->logError("Unknown method to request:", static_cast<int>(method));
+        return requestTemplate;
+    }
 
-    http::request<http::dynamic_body> req{http::verb::get, target, 11};
-    req.set(http::field::user_agent, d->clientName);
-    req.set(http::field::host, d->host);
-    req.set(http::field::accept, Packet::toString(Packet::BodyType::Bytes));
+    auto data = std::make_shared<RequestTemplate::Data>();
+    data->target = target;
+    data->address = d->targetAddress(data->target);
+    data->method = requestMethod;
+    data->acceptableType = acceptableType;
+    data->fields.set(http::field::user_agent, d->clientName);
+    data->fields.set(http::field::host, data->address.host);
+    data->fields.set(http::field::content_type, Packet::toString(bodyType));
+    data->fields.set(http::field::accept, Packet::toString(acceptableType));
+    if (d->isCompressionEnabled && !ContentDecoder::acceptEncoding().empty()) {
+        data->fields.set(http::field::accept_encoding, ContentDecoder::acceptEncoding());
+    }
+    data->serialize();
 
-    req.prepare_payload();
+    requestTemplate.d = std::move(data);
+    return requestTemplate;
+}
 
-    if (!connectToHost()) {
-        return false;
+Packet Client::request(const RequestTemplate &requestTemplate, const std::shared_ptr<const std::string> &body)
+{
+    if (!requestTemplate.isValid()) {
+        d->logError("Invalid request template");
+        return {};
+    }
+    if (!d->canWaitSync()) {
+        return {};
     }
 
-    http::response<http::dynamic_body> res;
+    std::promise<std::optional<Packet> > result;
+    auto resultFuture = result.get_future();
+    requestAsync(requestTemplate, body, [&result](std::optional<Packet>&& resp) {
+        result.set_value(std::move(resp));
+    });
+    return d->waitResult(resultFuture).value_or(Packet{});
+}
 
-    std::visit([&](auto& sock){
-        http::write(sock, req);
+void Client::requestAsync(const RequestTemplate &requestTemplate,
+                          const std::shared_ptr<const std::string> &body,
+                          std::function<void (std::optional<Packet> &&)> &&cbk)
+{
+    if (!requestTemplate.isValid()) {
+        d->logError("Invalid request template");
+        return;
+    }
 
-        beast::flat_buffer buffer;
-        http::read(sock, buffer, res);
-    }, d->socket);
+    const auto& data = requestTemplate.d;
+    auto req = d->createRequest(data, body);
+    d->performPolicyRequest(data->address, req, d->requestPolicy,
+        [d = d, cbk = std::move(cbk), data](beast::error_code ec, const Impl::PacketResponse& res, const RequestTiming& timing) {
+        if (!cbk) {
+            return;
+        }
+        if (ec) {
+            d->logError("Failed to send or receive data:", ec.message());
+            cbk(std::nullopt);
+            return;
+        }
 
-    Packet resp;
-    resp.target = target;
-    resp.acceptableType = Packet::BodyType::Bytes;
+        Packet resp;
+        resp.target = data->target;
+        resp.acceptableType = data->acceptableType;
+        resp.timing = timing;
+        if (!d->fillResponse(res->get(), resp)) {
+            cbk(std::nullopt);
+            return;
+        }
 
-    resp.statusCode = res.result_int();
-    if (resp.statusCode != 200) {
-        d->logError(this, http::obsolete_reason(res.result()));
-    }
+        d->logOk("Received response (", resp.body.size(), "bytes)");
+        cbk(resp);
+    });
+}
 
-    if (res.count(http::field::content_type)) {
-        resp.bodyType = resp.fromString(to_string(res.at(http::field::content_type)));
-        if (resp.bodyType != resp.acceptableType) {
-            d->logWarning("Got packet of inacceptable type (", resp.toString(resp.bodyType), "!=", resp.toString(resp.acceptableType), ")");
-        }
+std::vector<std::optional<Packet> > Client::requestMany(std::vector<std::pair<MethodType, Packet> > &&requests,
+                                                         const BatchOptions &options)
+{
+    if (!d->canWaitSync()) {
+        return std::vector<std::optional<Packet> >(requests.size());
     }
 
-    std::ofstream saveFile(saveFilePath, std::ios::binary | std::ios::trunc);
-    if (!saveFile.is_open()) {
-        d->logError("Error opening savefile by path: [", saveFilePath, "] reason:", std::strerror(errno));
-        return false;
-    }
-    for (auto const& chunk : res.body().data()) {
-        saveFile.write(static_cast<const char*>(chunk.data()), chunk.size());
-    }
-    return resp.statusCode == 200;
+    std::promise<std::vector<std::optional<Packet> > > result;
+    auto resultFuture = result.get_future();
+    d->performBatch(std::move(requests), options, [&result](std::vector<std::optional<Packet> >&& responses){
+        result.set_value(std::move(responses));
+    });
+    return d->waitResult(resultFuture);
 }
 
-bool Client::uploadFile(const std::string &target, const std::string &filePath)
+void Client::requestManyAsync(std::vector<std::pair<MethodType, Packet> > &&requests,
+                              std::function<void (std::vector<std::optional<Packet> > &&)> &&cbk,
+                              const BatchOptions &options)
 {
-    d->logInfo("Uploading file:", filePath, "---> URL", target);
+    d->performBatch(std::move(requests), options, std::move(cbk));
+}
 
-    http::request<http::file_body> req{http::verb::post, target, 11};
-    req.set(http::field::user_agent, d->clientName);
-    req.set(http::field::host, d->host);
-    req.set(http::field::content_type, Packet::toString(Packet::BodyType::Bytes));
+void Client::prewarm(std::size_t count, std::function<void (std::size_t)> &&cbk)
+{
+    d->prewarm(count, std::move(cbk));
+}
 
-    boost::system::error_code ec;
-    http::file_body::value_type targetFile;
-    targetFile.open(filePath.c_str(), beast::file_mode::read, ec);
-    if (ec) {
-        d->logError("Error opening file:", ec.message());
-        return false;
-    }
-    req.body() = std::move(targetFile);
-    req.prepare_payload();
+std::map<std::string, HostTimingStats> Client::timingStats() const
+{
+    std::lock_guard<std::mutex> lock(d->latencyMutex);
+    return d->hostTimings;
+}
 
-    if (!connectToHost()) {
-        return false;
-    }
+void Client::resetTimingStats()
+{
+    std::lock_guard<std::mutex> lock(d->latencyMutex);
+    d->hostTimings.clear();
+}
 
-    http::response<http::dynamic_body> res;
-    std::visit([&](auto& sock){
-        http::write(sock, req);
+void Client::interruptRequestProcessing()
+{
+    d->pool->cancelActive();
 
-        beast::flat_buffer buffer;
-        http::read(sock, buffer, res);
-    }, d->socket);
+#ifdef COMPONENTS_NETWORK_HTTP2
+    std::lock_guard<std::mutex> lock(d->http2Mutex);
+    for (auto& [hostKey, session] : d->http2Sessions) {
+        session->fail(net::error::operation_aborted);
+    }
+    d->http2Sessions.clear();
+#endif
+}
 
-    return (res.result_int() == 200);
+bool Client::downloadFile(const std::string &target, const std::string &saveFilePath)
+{
+    return downloadFile(target, saveFilePath, DownloadOptions{});
 }
 
-bool Client::connectToHost()
+bool Client::downloadFile(const std::string &target, const std::string &saveFilePath, const DownloadOptions &options)
 {
-    if (isConnected()) {
-        return true;
+    d->logInfo("Downloading file: URL", target, "--->", saveFilePath);
+    if (!d->canWaitSync()) {
+        return false;
     }
 
-    d->logInfo("Connecting to host:", d->host, d->port);
-    auto const results = d->resolver.resolve(d->host, d->port);
-
-    boost::system::error_code ec;
+    auto requestTarget = target;
+    auto address = d->targetAddress(requestTarget);
 
-    if (std::holds_alternative<beast::tcp_stream>(d->socket)) {
-        std::get<beast::tcp_stream>(d->socket).connect(results, ec);
-    } else if (std::holds_alternative<net::ssl::stream<tcp::socket> >(d->socket)) {
-        if(SSL_set_tlsext_host_name(std::get<net::ssl::stream<tcp::socket> >(d->socket).native_handle(), d->host.c_str())) {
-            std::get<net::ssl::stream<tcp::socket> >(d->socket).lowest_layer().connect(results->endpoint(), ec);
-            std::get<net::ssl::stream<tcp::socket> >(d->socket).handshake(ssl::stream_base::client, ec);
-        } else {
-            beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
+    if (options.segmentCount > 1) {
+        auto fileSize = d->rangedContentLength(address, requestTarget);
+        if (fileSize && *fileSize > 0 && *fileSize >= 2 * options.minSegmentSize) {
+            return d->downloadSegments(address, requestTarget, saveFilePath, *fileSize, options);
         }
+        d->logInfo("File can not be downloaded by segments, downloading it in one request");
     }
-    if (ec) {
-        d->logError("Error connecting:", ec.message());
-    } else {
-        d->logOk("Connected to", d->host);
-    }
-    return (!ec);
+    return d->downloadWhole(address, requestTarget, saveFilePath, options.isResumeEnabled);
 }
 
-bool Client::isConnected()
+bool Client::uploadFile(const std::string &target, const std::string &filePath)
 {
-    bool isSocketOpened {false};
-    if (std::holds_alternative<beast::tcp_stream>(d->socket)) {
-        isSocketOpened = std::get<beast::tcp_stream>(d->socket).socket().lowest_layer().is_open();
-    } else {
-        isSocketOpened = std::get<ssl::stream<tcp::socket> >(d->socket).lowest_layer().is_open();
-    }
-
-    if (!isSocketOpened) {
+    if (!d->canWaitSync()) {
         return false;
     }
 
-    // Why...
-    auto tryRead = [](auto& sock) -> bool {
-        boost::system::error_code ec;
-        char buffer[1];
-        size_t n = sock.receive(boost::asio::buffer(buffer),
-                                tcp::socket::message_peek, ec);
+    std::promise<std::optional<Packet> > result;
+    auto resultFuture = result.get_future();
+    uploadFileAsync(target, filePath, [&result](std::optional<Packet>&& resp){
+        result.set_value(std::move(resp));
+    });
 
-        // No data, but connected
-        if (ec == boost::asio::error::would_block ||
-            ec == boost::asio::error::try_again)
-            return true;
-
-        // Any other error = disconnected
-        return !ec;
-    };
-
-    if (std::holds_alternative<beast::tcp_stream>(d->socket)) {
-        return tryRead(std::get<beast::tcp_stream>(d->socket).socket());
-    }
-    return tryRead(beast::get_lowest_layer(std::get<ssl::stream<tcp::socket> >(d->socket)));
+    auto resp = d->waitResult(resultFuture);
+    return (resp && resp->statusCode == 200);
 }
 
-bool Client::disconnectFromHost()
+void Client::uploadFileAsync(const std::string &target,
+                             const std::string &filePath,
+                             std::function<void (std::optional<Packet> &&)> &&cbk,
+                             UploadProgressCallback &&progress)
 {
-    d->logInfo("Disconnecting from host");
-    if (!isConnected()) {
-        d->logOk("Not connected");
-        return true;
-    }
+    d->logInfo("Uploading file:", filePath, "---> URL", target);
 
     beast::error_code ec;
-    if (std::holds_alternative<beast::tcp_stream>(d->socket)) {
-        std::get<beast::tcp_stream>(d->socket).socket().shutdown(tcp::socket::shutdown_both, ec);
-        if (ec && ec != boost::asio::error::not_connected) {
-            d->logError("Error disconnecting:", ec.message());
-            return false;
-        }
-        std::get<beast::tcp_stream>(d->socket).close();
-
-    } else if (std::holds_alternative<ssl::stream<tcp::socket> >(d->socket)) {
-        std::get<ssl::stream<tcp::socket> >(d->socket).shutdown(ec);
-        if (ec == net::error::eof ||
-            ec == net::ssl::error::stream_truncated ||
-            ec == boost::asio::error::operation_aborted) {
-            ec = {};
-        }
-        if (ec && ec != boost::asio::error::not_connected) {
-            d->logError("Error in SSL shutdown:", ec.message());
-            return false;
-        }
+    auto source = std::make_shared<UploadBody::Source>();
+    source->open(filePath, ec);
+    if (ec) {
+        d->logError("Error opening file:", ec.message());
+        cbk(std::nullopt);
+        return;
+    }
+    source->setProgressCallback(std::move(progress));
+    d->upload(target, source, std::move(cbk));
+}
 
+void Client::uploadAsync(const std::string &target,
+                         UploadReader &&reader,
+                         std::function<void (std::optional<Packet> &&)> &&cbk,
+                         UploadProgressCallback &&progress)
+{
+    d->logInfo("Uploading data ---> URL", target);
 
-        std::get<ssl::stream<tcp::socket> >(d->socket).lowest_layer().shutdown(tcp::socket::shutdown_both, ec);
-        if (ec && ec != boost::asio::error::not_connected) {
-            d->logError("Error disconnecting:", ec.message());
-            return false;
-        }
-        std::get<ssl::stream<tcp::socket> >(d->socket).lowest_layer().close();
-    }
-    d->logOk("Disconnected");
-    return true;
+    auto source = std::make_shared<UploadBody::Source>();
+    source->setReader(std::move(reader));
+    source->setProgressCallback(std::move(progress));
+    d->upload(target, source, std::move(cbk));
 }
 
 }
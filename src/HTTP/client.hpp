@@ -3,8 +3,10 @@
 #include <memory>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "httptypes.hpp"
+#include "clientruntime.hpp"
 
 namespace boost::asio
 {
@@ -14,10 +16,38 @@ class io_context;
 namespace HTTP
 {
 
+/**
+ * @brief The RequestTemplate class Заготовка однотипных запросов (например, частой телеметрии).
+ *        Строка запроса и постоянные заголовки сериализуются один раз при создании, каждый запрос
+ *        отправляется одной записью: готовый заголовок, Content-Length и тело без копирования.
+ *        Создаётся через Client::createRequestTemplate, копирование дешёвое
+ */
+class RequestTemplate
+{
+public:
+    RequestTemplate() = default;
+
+    bool isValid() const;
+
+private:
+    friend class Client;
+    friend struct PreparedBody;
+    struct Data;
+    std::shared_ptr<const Data> d;
+};
+
+/**
+ * @brief The Client class  HTTP(S) клиент с пулом keep-alive соединений.
+ *        Синхронные запросы выполняются через io_context клиента. Переданный io_context может обслуживаться
+ *        в других потоках, а если его никто не запускает, обработчики выполняет поток синхронного запроса.
+ *        На остановленном (stop) io_context синхронные запросы сразу завершаются ошибкой.
+ *        Клиент без своего io_context работает на общем ClientRuntime процесса и не создаёт потоков
+ */
 class Client
 {
 public:
     Client(boost::asio::io_context& ioc, bool isSecure = false, bool verifyCertificate = true);
+    Client(ClientRuntime& runtime, bool isSecure = false, bool verifyCertificate = true);
     Client(bool isSecure = false, bool verifyCertificate = true);
     ~Client();
 
@@ -26,23 +56,214 @@ public:
     void setClientName(const std::string& clientName);
     void setMaxFileSize(uint32_t fileSizeByte);
 
+    /**
+     * @brief setMaxConnectionsPerHost  Ограничение на число соединений к одному хосту.
+     *                                  Запросы сверх лимита ждут освобождения соединения
+     * @param count
+     */
+    void setMaxConnectionsPerHost(std::size_t count);
+
+    /**
+     * @brief setIdleConnectionTimeout  Время, через которое простаивающее соединение закрывается
+     * @param timeoutMs
+     */
+    void setIdleConnectionTimeout(uint32_t timeoutMs);
+
+    /**
+     * @brief setHttp2Enabled   Отправлять запросы по HTTP/2: все запросы к хосту идут независимыми потоками
+     *                          в одном соединении. Для HTTPS протокол согласуется по ALPN, если сервер не выбрал h2 --
+     *                          используется HTTP/1.1. Без TLS (h2c) сервер обязан поддерживать HTTP/2.
+     *                          Требует сборки с nghttp2
+     * @param isEnabled
+     */
+    void setHttp2Enabled(bool isEnabled);
+
+    /**
+     * @brief setPipelineDepth  Сколько идемпотентных запросов (GET, HEAD, PUT, DELETE) можно отправить в одно соединение,
+     *                          не дожидаясь ответов (HTTP/1.1 pipelining). Ответы сопоставляются с запросами по порядку.
+     *                          Конвейер используется, только когда все соединения к хосту заняты. По умолчанию 1 (выключен)
+     * @param depth
+     */
+    void setPipelineDepth(std::size_t depth);
+
+    /**
+     * @brief setConnectionAttemptDelay Через сколько начинать подключение к следующему адресу хоста,
+     *                                  если предыдущая попытка ещё не завершилась (Happy Eyeballs, RFC 8305)
+     * @param delayMs
+     */
+    void setConnectionAttemptDelay(uint32_t delayMs);
+
+    /**
+     * @brief setHost   Задать хост по умолчанию. Запросы с абсолютным URL в target (http://host:port/path)
+     *                  идут на указанный в нём хост, соединения к каждому хосту берутся из общего пула
+     * @param host
+     * @param port
+     */
     void setHost(const std::string& host, const uint16_t port = 80);
+
+    /**
+     * @brief setUpstreams  Распределять запросы к хосту по умолчанию между несколькими хостами (репликами).
+     *                      Для каждого запроса из двух случайных хостов выбирается менее загруженный
+     *                      с учётом незавершённых запросов и времени ответа. Заголовок Host берётся из setHost,
+     *                      если он не задан -- хостом по умолчанию становится первый upstream
+     * @param upstreams     Пустой список выключает распределение
+     */
+    void setUpstreams(const std::vector<UpstreamHost>& upstreams);
+
+    /**
+     * @brief setOutlierDetection   Исключать upstream после нескольких ошибок (соединения или ответов 5xx) подряд.
+     *                              По истечении времени исключения на хост уходит один пробный запрос,
+     *                              при его неудаче время исключения удваивается. По умолчанию 5 ошибок и 10 секунд
+     * @param consecutiveFailures
+     * @param ejectionTimeMs
+     */
+    void setOutlierDetection(std::size_t consecutiveFailures, uint32_t ejectionTimeMs);
+
+    /**
+     * @brief setCompressionEnabled Запрашивать сжатые ответы (Accept-Encoding) и распаковывать их в Packet::body.
+     *                              gzip и deflate поддерживаются при сборке с zlib, zstd -- с libzstd. По умолчанию включено
+     * @param isEnabled
+     */
+    void setCompressionEnabled(bool isEnabled);
+
+    /**
+     * @brief setResponseCacheSize  Кеш ответов на GET в памяти по Cache-Control, ETag и Last-Modified.
+     *                              Свежий ответ возвращается без запроса, устаревший проверяется условным запросом
+     *                              (If-None-Match, If-Modified-Since): при ответе 304 возвращается сохранённый с кодом 200
+     * @param maxSizeBytes          Наибольший суммарный размер тел. 0 -- кеш выключен (по умолчанию)
+     */
+    void setResponseCacheSize(std::size_t maxSizeBytes);
+
+    /**
+     * @brief setRequestPolicy  Срок, повторы и дублирование для request и requestAsync без явной политики.
+     *                          По умолчанию запрос выполняется один раз без срока
+     * @param policy
+     */
+    void setRequestPolicy(const RequestPolicy& policy);
+
     Packet request(MethodType method, Packet &&pkt);
     Packet request(MethodType method, const Packet &pkt);
 
+    /**
+     * @brief request   Запрос с собственной политикой. По истечении срока возвращается пустой Packet
+     * @param method
+     * @param pkt
+     * @param policy
+     * @return
+     */
+    Packet request(MethodType method, const Packet &pkt, const RequestPolicy& policy);
+
     void requestAsync(MethodType method, Packet&& pkt, std::function<void(std::optional<Packet>&&)>&& cbk);
+    void requestAsync(MethodType method, Packet&& pkt, std::function<void(std::optional<Packet>&&)>&& cbk, const RequestPolicy& policy);
+
+    /**
+     * @brief createRequestTemplate Создать заготовку запросов. Заголовки User-Agent, Host, Content-Type и Accept
+     *                              берутся из текущих настроек клиента и дальше не меняются
+     * @param method
+     * @param target            Путь или абсолютный URL
+     * @param bodyType
+     * @param acceptableType
+     * @return                  Невалидная заготовка, если метод неизвестен
+     */
+    RequestTemplate createRequestTemplate(MethodType method,
+                                          const std::string& target,
+                                          Packet::BodyType bodyType = Packet::BodyType::Undefined,
+                                          Packet::BodyType acceptableType = Packet::BodyType::Undefined);
+
+    /**
+     * @brief request   Запрос по заготовке с политикой по умолчанию. Тело не копируется:
+     *                  буфер держится до завершения запроса и может быть общим для нескольких запросов
+     * @param requestTemplate
+     * @param body
+     * @return          Пустой Packet, если ответа нет
+     */
+    Packet request(const RequestTemplate& requestTemplate, const std::shared_ptr<const std::string>& body = {});
+    void requestAsync(const RequestTemplate& requestTemplate,
+                      const std::shared_ptr<const std::string>& body,
+                      std::function<void(std::optional<Packet>&&)>&& cbk);
+
+    /**
+     * @brief requestMany   Выполнить запросы одновременно на соединениях из пула.
+     *                      Каждый запрос выполняется с политикой клиента (setRequestPolicy), но не дольше общего срока пакета
+     * @param requests
+     * @param options       Ограничение одновременных запросов и общий срок
+     * @return              Ответы в порядке запросов, std::nullopt для неудавшихся и не успевших к сроку
+     */
+    std::vector<std::optional<Packet> > requestMany(std::vector<std::pair<MethodType, Packet> >&& requests,
+                                                    const BatchOptions& options = {});
+
+    /**
+     * @brief requestManyAsync  Асинхронный вариант requestMany, колбек вызывается один раз после завершения всех запросов
+     * @param requests
+     * @param cbk
+     * @param options
+     */
+    void requestManyAsync(std::vector<std::pair<MethodType, Packet> >&& requests,
+                          std::function<void(std::vector<std::optional<Packet> >&&)>&& cbk,
+                          const BatchOptions& options = {});
+
+    /**
+     * @brief prewarm   Открыть соединения заранее: DNS, TCP и TLS выполняются до первого запроса.
+     *                  Соединения открываются до хоста по умолчанию или до каждого upstream, уже открытые учитываются.
+     *                  С HTTP/2 до хоста открывается одна сессия. TLS сессии кешируются по хосту, поэтому
+     *                  последующие подключения возобновляют сессию без полного рукопожатия
+     * @param count     Сколько соединений держать до каждого хоста, не больше setMaxConnectionsPerHost
+     * @param cbk       Вызывается по завершении с числом открытых прогревом соединений
+     */
+    void prewarm(std::size_t count, std::function<void(std::size_t connectedCount)>&& cbk = {});
+
+    /**
+     * @brief timingStats   Время этапов успешных запросов (request, requestAsync, requestMany) по хостам
+     *                      с создания клиента или вызова resetTimingStats. Время отдельного запроса -- в Packet::timing ответа
+     * @return              Ключ -- адрес хоста (http://host:port), при setUpstreams -- каждого upstream
+     */
+    std::map<std::string, HostTimingStats> timingStats() const;
+    void resetTimingStats();
+
     void interruptRequestProcessing();
 
     bool downloadFile(const std::string& target, const std::string& saveFilePath);
+
+    /**
+     * @brief downloadFile  Загрузить файл. Тело ответа пишется в файл по мере приёма, без накопления в памяти
+     * @param target
+     * @param saveFilePath
+     * @param options       Докачка и параллельная загрузка диапазонами. Если сервер не поддерживает
+     *                      диапазоны (Accept-Ranges), файл загружается одним запросом
+     * @return              true, если файл загружен полностью
+     */
+    bool downloadFile(const std::string& target, const std::string& saveFilePath, const DownloadOptions& options);
     bool uploadFile(const std::string& target, const std::string& filePath);
 
+    /**
+     * @brief uploadFileAsync   Отправить файл, не блокируя вызывающего. Обычный файл без TLS отправляется через sendfile,
+     *                          иначе крупными порциями. Канал или устройство отправляются с Transfer-Encoding: chunked
+     * @param target
+     * @param filePath
+     * @param cbk               Ответ сервера или std::nullopt при ошибке и прерывании
+     * @param progress          Ход отправки, может прервать её, вернув false
+     */
+    void uploadFileAsync(const std::string& target,
+                         const std::string& filePath,
+                         std::function<void(std::optional<Packet>&&)>&& cbk,
+                         UploadProgressCallback&& progress = {});
+
+    /**
+     * @brief uploadAsync   Отправить данные неизвестной длины (Transfer-Encoding: chunked).
+     *                      reader вызывается в потоке ввода-вывода клиента
+     * @param target
+     * @param reader
+     * @param cbk
+     * @param progress
+     */
+    void uploadAsync(const std::string& target,
+                     UploadReader&& reader,
+                     std::function<void(std::optional<Packet>&&)>&& cbk,
+                     UploadProgressCallback&& progress = {});
+
 private:
     struct Impl;
     std::shared_ptr<Impl> d;
-
-    bool connectToHost();
-    bool isConnected();
-    bool disconnectFromHost();
 };
 
 }
@@ -0,0 +1,545 @@
+#include "clientconnection.hpp"
+
+#include "tlssessioncache.hpp"
+
+#include <array>
+#include <iterator>
+
+namespace HTTP
+{
+
+namespace
+{
+
+/**
+ * Параллельное подключение по RFC 8305 (Happy Eyeballs): попытки к следующему адресу
+ * запускаются с задержкой attemptDelay или сразу после неудачи предыдущей,
+ * первое установленное соединение выигрывает, остальные закрываются.
+ * Все обработчики выполняются в strand соединения
+ */
+class EndpointRace : public std::enable_shared_from_this<EndpointRace>
+{
+public:
+    using RaceCallback = std::function<void(beast::error_code, tcp::socket&&, const tcp::endpoint&)>;
+
+    EndpointRace(const net::any_io_executor& executor,
+                 const std::vector<tcp::endpoint>& endpoints,
+                 std::chrono::milliseconds attemptDelay,
+                 RaceCallback&& cbk) :
+        m_executor {executor},
+        m_endpoints {endpoints},
+        m_attemptDelay {attemptDelay},
+        m_delayTimer {executor},
+        m_callback {std::move(cbk)}
+    {
+
+    }
+
+    void start() {
+        net::dispatch(m_executor, [pSelf = shared_from_this()](){
+            pSelf->startNextAttempt();
+        });
+    }
+
+    // Закрыть все попытки и таймер, подключение завершится с operation_aborted
+    void cancel() {
+        net::post(m_executor, [pSelf = shared_from_this()](){
+            if (!pSelf->m_isFinished) {
+                pSelf->finish(net::error::operation_aborted, pSelf->m_attempts.size());
+            }
+        });
+    }
+
+private:
+    net::any_io_executor        m_executor;
+    std::vector<tcp::endpoint>  m_endpoints;
+    std::chrono::milliseconds   m_attemptDelay;
+    net::steady_timer           m_delayTimer;
+    RaceCallback                m_callback;
+
+    std::vector<std::unique_ptr<tcp::socket> > m_attempts;
+    std::size_t         m_activeCount {0};
+    bool                m_isFinished {false};
+    beast::error_code   m_lastError {net::error::host_not_found};
+
+    void startNextAttempt() {
+        if (m_attempts.size() == m_endpoints.size()) {
+            if (m_activeCount == 0) {
+                finish(m_lastError, m_attempts.size());
+            }
+            return;
+        }
+
+        auto attemptIndex = m_attempts.size();
+        const auto& endpoint = m_endpoints[attemptIndex];
+        m_attempts.push_back(std::make_unique<tcp::socket>(m_executor));
+        ++m_activeCount;
+
+        m_attempts.back()->async_connect(endpoint,
+            [pSelf = shared_from_this(), attemptIndex](beast::error_code ec) {
+            pSelf->onAttemptFinished(attemptIndex, ec);
+        });
+
+        m_delayTimer.expires_after(m_attemptDelay);
+        m_delayTimer.async_wait([pSelf = shared_from_this()](beast::error_code ec) {
+            if (ec || pSelf->m_isFinished) {
+                return;
+            }
+            pSelf->startNextAttempt();
+        });
+    }
+
+    void onAttemptFinished(std::size_t attemptIndex, beast::error_code ec) {
+        --m_activeCount;
+        if (m_isFinished) {
+            return;
+        }
+
+        if (ec) {
+            m_lastError = ec;
+            boost::system::error_code closeEc;
+            m_attempts[attemptIndex]->close(closeEc);
+            startNextAttempt();
+            return;
+        }
+        finish(ec, attemptIndex);
+    }
+
+    void finish(beast::error_code ec, std::size_t winnerIndex) {
+        m_isFinished = true;
+        m_delayTimer.cancel();
+
+        for (std::size_t i = 0; i < m_attempts.size(); ++i) {
+            if (i != winnerIndex) {
+                boost::system::error_code closeEc;
+                m_attempts[i]->close(closeEc);
+            }
+        }
+
+        if (ec) {
+            tcp::socket emptySocket(m_executor);
+            m_callback(ec, std::move(emptySocket), {});
+            return;
+        }
+        m_callback(ec, std::move(*m_attempts[winnerIndex]), m_endpoints[winnerIndex]);
+    }
+};
+
+}
+
+std::string HostAddress::toString() const
+{
+    return std::string(isSecure ? "https://" : "http://") + host + ":" + port;
+}
+
+ClientConnection::ClientConnection(net::io_context &ioc,
+                                   const HostAddress &address,
+                                   const std::shared_ptr<ssl::context> &ctx) :
+    m_address {address},
+    m_ctx {ctx},
+    m_stream {beast::tcp_stream(net::make_strand(ioc))}
+{
+    if (m_address.isSecure) {
+        m_stream.emplace<SslStream>(net::make_strand(ioc), *m_ctx);
+    }
+}
+
+ClientConnection::~ClientConnection()
+{
+    close();
+}
+
+const HostAddress &ClientConnection::address() const
+{
+    return m_address;
+}
+
+net::any_io_executor ClientConnection::executor()
+{
+    return socket().get_executor();
+}
+
+void ClientConnection::setAlpnProtocols(const std::vector<std::string> &protocols)
+{
+    if (!std::holds_alternative<SslStream>(m_stream)) {
+        return;
+    }
+
+    // Формат ALPN: каждый протокол с префиксом длины
+    std::vector<unsigned char> protocolList;
+    for (const auto& protocol : protocols) {
+        protocolList.push_back(static_cast<unsigned char>(protocol.size()));
+        protocolList.insert(protocolList.end(), protocol.begin(), protocol.end());
+    }
+    SSL_set_alpn_protos(std::get<SslStream>(m_stream).native_handle(), protocolList.data(), protocolList.size());
+}
+
+std::string ClientConnection::negotiatedProtocol()
+{
+    if (!std::holds_alternative<SslStream>(m_stream)) {
+        return {};
+    }
+
+    const unsigned char* protocol {nullptr};
+    unsigned int protocolSize {0};
+    SSL_get0_alpn_selected(std::get<SslStream>(m_stream).native_handle(), &protocol, &protocolSize);
+    if (!protocol) {
+        return {};
+    }
+    return std::string(reinterpret_cast<const char*>(protocol), protocolSize);
+}
+
+void ClientConnection::asyncConnect(const std::vector<tcp::endpoint> &endpoints,
+                                    std::chrono::milliseconds attemptDelay,
+                                    ConnectCallback &&cbk)
+{
+    if (std::holds_alternative<SslStream>(m_stream) &&
+            !SSL_set_tlsext_host_name(std::get<SslStream>(m_stream).native_handle(), m_address.host.c_str())) {
+        cbk(beast::error_code{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()});
+        return;
+    }
+    if (std::holds_alternative<SslStream>(m_stream)) {
+        TlsSessionCache::prepare(std::get<SslStream>(m_stream).native_handle(), m_address);
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    net::dispatch(socket().get_executor(), [pSelf = shared_from_this(), endpoints, attemptDelay, startTime, cbk = std::move(cbk)]() mutable {
+        // Обмен могли прервать, пока разрешалось имя хоста
+        if (pSelf->m_isAborted) {
+            cbk(net::error::operation_aborted);
+            return;
+        }
+        pSelf->startRace(endpoints, attemptDelay, startTime, std::move(cbk));
+    });
+}
+
+void ClientConnection::startRace(const std::vector<tcp::endpoint> &endpoints,
+                                 std::chrono::milliseconds attemptDelay,
+                                 std::chrono::steady_clock::time_point startTime,
+                                 ConnectCallback &&cbk)
+{
+    auto race = std::make_shared<EndpointRace>(socket().get_executor(), endpoints, attemptDelay,
+        [pSelf = shared_from_this(), startTime, cbk = std::move(cbk)](beast::error_code ec, tcp::socket&& sock, const tcp::endpoint& endpoint) mutable {
+        pSelf->m_cancelConnect = nullptr;
+        auto connectedTime = std::chrono::steady_clock::now();
+        pSelf->m_connectTiming.connect = std::chrono::duration_cast<std::chrono::microseconds>(connectedTime - startTime);
+        pSelf->m_connectTiming.tlsHandshake = std::chrono::microseconds(0);
+        if (ec) {
+            cbk(ec);
+            return;
+        }
+        pSelf->socket() = std::move(sock);
+        pSelf->m_remoteEndpoint = endpoint;
+
+        if (std::holds_alternative<beast::tcp_stream>(pSelf->m_stream)) {
+            pSelf->m_isAlive = true;
+            cbk(ec);
+            return;
+        }
+        std::get<SslStream>(pSelf->m_stream).async_handshake(ssl::stream_base::client,
+            [pSelf, connectedTime, cbk = std::move(cbk)](beast::error_code ec) {
+            pSelf->m_connectTiming.tlsHandshake = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - connectedTime);
+            pSelf->m_isAlive = !ec;
+            cbk(ec);
+        });
+    });
+    m_cancelConnect = [pWeakRace = std::weak_ptr<EndpointRace>(race)](){
+        if (auto race = pWeakRace.lock()) {
+            race->cancel();
+        }
+    };
+    race->start();
+}
+
+void ClientConnection::setResolveTime(std::chrono::microseconds duration)
+{
+    m_connectTiming.dns = duration;
+}
+
+const ClientConnection::ConnectTiming &ClientConnection::connectTiming() const
+{
+    return m_connectTiming;
+}
+
+bool ClientConnection::isSessionReused()
+{
+    if (!std::holds_alternative<SslStream>(m_stream)) {
+        return false;
+    }
+    return SSL_session_reused(std::get<SslStream>(m_stream).native_handle());
+}
+
+const tcp::endpoint &ClientConnection::remoteEndpoint() const
+{
+    return m_remoteEndpoint;
+}
+
+bool ClientConnection::isOpen() const
+{
+    return socket().is_open();
+}
+
+bool ClientConnection::isAlive() const
+{
+    return m_isAlive;
+}
+
+void ClientConnection::markDead()
+{
+    m_isAlive = false;
+}
+
+void ClientConnection::watchIdle(std::function<void ()> &&onClosed)
+{
+    auto generation = ++m_idleWatchGeneration;
+    net::dispatch(socket().get_executor(), [pSelf = shared_from_this(), generation, onClosed = std::move(onClosed)]() mutable {
+        pSelf->waitIdle(generation, std::move(onClosed));
+    });
+}
+
+void ClientConnection::waitIdle(unsigned generation, std::function<void ()> &&onClosed)
+{
+    // Соединение могли снова выдать, пока ожидание ставилось в strand
+    if (generation != m_idleWatchGeneration || !isOpen()) {
+        return;
+    }
+
+    socket().async_wait(tcp::socket::wait_read,
+        [pWeak = weak_from_this(), generation, onClosed = std::move(onClosed)](beast::error_code ec) mutable {
+        auto pSelf = pWeak.lock();
+        if (!pSelf || ec == net::error::operation_aborted || generation != pSelf->m_idleWatchGeneration) {
+            return;
+        }
+
+        // TLS 1.3 сервер после рукопожатия присылает билеты сессий: они не означают закрытия
+        if (!ec && pSelf->drainTlsRecords()) {
+            pSelf->waitIdle(generation, std::move(onClosed));
+            return;
+        }
+
+        // В свободном HTTP/1.1 соединении читать нечего: это закрытие со стороны сервера
+        pSelf->m_isAlive = false;
+        onClosed();
+    });
+}
+
+bool ClientConnection::drainTlsRecords()
+{
+    auto stream = std::get_if<SslStream>(&m_stream);
+    if (!stream) {
+        return false;
+    }
+
+    // Служебные записи (NewSessionTicket) разбираются движком TLS при чтении, новые сессии попадают в кеш.
+    // Чтение без блокировки: would_block -- данных приложения нет и соединение открыто
+    beast::error_code ec;
+    socket().non_blocking(true, ec);
+    if (ec) {
+        return false;
+    }
+    std::array<char, 1> data;
+    stream->read_some(net::buffer(data), ec);
+
+    beast::error_code restoreEc;
+    socket().non_blocking(false, restoreEc);
+    return (ec == net::error::would_block && !restoreEc);
+}
+
+void ClientConnection::stopIdleWatch()
+{
+    // Ожидание не отменяется (лишний системный вызов): оно завершится с приходом ответа и будет проигнорировано
+    ++m_idleWatchGeneration;
+}
+
+void ClientConnection::enqueue(WriteOperation &&write, ReadOperation &&read, ExchangeCallback &&cbk)
+{
+    net::dispatch(socket().get_executor(),
+        [pSelf = shared_from_this(), entry = PipelineEntry{std::move(write), std::move(read), std::move(cbk)}]() mutable {
+        if (pSelf->m_pipelineError) {
+            entry.callback(pSelf, pSelf->unsentRequestError());
+            return;
+        }
+        pSelf->m_writeQueue.push_back(std::move(entry));
+        pSelf->writeNext();
+    });
+}
+
+void ClientConnection::cancel()
+{
+    net::post(socket().get_executor(), [pSelf = shared_from_this()](){
+        boost::system::error_code ec;
+        pSelf->socket().cancel(ec);
+    });
+}
+
+void ClientConnection::close()
+{
+    m_isAlive = false;
+    if (!isOpen()) {
+        return;
+    }
+
+    boost::system::error_code ec;
+    socket().shutdown(tcp::socket::shutdown_both, ec);
+    socket().close(ec);
+}
+
+void ClientConnection::postClose()
+{
+    m_isAlive = false;
+    net::post(socket().get_executor(), [pSelf = shared_from_this()](){
+        pSelf->close();
+    });
+}
+
+void ClientConnection::abort()
+{
+    m_isAborted = true;
+    if (m_cancelConnect) {
+        m_cancelConnect();
+        m_cancelConnect = nullptr;
+    }
+    breakPipeline(net::error::connection_aborted);
+    close();
+}
+
+beast::flat_buffer &ClientConnection::buffer()
+{
+    return m_buffer;
+}
+
+void ClientConnection::setIdleSince(std::chrono::steady_clock::time_point timePoint)
+{
+    m_idleSince = timePoint;
+}
+
+std::chrono::steady_clock::time_point ClientConnection::idleSince() const
+{
+    return m_idleSince;
+}
+
+void ClientConnection::writeNext()
+{
+    if (m_isWriting || m_writeQueue.empty()) {
+        return;
+    }
+    m_isWriting = true;
+    m_writeQueue.front().write(*this, [pSelf = shared_from_this()](beast::error_code ec) {
+        pSelf->onWriteFinished(ec);
+    });
+}
+
+void ClientConnection::readNext()
+{
+    if (m_isReading || m_readQueue.empty()) {
+        return;
+    }
+    m_isReading = true;
+    m_readQueue.front().read(*this, [pSelf = shared_from_this()](beast::error_code ec, bool isKeepAlive) {
+        pSelf->onReadFinished(ec, isKeepAlive);
+    });
+}
+
+void ClientConnection::onWriteFinished(beast::error_code ec)
+{
+    m_isWriting = false;
+    auto entry = std::move(m_writeQueue.front());
+    m_writeQueue.pop_front();
+
+    if (ec) {
+        breakPipeline(ec);
+        entry.callback(shared_from_this(), m_pipelineError);
+        drainPipeline();
+        return;
+    }
+
+    m_readQueue.push_back(std::move(entry));
+    if (m_pipelineError) {
+        drainPipeline();
+        return;
+    }
+    readNext();
+    writeNext();
+}
+
+void ClientConnection::onReadFinished(beast::error_code ec, bool isKeepAlive)
+{
+    m_isReading = false;
+    auto entry = std::move(m_readQueue.front());
+    m_readQueue.pop_front();
+
+    // После ответа с Connection: close сервер не обрабатывает следующие запросы (RFC 7230, 6.6)
+    if (ec) {
+        breakPipeline(ec);
+    } else if (!isKeepAlive) {
+        breakPipeline(net::error::try_again);
+    }
+    entry.callback(shared_from_this(), ec ? m_pipelineError : ec);
+
+    if (m_pipelineError) {
+        drainPipeline();
+        return;
+    }
+    readNext();
+}
+
+void ClientConnection::breakPipeline(beast::error_code ec)
+{
+    if (m_pipelineError) {
+        return;
+    }
+    m_pipelineError = ec;
+    m_isAlive = false;
+
+    // Незавершённые операции закончатся с operation_aborted и будут завершены с исходной ошибкой
+    boost::system::error_code cancelEc;
+    socket().cancel(cancelEc);
+}
+
+void ClientConnection::drainPipeline()
+{
+    // Запросы, операции которых ещё выполняются, завершатся в своих обработчиках
+    std::deque<PipelineEntry> unread;
+    std::deque<PipelineEntry> unsent;
+    auto firstUnread = m_readQueue.begin() + (m_isReading ? 1 : 0);
+    auto firstUnsent = m_writeQueue.begin() + (m_isWriting ? 1 : 0);
+    std::move(firstUnread, m_readQueue.end(), std::back_inserter(unread));
+    std::move(firstUnsent, m_writeQueue.end(), std::back_inserter(unsent));
+    m_readQueue.erase(firstUnread, m_readQueue.end());
+    m_writeQueue.erase(firstUnsent, m_writeQueue.end());
+
+    auto pSelf = shared_from_this();
+    for (auto& entry : unread) {
+        entry.callback(pSelf, m_pipelineError);
+    }
+    for (auto& entry : unsent) {
+        entry.callback(pSelf, unsentRequestError());
+    }
+}
+
+beast::error_code ClientConnection::unsentRequestError() const
+{
+    // Неотправленный запрос безопасно повторить, если только его не прервали намеренно
+    if (m_pipelineError == net::error::operation_aborted) {
+        return m_pipelineError;
+    }
+    return net::error::try_again;
+}
+
+tcp::socket &ClientConnection::socket()
+{
+    if (std::holds_alternative<beast::tcp_stream>(m_stream)) {
+        return std::get<beast::tcp_stream>(m_stream).socket();
+    }
+    return beast::get_lowest_layer(std::get<SslStream>(m_stream)).socket();
+}
+
+const tcp::socket &ClientConnection::socket() const
+{
+    if (std::holds_alternative<beast::tcp_stream>(m_stream)) {
+        return std::get<beast::tcp_stream>(m_stream).socket();
+    }
+    return beast::get_lowest_layer(std::get<SslStream>(m_stream)).socket();
+}
+
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <variant>
+#include <vector>
+
+namespace HTTP
+{
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+/**
+ * @brief The HostAddress struct Адрес хоста, по которому группируются соединения
+ */
+struct HostAddress
+{
+    bool        isSecure {false};
+    std::string host;
+    std::string port;
+
+    std::string toString() const;
+};
+
+/**
+ * @brief The ClientConnection class Одно клиентское соединение (TCP или TLS) из пула.
+ *        Все операции над потоком идут через собственный strand соединения
+ */
+class ClientConnection : public std::enable_shared_from_this<ClientConnection>
+{
+public:
+    using SslStream = ssl::stream<beast::tcp_stream>;
+    using ConnectCallback = std::function<void(beast::error_code)>;
+
+    using WriteHandler = std::function<void(beast::error_code)>;
+    using ReadHandler = std::function<void(beast::error_code, bool isKeepAlive)>;
+    using WriteOperation = std::function<void(ClientConnection&, WriteHandler&&)>;
+    using ReadOperation = std::function<void(ClientConnection&, ReadHandler&&)>;
+    using ExchangeCallback = std::function<void(const std::shared_ptr<ClientConnection>&, beast::error_code)>;
+
+    /**
+     * @brief The ConnectTiming struct Время этапов подключения
+     */
+    struct ConnectTiming
+    {
+        std::chrono::microseconds dns {0};
+        std::chrono::microseconds connect {0};
+        std::chrono::microseconds tlsHandshake {0};
+    };
+
+    ClientConnection(net::io_context& ioc,
+                     const HostAddress& address,
+                     const std::shared_ptr<ssl::context>& ctx);
+    ~ClientConnection();
+
+    const HostAddress& address() const;
+    net::any_io_executor executor();
+
+    /**
+     * @brief setAlpnProtocols  Протоколы, предлагаемые серверу при TLS рукопожатии (ALPN), в порядке предпочтения.
+     *                          Задаётся до подключения
+     * @param protocols
+     */
+    void setAlpnProtocols(const std::vector<std::string>& protocols);
+
+    /**
+     * @brief negotiatedProtocol    Протокол, выбранный сервером по ALPN. Пустая строка, если выбора не было
+     */
+    std::string negotiatedProtocol();
+
+    /**
+     * @brief asyncConnect  Подключиться к одному из адресов и, для TLS, выполнить рукопожатие.
+     *                      Адреса перебираются параллельно со сдвигом attemptDelay (Happy Eyeballs)
+     * @param endpoints     Адреса хоста в порядке предпочтения
+     * @param attemptDelay  Задержка перед попыткой подключения к следующему адресу
+     * @param cbk
+     */
+    void asyncConnect(const std::vector<tcp::endpoint>& endpoints,
+                      std::chrono::milliseconds attemptDelay,
+                      ConnectCallback&& cbk);
+
+    /**
+     * @brief setResolveTime    Время разрешения имени хоста перед подключением: DNS выполняется вне соединения
+     * @param duration
+     */
+    void setResolveTime(std::chrono::microseconds duration);
+
+    /**
+     * @brief connectTiming Время этапов последнего подключения
+     */
+    const ConnectTiming& connectTiming() const;
+
+    /**
+     * @brief isSessionReused   TLS сессия возобновлена из кеша, без полного рукопожатия
+     */
+    bool isSessionReused();
+
+    /**
+     * @brief remoteEndpoint    Адрес, к которому удалось подключиться
+     */
+    const tcp::endpoint& remoteEndpoint() const;
+
+    bool isOpen() const;
+
+    /**
+     * @brief isAlive   Состояние соединения по результатам прошлых операций, без обращения к сокету
+     * @return          false, если была ошибка ввода-вывода или сервер закрыл соединение
+     */
+    bool isAlive() const;
+    void markDead();
+
+    /**
+     * @brief watchIdle Следить за свободным соединением: если оно стало читаемым, сервер его закрыл.
+     *                  Служебные записи TLS (билеты сессий TLS 1.3) закрытием не считаются.
+     *                  Вызывается из любого потока, ожидание запускается в strand соединения
+     * @param onClosed  Колбек, вызываемый в этом случае
+     */
+    void watchIdle(std::function<void()>&& onClosed);
+    void stopIdleWatch();
+
+    /**
+     * @brief enqueue   Поставить запрос в очередь соединения. Запросы отправляются по порядку, не дожидаясь
+     *                  ответов на предыдущие (HTTP/1.1 pipelining), ответы читаются в том же порядке.
+     *                  Если соединение оборвалось или сервер закрыл его после одного из ответов,
+     *                  ещё не обработанные сервером запросы завершаются с net::error::try_again
+     * @param write     Отправка запроса в поток соединения
+     * @param read      Чтение ответа из потока соединения
+     * @param cbk       Колбек завершения обмена, вызывается в strand соединения
+     */
+    void enqueue(WriteOperation&& write, ReadOperation&& read, ExchangeCallback&& cbk);
+
+    void cancel();
+    void close();
+
+    /**
+     * @brief postClose Закрыть соединение из любого потока: соединение сразу считается мёртвым,
+     *                  а сокет закрывается в strand соединения, не пересекаясь с его операциями
+     */
+    void postClose();
+
+    /**
+     * @brief abort Прервать обмен и закрыть соединение. Отправленные запросы завершатся с connection_aborted,
+     *              неотправленные -- с try_again, идущее подключение (все попытки к адресам) -- с operation_aborted.
+     *              Вызывается в strand соединения
+     */
+    void abort();
+
+    beast::flat_buffer& buffer();
+
+    template <typename Handler>
+    decltype(auto) visit(Handler&& handler) {
+        return std::visit(std::forward<Handler>(handler), m_stream);
+    }
+
+    void setIdleSince(std::chrono::steady_clock::time_point timePoint);
+    std::chrono::steady_clock::time_point idleSince() const;
+
+private:
+    struct PipelineEntry
+    {
+        WriteOperation      write;
+        ReadOperation       read;
+        ExchangeCallback    callback;
+    };
+
+    HostAddress m_address;
+    std::shared_ptr<ssl::context> m_ctx;
+    std::variant<beast::tcp_stream, SslStream> m_stream;
+    beast::flat_buffer m_buffer;
+    tcp::endpoint m_remoteEndpoint;
+    ConnectTiming m_connectTiming;
+
+    std::atomic<bool>       m_isAlive {false};
+    std::atomic<unsigned>   m_idleWatchGeneration {0};
+    std::chrono::steady_clock::time_point m_idleSince;
+
+    // Очередь конвейера, доступ только из strand соединения
+    std::deque<PipelineEntry>   m_writeQueue;
+    std::deque<PipelineEntry>   m_readQueue;
+    bool                        m_isWriting {false};
+    bool                        m_isReading {false};
+    beast::error_code           m_pipelineError;
+
+    // Подключение, доступ только из strand соединения
+    std::function<void()>       m_cancelConnect;
+    bool                        m_isAborted {false};
+
+    tcp::socket& socket();
+    const tcp::socket& socket() const;
+
+    void startRace(const std::vector<tcp::endpoint>& endpoints,
+                   std::chrono::milliseconds attemptDelay,
+                   std::chrono::steady_clock::time_point startTime,
+                   ConnectCallback&& cbk);
+
+    void writeNext();
+    void readNext();
+    void onWriteFinished(beast::error_code ec);
+    void onReadFinished(beast::error_code ec, bool isKeepAlive);
+    void breakPipeline(beast::error_code ec);
+    void waitIdle(unsigned generation, std::function<void()>&& onClosed);
+
+    /**
+     * @brief drainTlsRecords   Дочитать пришедшие в свободное TLS соединение служебные записи
+     * @return                  true, если соединение по-прежнему открыто и данных приложения нет
+     */
+    bool drainTlsRecords();
+    void drainPipeline();
+    beast::error_code unsentRequestError() const;
+};
+
+}
@@ -0,0 +1,90 @@
+#include "clientruntime.hpp"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace HTTP
+{
+
+namespace net = boost::asio;
+
+namespace
+{
+
+const std::size_t maxDefaultThreadCount {4};
+
+std::atomic<std::size_t> defaultThreadCount {0};
+
+std::size_t threadCountOrDefault(std::size_t threadCount)
+{
+    if (threadCount > 0) {
+        return threadCount;
+    }
+    if (defaultThreadCount > 0) {
+        return defaultThreadCount;
+    }
+    return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, maxDefaultThreadCount);
+}
+
+}
+
+struct ClientRuntime::Impl
+{
+    net::io_context ioc;
+    net::executor_work_guard<net::io_context::executor_type> work {net::make_work_guard(ioc)};
+    std::vector<std::thread> ioThreads;
+
+    explicit Impl(std::size_t threadCount) :
+        ioc {static_cast<int>(threadCount)} {
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            ioThreads.emplace_back([this](){
+                ioc.run();
+            });
+        }
+    }
+
+    ~Impl() {
+        work.reset();
+        ioc.stop();
+        for (auto& ioThread : ioThreads) {
+            if (ioThread.joinable()) {
+                ioThread.join();
+            }
+        }
+    }
+};
+
+ClientRuntime::ClientRuntime(std::size_t threadCount) :
+    d {std::make_unique<Impl>(threadCountOrDefault(threadCount))}
+{
+
+}
+
+ClientRuntime::~ClientRuntime() = default;
+
+ClientRuntime &ClientRuntime::instance()
+{
+    static ClientRuntime runtime;
+    return runtime;
+}
+
+void ClientRuntime::setDefaultThreadCount(std::size_t threadCount)
+{
+    defaultThreadCount = threadCount;
+}
+
+net::io_context &ClientRuntime::context()
+{
+    return d->ioc;
+}
+
+std::size_t ClientRuntime::threadCount() const
+{
+    return d->ioThreads.size();
+}
+
+}
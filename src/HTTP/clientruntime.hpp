@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace boost::asio
+{
+class io_context;
+}
+
+namespace HTTP
+{
+
+/**
+ * @brief The ClientRuntime class Общий io_context с небольшим пулом потоков, на котором работают клиенты.
+ *        Клиенты, созданные без своего io_context, используют общий runtime процесса,
+ *        поэтому число потоков не растёт с числом клиентов
+ */
+class ClientRuntime
+{
+public:
+    /**
+     * @brief ClientRuntime Собственный runtime для группы клиентов
+     * @param threadCount   Число потоков, 0 -- значение по умолчанию
+     */
+    explicit ClientRuntime(std::size_t threadCount = 0);
+    ~ClientRuntime();
+
+    ClientRuntime(const ClientRuntime&) = delete;
+    ClientRuntime& operator=(const ClientRuntime&) = delete;
+
+    /**
+     * @brief instance  Runtime процесса, общий для клиентов без своего io_context
+     */
+    static ClientRuntime& instance();
+
+    /**
+     * @brief setDefaultThreadCount Число потоков runtime процесса. Действует, если вызвано до первого обращения к instance().
+     *                              По умолчанию -- число ядер, но не больше 4
+     * @param threadCount
+     */
+    static void setDefaultThreadCount(std::size_t threadCount);
+
+    boost::asio::io_context& context();
+    std::size_t threadCount() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
+
+}
@@ -0,0 +1,326 @@
+#include "connectionpool.hpp"
+
+#include <algorithm>
+
+namespace HTTP
+{
+
+ConnectionPool::ConnectionPool(net::io_context &ioc, const std::shared_ptr<ssl::context> &ctx) :
+    m_ioc {ioc},
+    m_ctx {ctx},
+    m_evictionTimer {ioc}
+{
+
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    m_evictionTimer.cancel();
+}
+
+void ConnectionPool::setMaxConnectionsPerHost(std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxConnectionsPerHost = std::max<std::size_t>(count, 1);
+}
+
+void ConnectionPool::setIdleTimeout(std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idleTimeout = timeout;
+}
+
+void ConnectionPool::setPipelineDepth(std::size_t depth)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pipelineDepth = std::max<std::size_t>(depth, 1);
+}
+
+void ConnectionPool::acquire(const HostAddress &address, AcquireCallback &&cbk, bool canPipeline)
+{
+    ConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& entry = m_hosts[address.toString()];
+
+        while (!entry.idle.empty()) {
+            auto idleConn = std::move(entry.idle.back());
+            entry.idle.pop_back();
+            if (idleConn->isAlive()) {
+                idleConn->stopIdleWatch();
+                conn = std::move(idleConn);
+                break;
+            }
+            idleConn->postClose();
+        }
+
+        if (!conn && entry.busy.size() < m_maxConnectionsPerHost) {
+            conn = createConnection(address);
+        }
+
+        if (conn) {
+            entry.busy[conn] = BusyState{1, canPipeline};
+        } else {
+            conn = (canPipeline ? pipelineConnection(entry) : nullptr);
+            if (!conn) {
+                entry.waiters.push_back(Waiter{std::move(cbk), canPipeline});
+                return;
+            }
+        }
+    }
+    cbk(std::move(conn));
+}
+
+void ConnectionPool::release(const ConnectionPtr &conn, bool isReusable)
+{
+    HandoverList handover;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& entry = m_hosts[conn->address().toString()];
+        auto busyConn = entry.busy.find(conn);
+        if (busyConn == entry.busy.end()) {
+            return;
+        }
+
+        isReusable = isReusable && conn->isAlive();
+        if (!isReusable) {
+            conn->postClose();
+        }
+
+        if (--busyConn->second.requestCount > 0) {
+            // В конвейере соединения остались запросы: место в очереди можно отдать ожидающему
+            if (isReusable) {
+                takePipelineWaiters(entry, conn, handover);
+            }
+        } else {
+            entry.busy.erase(busyConn);
+
+            if (!entry.waiters.empty()) {
+                auto waiter = std::move(entry.waiters.front());
+                entry.waiters.pop_front();
+                auto waiterConn = isReusable ? conn : createConnection(conn->address());
+                entry.busy[waiterConn] = BusyState{1, waiter.canPipeline};
+                handover.emplace_back(std::move(waiter.cbk), waiterConn);
+                takePipelineWaiters(entry, waiterConn, handover);
+            } else if (isReusable) {
+                conn->setIdleSince(std::chrono::steady_clock::now());
+                conn->watchIdle([pWeak = weak_from_this(), pWeakConn = std::weak_ptr<ClientConnection>(conn)](){
+                    auto pSelf = pWeak.lock();
+                    auto pConn = pWeakConn.lock();
+                    if (pSelf && pConn) {
+                        pSelf->dropIdle(pConn);
+                    }
+                });
+                entry.idle.push_back(conn);
+                scheduleEviction();
+            }
+        }
+    }
+    handOver(std::move(handover));
+}
+
+void ConnectionPool::dispatchWaiters(const ConnectionPtr &conn)
+{
+    HandoverList handover;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_hosts.find(conn->address().toString());
+        if (entry == m_hosts.end()) {
+            return;
+        }
+        takePipelineWaiters(entry->second, conn, handover);
+    }
+    handOver(std::move(handover));
+}
+
+void ConnectionPool::cancelActive()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [hostName, entry] : m_hosts) {
+        for (auto& [conn, state] : entry.busy) {
+            conn->cancel();
+        }
+    }
+}
+
+void ConnectionPool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [hostName, entry] : m_hosts) {
+        for (auto& conn : entry.idle) {
+            conn->postClose();
+        }
+        entry.idle.clear();
+    }
+}
+
+ConnectionPool::ConnectionPtr ConnectionPool::reserve(const HostAddress &address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& entry = m_hosts[address.toString()];
+    if (entry.idle.size() + entry.busy.size() >= m_maxConnectionsPerHost) {
+        return nullptr;
+    }
+
+    auto conn = createConnection(address);
+    entry.busy[conn] = BusyState{1, false};
+    return conn;
+}
+
+std::size_t ConnectionPool::connectionCount(const HostAddress &address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_hosts.find(address.toString());
+    if (entry == m_hosts.end()) {
+        return 0;
+    }
+    return entry->second.idle.size() + entry->second.busy.size();
+}
+
+std::size_t ConnectionPool::idleConnectionCount(const HostAddress &address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_hosts.find(address.toString());
+    if (entry == m_hosts.end()) {
+        return 0;
+    }
+    return entry->second.idle.size();
+}
+
+void ConnectionPool::setPreferredEndpoint(const HostAddress &address, const tcp::endpoint &endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_preferredEndpoints[address.toString()] = endpoint;
+}
+
+std::optional<tcp::endpoint> ConnectionPool::preferredEndpoint(const HostAddress &address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto endpoint = m_preferredEndpoints.find(address.toString());
+    if (endpoint == m_preferredEndpoints.end()) {
+        return std::nullopt;
+    }
+    return endpoint->second;
+}
+
+ConnectionPool::ConnectionPtr ConnectionPool::createConnection(const HostAddress &address)
+{
+    return std::make_shared<ClientConnection>(m_ioc, address, m_ctx);
+}
+
+ConnectionPool::ConnectionPtr ConnectionPool::pipelineConnection(HostEntry &entry)
+{
+    if (m_pipelineDepth < 2) {
+        return nullptr;
+    }
+
+    // Подключение ещё не установлено, пока соединение не живое: в его очередь не ставим
+    auto leastBusy = entry.busy.end();
+    for (auto busyConn = entry.busy.begin(); busyConn != entry.busy.end(); ++busyConn) {
+        const auto& state = busyConn->second;
+        if (!state.canPipeline || state.requestCount >= m_pipelineDepth || !busyConn->first->isAlive()) {
+            continue;
+        }
+        if (leastBusy == entry.busy.end() || state.requestCount < leastBusy->second.requestCount) {
+            leastBusy = busyConn;
+        }
+    }
+    if (leastBusy == entry.busy.end()) {
+        return nullptr;
+    }
+    ++leastBusy->second.requestCount;
+    return leastBusy->first;
+}
+
+void ConnectionPool::takePipelineWaiters(HostEntry &entry, const ConnectionPtr &conn, HandoverList &handover)
+{
+    auto busyConn = entry.busy.find(conn);
+    if (busyConn == entry.busy.end() || !busyConn->second.canPipeline || !conn->isAlive()) {
+        return;
+    }
+
+    // Ожидающие выдаются строго по очереди: запрос, который нельзя конвейеризовать, останавливает раздачу
+    auto& state = busyConn->second;
+    while (!entry.waiters.empty() && entry.waiters.front().canPipeline && state.requestCount < m_pipelineDepth) {
+        ++state.requestCount;
+        handover.emplace_back(std::move(entry.waiters.front().cbk), conn);
+        entry.waiters.pop_front();
+    }
+}
+
+void ConnectionPool::handOver(HandoverList &&handover)
+{
+    // Не в стеке вызова release: ожидающий может сразу начать новый запрос
+    for (auto& [waiter, waiterConn] : handover) {
+        net::post(m_ioc, [waiter = std::move(waiter), waiterConn = std::move(waiterConn)]() mutable {
+            waiter(std::move(waiterConn));
+        });
+    }
+}
+
+void ConnectionPool::dropIdle(const ConnectionPtr &conn)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_hosts.find(conn->address().toString());
+    if (entry == m_hosts.end()) {
+        return;
+    }
+
+    auto& idle = entry->second.idle;
+    auto idleConn = std::find(idle.begin(), idle.end(), conn);
+    if (idleConn != idle.end()) {
+        (*idleConn)->postClose();
+        idle.erase(idleConn);
+    }
+}
+
+void ConnectionPool::scheduleEviction()
+{
+    if (m_isEvictionScheduled) {
+        return;
+    }
+    m_isEvictionScheduled = true;
+
+    m_evictionTimer.expires_after(m_idleTimeout / 2);
+    m_evictionTimer.async_wait([pWeak = weak_from_this()](beast::error_code ec) {
+        auto pSelf = pWeak.lock();
+        if (ec || !pSelf) {
+            return;
+        }
+        pSelf->evictIdle();
+    });
+}
+
+void ConnectionPool::evictIdle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isEvictionScheduled = false;
+
+    bool hasIdle {false};
+    auto expireTime = std::chrono::steady_clock::now() - m_idleTimeout;
+    for (auto hostIt = m_hosts.begin(); hostIt != m_hosts.end();) {
+        auto& entry = hostIt->second;
+
+        // Свободные соединения лежат в порядке возврата, самые старые -- в начале
+        auto firstAlive = std::find_if(entry.idle.begin(), entry.idle.end(), [&](const ConnectionPtr& conn){
+            return conn->idleSince() > expireTime;
+        });
+        std::for_each(entry.idle.begin(), firstAlive, [](const ConnectionPtr& conn){
+            conn->postClose();
+        });
+        entry.idle.erase(entry.idle.begin(), firstAlive);
+        hasIdle = hasIdle || !entry.idle.empty();
+
+        if (entry.idle.empty() && entry.busy.empty() && entry.waiters.empty()) {
+            hostIt = m_hosts.erase(hostIt);
+        } else {
+            ++hostIt;
+        }
+    }
+
+    if (hasIdle) {
+        scheduleEviction();
+    }
+}
+
+}
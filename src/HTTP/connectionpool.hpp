@@ -0,0 +1,134 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "clientconnection.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The ConnectionPool class Пул keep-alive соединений клиента, сгруппированных по схеме, хосту и порту.
+ *        Свободные соединения выдаются в порядке LIFO (последнее возвращённое -- самое "тёплое"),
+ *        простаивающие дольше таймаута закрываются
+ */
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+{
+public:
+    using ConnectionPtr = std::shared_ptr<ClientConnection>;
+    using AcquireCallback = std::function<void(ConnectionPtr)>;
+
+    ConnectionPool(net::io_context& ioc, const std::shared_ptr<ssl::context>& ctx);
+    ~ConnectionPool();
+
+    void setMaxConnectionsPerHost(std::size_t count);
+    void setIdleTimeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief setPipelineDepth  Сколько запросов можно одновременно держать в очереди одного соединения.
+     *                          1 -- конвейер (HTTP/1.1 pipelining) выключен
+     * @param depth
+     */
+    void setPipelineDepth(std::size_t depth);
+
+    /**
+     * @brief acquire       Взять соединение до хоста. Если свободного нет и лимит не достигнут, выдаётся новое
+     *                      неподключенное соединение. Иначе запрос ставится в конвейер наименее загруженного
+     *                      подключенного соединения, а если и это нельзя -- колбек вызовется, когда соединение вернут
+     * @param address
+     * @param cbk
+     * @param canPipeline   Можно ли отправить запрос, не дожидаясь ответов на предыдущие (идемпотентный метод)
+     */
+    void acquire(const HostAddress& address, AcquireCallback&& cbk, bool canPipeline = false);
+
+    /**
+     * @brief reserve   Занять новое неподключенное соединение для прогрева, если лимит хоста не достигнут
+     * @param address
+     * @return          nullptr, если лимит достигнут
+     */
+    ConnectionPtr reserve(const HostAddress& address);
+
+    /**
+     * @brief release       Вернуть соединение в пул. Соединение с конвейером возвращается столько раз, сколько было выдано
+     * @param conn
+     * @param isReusable    false, если соединение нельзя использовать повторно (ошибка, Connection: close)
+     */
+    void release(const ConnectionPtr& conn, bool isReusable);
+
+    /**
+     * @brief dispatchWaiters   Поставить ожидающие запросы в конвейер соединения, которое только что подключилось
+     * @param conn
+     */
+    void dispatchWaiters(const ConnectionPtr& conn);
+
+    /**
+     * @brief cancelActive  Прервать операции на всех занятых соединениях
+     */
+    void cancelActive();
+
+    /**
+     * @brief clear Закрыть все свободные соединения
+     */
+    void clear();
+
+    std::size_t connectionCount(const HostAddress& address);
+    std::size_t idleConnectionCount(const HostAddress& address);
+
+    /**
+     * @brief setPreferredEndpoint  Запомнить адрес, к которому последний раз удалось подключиться
+     * @param address
+     * @param endpoint
+     */
+    void setPreferredEndpoint(const HostAddress& address, const tcp::endpoint& endpoint);
+    std::optional<tcp::endpoint> preferredEndpoint(const HostAddress& address);
+
+private:
+    struct BusyState
+    {
+        std::size_t requestCount {0};
+        bool        canPipeline {false};
+    };
+
+    struct Waiter
+    {
+        AcquireCallback cbk;
+        bool            canPipeline {false};
+    };
+
+    struct HostEntry
+    {
+        std::vector<ConnectionPtr>                      idle;
+        std::unordered_map<ConnectionPtr, BusyState>    busy;
+        std::deque<Waiter>                              waiters;
+    };
+
+    using HandoverList = std::vector<std::pair<AcquireCallback, ConnectionPtr> >;
+
+    net::io_context&                m_ioc;
+    std::shared_ptr<ssl::context>   m_ctx;
+
+    std::mutex                                  m_mutex;
+    std::unordered_map<std::string, HostEntry>  m_hosts;
+    std::unordered_map<std::string, tcp::endpoint> m_preferredEndpoints;
+
+    std::size_t                 m_maxConnectionsPerHost {6};
+    std::chrono::milliseconds   m_idleTimeout {30000};
+    std::size_t                 m_pipelineDepth {1};
+
+    net::steady_timer   m_evictionTimer;
+    bool                m_isEvictionScheduled {false};
+
+    ConnectionPtr createConnection(const HostAddress& address);
+    ConnectionPtr pipelineConnection(HostEntry& entry);
+    void takePipelineWaiters(HostEntry& entry, const ConnectionPtr& conn, HandoverList& handover);
+    void handOver(HandoverList&& handover);
+    void dropIdle(const ConnectionPtr& conn);
+    void scheduleEviction();
+    void evictIdle();
+};
+
+}
@@ -2,11 +2,172 @@
 
 #include <Components/Logger/Logger.h>
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "multipartparser.hpp"
+
 namespace HTTP
 {
 
+namespace
+{
+
+// Ограничение тела обычных запросов, как у парсера beast по умолчанию
+const std::uint64_t requestBodyLimit {1024 * 1024};
+
+bool isSessionClosed(const beast::error_code& ec)
+{
+    return (ec == beast::errc::not_connected ||
+            ec == net::error::eof ||
+            ec == net::error::connection_reset ||
+            ec == net::ssl::error::stream_truncated ||
+            ec == net::error::operation_aborted ||
+            ec.value() == 1); // TODO: Разобраться чё за код
+}
+
+// Имя файла от клиента используется только как суффикс, без путей и спецсимволов
+std::string sanitizedFileName(const std::string& fileName)
+{
+    auto res = std::filesystem::path(fileName).filename().string();
+    for (auto& c : res) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_') {
+            c = '_';
+        }
+    }
+    return res;
+}
+
+// Номер файла загрузки, общий для всех сессий процесса
+std::atomic<std::uint64_t> spillFileCounter {0};
+
+// Создать файл загрузки, которого ещё нет: существующий файл, в том числе уже отданный обработчику, не перезаписывается.
+// Возвращает дескриптор созданного файла или -1, запись идёт через него, без повторного открытия по пути
+int createSpillFile(const std::string& directory, const std::string& fileName, std::string& path)
+{
+    const int maxAttempts {16};
+    for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+        path = (std::filesystem::path(directory) /
+                     ("upload-" + std::to_string(::getpid()) + "-" + std::to_string(spillFileCounter.fetch_add(1)) +
+                      "-" + sanitizedFileName(fileName))).string();
+        auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            return fd;
+        }
+        if (errno != EEXIST) {
+            COMPLOG_ERROR("Error creating upload file by path: [", path, "] reason:", std::strerror(errno));
+            return -1;
+        }
+    }
+    COMPLOG_ERROR("Error creating upload file in:", directory);
+    return -1;
+}
+
+bool writeSpillFile(int fd, const char* data, std::size_t size)
+{
+    while (size > 0) {
+        auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+}
+
+struct ConnectionSession::UploadState
+{
+    const MultipartHandler&     handler;
+    MultipartParser             parser;
+    Packet                      request;
+    std::array<char, 64 * 1024> chunk;
+
+    int             spillFile {-1};
+    std::string     spillFilePath;
+    bool            isTooLarge {false};
+
+    UploadState(const MultipartHandler& uploadHandler, const std::string& boundary) :
+        handler {uploadHandler},
+        parser {boundary}
+    {
+
+    }
+
+    ~UploadState() {
+        // Недописанный файл прерванной загрузки не нужен
+        if (spillFile >= 0) {
+            ::close(spillFile);
+            std::error_code ec;
+            std::filesystem::remove(spillFilePath, ec);
+        }
+    }
+
+    bool beginPart(MultipartPart& part) {
+        if (handler.onPartBegin && !handler.onPartBegin(part)) {
+            return false;
+        }
+        if (part.fileName.empty() || handler.spillDirectory.empty()) {
+            return true;
+        }
+
+        spillFile = createSpillFile(handler.spillDirectory, part.fileName, spillFilePath);
+        if (spillFile < 0) {
+            return false;
+        }
+        part.savedFilePath = spillFilePath;
+        return true;
+    }
+
+    bool writePart(MultipartPart& part, const char* data, std::size_t size) {
+        if (spillFile >= 0 && !writeSpillFile(spillFile, data, size)) {
+            COMPLOG_ERROR("Error writing upload file:", spillFilePath, "reason:", std::strerror(errno));
+            return false;
+        }
+        if (handler.onPartData && !handler.onPartData(part, data, size)) {
+            return false;
+        }
+        if (spillFile >= 0 || handler.onPartData) {
+            return true;
+        }
+
+        if (part.body.size() + size > handler.maxFieldSize) {
+            isTooLarge = true;
+            return false;
+        }
+        part.body.append(data, size);
+        return true;
+    }
+
+    bool endPart(MultipartPart& part) {
+        if (spillFile >= 0) {
+            auto result = ::close(spillFile);
+            spillFile = -1;
+            if (result != 0) {
+                COMPLOG_ERROR("Error closing upload file:", spillFilePath, "reason:", std::strerror(errno));
+                return false;
+            }
+        }
+        if (handler.onPartEnd) {
+            handler.onPartEnd(std::move(part));
+        }
+        return true;
+    }
+};
+
 void ConnectionSession::checkDeadline() {
-    m_deadlineTimer->cancel();
+    m_deadlineTimer->expires_after(std::chrono::seconds(m_timeoutSec));
     m_deadlineTimer->async_wait( // pSelf = shared_from_this()
         [this, pSelf = shared_from_this()](beast::error_code ec) {
         if(!ec) {
@@ -67,15 +228,15 @@ ConnectionSession::ConnectionSession(const std::string &selfServerName,
     m_selfServerName {selfServerName},
     m_socket {beast::tcp_stream(std::move(sock))}
 {
-    const unsigned timeoutSec {10};
-
     if (ctx) {
-        m_socket.emplace<net::ssl::stream<tcp::socket> >(std::move(std::get<beast::tcp_stream>(m_socket).socket()), *ctx);
+        // emplace разрушает tcp_stream до создания ssl::stream: сокет забирается заранее
+        auto socket = std::move(std::get<beast::tcp_stream>(m_socket).socket());
+        m_socket.emplace<net::ssl::stream<tcp::socket> >(std::move(socket), *ctx);
         m_deadlineTimer = std::make_shared<net::steady_timer>(std::get<net::ssl::stream<tcp::socket> >(m_socket).get_executor(),
-                           std::chrono::seconds(timeoutSec));
+                           std::chrono::seconds(m_timeoutSec));
     } else {
         m_deadlineTimer = std::make_shared<net::steady_timer>(std::get<beast::tcp_stream>(m_socket).get_executor(),
-                           std::chrono::seconds(timeoutSec));
+                           std::chrono::seconds(m_timeoutSec));
     }
 }
 
@@ -94,15 +255,17 @@ void ConnectionSession::handleRequests() {
             return;
         }
     }
+    readRequest();
+}
 
-    auto readHandler = [pSelf = shared_from_this(), this]
-            (beast::error_code ec, std::size_t bytes_transferred) {
-        if (ec == beast::errc::not_connected ||
-                ec == net::error::eof ||
-                ec == net::error::connection_reset ||
-                ec == net::ssl::error::stream_truncated ||
-                ec == net::error::operation_aborted ||
-                ec.value() == 1) { // TODO: Разобраться чё за код
+void ConnectionSession::readRequest()
+{
+    // Сначала читается только заголовок: по нему решаем, читать тело целиком или потоково
+    m_headerParser.emplace();
+    m_headerParser->body_limit(std::numeric_limits<std::uint64_t>::max());
+    auto readHeaderHandler = [pSelf = shared_from_this(), this]
+            (beast::error_code ec, std::size_t) {
+        if (isSessionClosed(ec)) {
             return;
         }
 
@@ -112,45 +275,173 @@ void ConnectionSession::handleRequests() {
             return;
         }
 
-        Packet request;
-        request.target  = to_string(m_request.target());
-        request.body    = std::move(beast::buffers_to_string(m_request.body().data()));
-
-        if (m_request.count(http::field::content_type)) {
-            auto bodyType = to_string(m_request.at(http::field::content_type));
-            request.bodyType = request.fromString(bodyType);
+        const auto& header = m_headerParser->get();
+        if (m_uploadHandlers &&
+                (header.method() == http::verb::post || header.method() == http::verb::put) &&
+                header.count(http::field::content_type)) {
+            auto boundary = MultipartParser::boundaryFromContentType(to_string(header.at(http::field::content_type)));
+            auto uploadHandler = m_uploadHandlers->find(to_string(header.target()));
+            if (!boundary.empty() && uploadHandler != m_uploadHandlers->end()) {
+                startUpload(uploadHandler->second, boundary);
+                return;
+            }
         }
 
-        COMPLOG_INFO(this, "Request:", m_request.method_string(), request.target, "(", request.toString(request.bodyType), ")");
-
-        MethodType targetMethodType;
-        switch  (m_request.method())
-        {
-        case http::verb::get:       targetMethodType = MethodType::Get; break;
-        case http::verb::put:       targetMethodType = MethodType::Put; break;
-        case http::verb::post:      targetMethodType = MethodType::Post; break;
-        case http::verb::delete_:   targetMethodType = MethodType::Delete; break;
-
-        default: // От варнингов
-            break;
+        if (m_headerParser->content_length().value_or(0) > requestBodyLimit) {
+            COMPLOG_ERROR(this, "Read error:", beast::error_code(http::error::body_limit).message());
+            closeConnection();
+            return;
         }
+        m_requestParser.emplace(std::move(*m_headerParser));
+        m_requestParser->body_limit(requestBodyLimit);
+        std::visit([&](auto& sock){
+            http::async_read(sock, m_buffer, *m_requestParser,
+                [pSelf, this](beast::error_code ec, std::size_t) {
+                if (isSessionClosed(ec)) {
+                    return;
+                }
 
-        if (auto targetProcessor = m_processors.find(targetMethodType); targetProcessor != m_processors.end()) {
-            targetProcessor->second(std::move(request));
-        } else {
-            COMPLOG_WARNING(this, "Unknown method:", m_request.method_string());
-            sendErrorResponse(http::status::method_not_allowed, "Invalid method");
-        }
+                if(ec) {
+                    COMPLOG_ERROR(this, "Read error:", ec.message());
+                    closeConnection();
+                    return;
+                }
 
-        handleRequests();
+                m_request = m_requestParser->release();
+                processRequest();
+                readRequest();
+            });
+        }, m_socket);
     };
 
     std::visit([=](auto& sock){
-        http::async_read(sock, m_buffer, m_request, readHandler);
+        http::async_read_header(sock, m_buffer, *m_headerParser, readHeaderHandler);
     }, m_socket);
     checkDeadline();
 }
 
+void ConnectionSession::processRequest()
+{
+    Packet request;
+    request.target  = to_string(m_request.target());
+    request.body    = std::move(beast::buffers_to_string(m_request.body().data()));
+
+    if (m_request.count(http::field::content_type)) {
+        auto bodyType = to_string(m_request.at(http::field::content_type));
+        request.bodyType = request.fromString(bodyType);
+    }
+
+    COMPLOG_INFO(this, "Request:", m_request.method_string(), request.target, "(", request.toString(request.bodyType), ")");
+
+    MethodType targetMethodType;
+    switch  (m_request.method())
+    {
+    case http::verb::get:       targetMethodType = MethodType::Get; break;
+    case http::verb::put:       targetMethodType = MethodType::Put; break;
+    case http::verb::post:      targetMethodType = MethodType::Post; break;
+    case http::verb::delete_:   targetMethodType = MethodType::Delete; break;
+
+    default: // От варнингов
+        break;
+    }
+
+    if (auto targetProcessor = m_processors.find(targetMethodType); targetProcessor != m_processors.end()) {
+        targetProcessor->second(std::move(request));
+    } else {
+        COMPLOG_WARNING(this, "Unknown method:", m_request.method_string());
+        sendErrorResponse(http::status::method_not_allowed, "Invalid method");
+    }
+}
+
+void ConnectionSession::startUpload(const MultipartHandler &handler, const std::string &boundary)
+{
+    m_upload = std::make_unique<UploadState>(handler, boundary);
+    m_upload->request.target = to_string(m_headerParser->get().target());
+    COMPLOG_INFO(this, "Upload:", m_headerParser->get().method_string(), m_upload->request.target);
+
+    m_upload->parser.setPartBeginCallback([this](MultipartPart& part){
+        return m_upload->beginPart(part);
+    });
+    m_upload->parser.setPartDataCallback([this](MultipartPart& part, const char* data, std::size_t size){
+        return m_upload->writePart(part, data, size);
+    });
+    m_upload->parser.setPartEndCallback([this](MultipartPart& part){
+        return m_upload->endPart(part);
+    });
+
+    // Размер тела ограничивает только обработчик: в памяти держится не больше одного куска
+    m_uploadParser.emplace(std::move(*m_headerParser));
+    readUploadBody();
+}
+
+void ConnectionSession::readUploadBody()
+{
+    if (m_uploadParser->is_done()) {
+        finishUpload();
+        return;
+    }
+
+    auto& body = m_uploadParser->get().body();
+    body.data = m_upload->chunk.data();
+    body.size = m_upload->chunk.size();
+
+    std::visit([&](auto& sock){
+        http::async_read_some(sock, m_buffer, *m_uploadParser,
+            [pSelf = shared_from_this(), this](beast::error_code ec, std::size_t) {
+            if (ec == http::error::need_buffer) {
+                ec = {};
+            }
+            if (isSessionClosed(ec)) {
+                m_upload.reset();
+                return;
+            }
+            if (ec) {
+                abortUpload(http::status::bad_request, ec.message());
+                return;
+            }
+
+            auto receivedSize = m_upload->chunk.size() - m_uploadParser->get().body().size;
+            if (!m_upload->parser.feed(m_upload->chunk.data(), receivedSize)) {
+                abortUpload(m_upload->isTooLarge ? http::status::payload_too_large : http::status::bad_request,
+                            m_upload->parser.errorString());
+                return;
+            }
+            readUploadBody();
+        });
+    }, m_socket);
+    checkDeadline();
+}
+
+void ConnectionSession::finishUpload()
+{
+    if (!m_upload->parser.isDone()) {
+        abortUpload(http::status::bad_request, "Unexpected end of multipart body");
+        return;
+    }
+
+    COMPLOG_OK(this, "Upload finished:", m_upload->request.target);
+    auto upload = std::move(m_upload);
+    if (upload->handler.onComplete) {
+        upload->handler.onComplete(std::move(upload->request), [pSelf = shared_from_this()](Packet&& pkt){
+            pSelf->sendResponse(pkt, http::verb::post);
+        });
+    } else {
+        m_responseErrorPacket = createErrorPacket(static_cast<unsigned>(http::status::ok));
+        sendResponse(m_responseErrorPacket, http::verb::post);
+    }
+    readRequest();
+}
+
+void ConnectionSession::abortUpload(http::status status, const std::string &reason)
+{
+    COMPLOG_ERROR(this, "Upload aborted:", reason);
+    m_upload.reset();
+
+    // Остаток тела не вычитан, поэтому после ответа соединение закрывается
+    m_deadlineTimer->cancel();
+    sendErrorResponse(status, reason);
+}
+
 void ConnectionSession::sendResponse(const Packet &pkt, http::verb method) {
 
     COMPLOG_INFO(this, "Sending response with status", pkt.statusCode);
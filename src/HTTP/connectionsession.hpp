@@ -6,6 +6,8 @@
 #include <boost/asio/ssl.hpp>
 
 #include <map>
+#include <optional>
+#include <unordered_map>
 #include <variant>
 
 #include "httptypes.hpp"
@@ -33,6 +35,7 @@ public:
     bool isConnected() const;
 
     std::map<MethodType, RequestProcessor> m_processors;
+    const std::unordered_map<std::string, MultipartHandler>* m_uploadHandlers {nullptr};
 
 private:
     std::variant<beast::tcp_stream, net::ssl::stream<tcp::socket> > m_socket;
@@ -40,6 +43,13 @@ private:
 
     beast::flat_buffer                  m_buffer {32768};
     http::request<http::dynamic_body>   m_request;
+
+    std::optional<http::request_parser<http::empty_body> >      m_headerParser;
+    std::optional<http::request_parser<http::dynamic_body> >    m_requestParser;
+    std::optional<http::request_parser<http::buffer_body> >     m_uploadParser;
+
+    struct UploadState;
+    std::unique_ptr<UploadState> m_upload;
     std::variant<
         http::response<http::dynamic_body>,
         http::response<http::file_body> >   m_response;
@@ -47,9 +57,18 @@ private:
 
     std::string m_selfServerName {"Unknown server"};
     std::shared_ptr<net::steady_timer> m_deadlineTimer;
+    const unsigned m_timeoutSec {10};
 
     void checkDeadline();
     void closeConnection();
+
+    void readRequest();
+    void processRequest();
+
+    void startUpload(const MultipartHandler& handler, const std::string& boundary);
+    void readUploadBody();
+    void finishUpload();
+    void abortUpload(http::status status, const std::string& reason);
 };
 
 }
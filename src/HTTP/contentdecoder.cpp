@@ -0,0 +1,188 @@
+#include "contentdecoder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+#ifdef COMPONENTS_NETWORK_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef COMPONENTS_NETWORK_ZSTD
+#include <zstd.h>
+#endif
+
+namespace HTTP
+{
+
+namespace
+{
+
+// Шаг роста распакованного тела
+const std::size_t outputChunkSize {64 * 1024};
+
+std::string trimmedLower(std::string_view value)
+{
+    auto begin = value.find_first_not_of(" \t");
+    auto end = value.find_last_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+
+    std::string result(value.substr(begin, end - begin + 1));
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c){ return std::tolower(c); });
+    return result;
+}
+
+#ifdef COMPONENTS_NETWORK_ZLIB
+// windowBits: 15 + 32 -- zlib или gzip с определением по заголовку, -15 -- deflate без обёртки
+bool inflateBody(const std::string& input, std::string& output, std::size_t maxSize, int windowBits)
+{
+    z_stream stream {};
+    if (inflateInit2(&stream, windowBits) != Z_OK) {
+        return false;
+    }
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+
+    output.clear();
+    int result {Z_OK};
+    while (result == Z_OK) {
+        if (output.size() >= maxSize) {
+            break;
+        }
+        auto offset = output.size();
+        output.resize(std::min(offset + outputChunkSize, maxSize));
+        stream.next_out = reinterpret_cast<Bytef*>(output.data() + offset);
+        stream.avail_out = static_cast<uInt>(output.size() - offset);
+
+        result = inflate(&stream, Z_NO_FLUSH);
+        output.resize(output.size() - stream.avail_out);
+        if (result == Z_BUF_ERROR && stream.avail_in == 0) {
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    return (result == Z_STREAM_END);
+}
+#endif
+
+#ifdef COMPONENTS_NETWORK_ZSTD
+bool decompressZstd(const std::string& input, std::string& output, std::size_t maxSize)
+{
+    auto stream = ZSTD_createDStream();
+    if (!stream) {
+        return false;
+    }
+
+    // Тело может состоять из нескольких кадров: читаем до конца входных данных и конца кадра
+    ZSTD_inBuffer inBuffer {input.data(), input.size(), 0};
+    output.clear();
+    std::size_t result {0};
+    bool isFailed {false};
+    while (inBuffer.pos < inBuffer.size || result != 0) {
+        if (output.size() >= maxSize) {
+            isFailed = true;
+            break;
+        }
+        auto offset = output.size();
+        output.resize(std::min(offset + outputChunkSize, maxSize));
+        ZSTD_outBuffer outBuffer {output.data() + offset, output.size() - offset, 0};
+
+        result = ZSTD_decompressStream(stream, &outBuffer, &inBuffer);
+        output.resize(offset + outBuffer.pos);
+
+        // Входные данные кончились посреди кадра
+        auto isTruncated = (inBuffer.pos == inBuffer.size && outBuffer.pos < outBuffer.size && result != 0);
+        if (ZSTD_isError(result) || isTruncated) {
+            isFailed = true;
+            break;
+        }
+    }
+    ZSTD_freeDStream(stream);
+    return !isFailed;
+}
+#endif
+
+bool decodeOne(const std::string& encoding, [[maybe_unused]] std::string& body, [[maybe_unused]] std::size_t maxSize)
+{
+    if (encoding.empty() || encoding == "identity") {
+        return true;
+    }
+
+#ifdef COMPONENTS_NETWORK_ZLIB
+    if (encoding == "gzip" || encoding == "x-gzip") {
+        std::string output;
+        if (!inflateBody(body, output, maxSize, 15 + 32)) {
+            return false;
+        }
+        body = std::move(output);
+        return true;
+    }
+
+    // deflate по RFC -- поток zlib, но часть серверов отправляет его без обёртки
+    if (encoding == "deflate") {
+        std::string output;
+        if (!inflateBody(body, output, maxSize, 15 + 32) && !inflateBody(body, output, maxSize, -15)) {
+            return false;
+        }
+        body = std::move(output);
+        return true;
+    }
+#endif
+
+#ifdef COMPONENTS_NETWORK_ZSTD
+    if (encoding == "zstd") {
+        std::string output;
+        if (!decompressZstd(body, output, maxSize)) {
+            return false;
+        }
+        body = std::move(output);
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+}
+
+const std::string &ContentDecoder::acceptEncoding()
+{
+    static const std::string encodings = [](){
+        std::vector<std::string> supported;
+#ifdef COMPONENTS_NETWORK_ZSTD
+        supported.push_back("zstd");
+#endif
+#ifdef COMPONENTS_NETWORK_ZLIB
+        supported.push_back("gzip");
+        supported.push_back("deflate");
+#endif
+        std::string result;
+        for (const auto& encoding : supported) {
+            result += (result.empty() ? "" : ", ") + encoding;
+        }
+        return result;
+    }();
+    return encodings;
+}
+
+bool ContentDecoder::decode(std::string_view contentEncoding, std::string &body, std::size_t maxSize)
+{
+    std::vector<std::string> encodings;
+    while (!contentEncoding.empty()) {
+        auto separator = std::min(contentEncoding.find(','), contentEncoding.size());
+        encodings.push_back(trimmedLower(contentEncoding.substr(0, separator)));
+        contentEncoding.remove_prefix(std::min(separator + 1, contentEncoding.size()));
+    }
+
+    for (auto encoding = encodings.rbegin(); encoding != encodings.rend(); ++encoding) {
+        if (!decodeOne(*encoding, body, maxSize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace HTTP
+{
+
+/**
+ * @brief The ContentDecoder class Распаковка тела ответа по Content-Encoding.
+ *        gzip и deflate доступны при сборке с zlib, zstd -- при сборке с libzstd
+ */
+class ContentDecoder
+{
+public:
+    /**
+     * @brief acceptEncoding    Значение Accept-Encoding со всеми поддержанными кодировками. Пусто, если их нет
+     */
+    static const std::string& acceptEncoding();
+
+    /**
+     * @brief decode            Распаковать тело. Кодировки из списка Content-Encoding снимаются в обратном порядке
+     * @param contentEncoding   Значение Content-Encoding
+     * @param body              Тело ответа, заменяется распакованным
+     * @param maxSize           Наибольший размер распакованного тела
+     * @return                  false, если кодировка не поддерживается, данные повреждены или превышен maxSize
+     */
+    static bool decode(std::string_view contentEncoding, std::string& body, std::size_t maxSize);
+};
+
+}
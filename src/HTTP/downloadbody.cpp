@@ -0,0 +1,125 @@
+#include "downloadbody.hpp"
+
+#include <charconv>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace HTTP
+{
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+namespace
+{
+
+beast::error_code lastSystemError()
+{
+    return beast::error_code(errno, boost::system::system_category());
+}
+
+}
+
+DownloadBody::File::~File()
+{
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+void DownloadBody::File::open(const std::string &path, bool isTruncate, beast::error_code &ec)
+{
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (isTruncate ? O_TRUNC : 0), 0644);
+    ec = (m_fd == -1 ? lastSystemError() : beast::error_code{});
+}
+
+void DownloadBody::File::preallocate(std::uint64_t size, beast::error_code &ec)
+{
+    // posix_fallocate не выставляет errno, а возвращает код ошибки
+    auto result = ::posix_fallocate(m_fd, 0, static_cast<off_t>(size));
+    if (result == EOPNOTSUPP || result == EINVAL) {
+        truncate(size, ec);
+        return;
+    }
+    ec = (result != 0 ? beast::error_code(result, boost::system::system_category()) : beast::error_code{});
+}
+
+void DownloadBody::File::truncate(std::uint64_t size, beast::error_code &ec)
+{
+    ec = (::ftruncate(m_fd, static_cast<off_t>(size)) != 0 ? lastSystemError() : beast::error_code{});
+}
+
+void DownloadBody::File::write(std::uint64_t offset, const void *data, std::size_t size, beast::error_code &ec)
+{
+    // pwrite: диапазоны пишутся в один файл из разных соединений без общей позиции
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        auto writtenSize = ::pwrite(m_fd, bytes, size, static_cast<off_t>(offset));
+        if (writtenSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ec = lastSystemError();
+            return;
+        }
+        bytes += writtenSize;
+        offset += static_cast<std::uint64_t>(writtenSize);
+        size -= static_cast<std::size_t>(writtenSize);
+    }
+    ec = {};
+}
+
+std::uint64_t DownloadBody::File::size(beast::error_code &ec) const
+{
+    struct stat fileStat {};
+    if (::fstat(m_fd, &fileStat) != 0) {
+        ec = lastSystemError();
+        return 0;
+    }
+    ec = {};
+    return static_cast<std::uint64_t>(fileStat.st_size);
+}
+
+void DownloadBody::reader::init(const boost::optional<std::uint64_t> &, beast::error_code &ec)
+{
+    ec = {};
+    m_body.writtenSize = 0;
+
+    if (m_status() == http::status::partial_content) {
+        // Content-Range: bytes first-last/size
+        auto contentRange = m_contentRange();
+        const std::string unit {"bytes "};
+        std::uint64_t first {0};
+        if (contentRange.compare(0, unit.size(), unit) != 0 ||
+            std::from_chars(contentRange.data() + unit.size(), contentRange.data() + contentRange.size(), first).ec != std::errc() ||
+            first != m_body.offset) {
+            ec = http::error::bad_value;
+            return;
+        }
+        m_position = first;
+        return;
+    }
+
+    if (m_status() == http::status::ok) {
+        if (!m_body.isFullResponseAccepted) {
+            ec = http::error::bad_value;
+            return;
+        }
+
+        // Сервер не поддерживает диапазоны и прислал файл целиком
+        m_body.file->truncate(0, ec);
+        m_body.offset = 0;
+        m_position = 0;
+        return;
+    }
+    m_isDiscarding = true;
+}
+
+void DownloadBody::reader::finish(beast::error_code &ec)
+{
+    ec = {};
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace HTTP
+{
+
+/**
+ * @brief The DownloadBody struct Тело ответа, которое пишется прямо в файл по мере приёма.
+ *        Ответ 206 пишется с позиции из Content-Range, поэтому в один файл можно
+ *        параллельно принимать несколько диапазонов. Ответы с другим статусом в файл не пишутся
+ */
+struct DownloadBody
+{
+    /**
+     * @brief The File class Файл загрузки, общий для всех диапазонов
+     */
+    class File
+    {
+    public:
+        File() = default;
+        ~File();
+
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        /**
+         * @brief open      Открыть или создать файл на запись
+         * @param path
+         * @param isTruncate Очистить существующий файл
+         * @param ec
+         */
+        void open(const std::string& path, bool isTruncate, boost::beast::error_code& ec);
+
+        /**
+         * @brief preallocate Выделить место под файл заранее, чтобы диапазоны не фрагментировали его
+         * @param size
+         * @param ec
+         */
+        void preallocate(std::uint64_t size, boost::beast::error_code& ec);
+
+        void truncate(std::uint64_t size, boost::beast::error_code& ec);
+        void write(std::uint64_t offset, const void* data, std::size_t size, boost::beast::error_code& ec);
+        std::uint64_t size(boost::beast::error_code& ec) const;
+
+    private:
+        int m_fd {-1};
+    };
+
+    struct value_type
+    {
+        std::shared_ptr<File> file;
+
+        std::uint64_t   offset {0};                     // Ожидаемое начало диапазона в файле
+        bool            isFullResponseAccepted {true};  // Принять 200 OK (весь файл) вместо 206: файл пишется с начала
+        std::uint64_t   writtenSize {0};
+    };
+
+    class reader
+    {
+    public:
+        // Заголовок к моменту создания ещё не разобран, он читается в init()
+        template <bool isRequest, typename Fields>
+        reader(boost::beast::http::header<isRequest, Fields>& header, value_type& body) :
+            m_body {body} {
+            static_assert(!isRequest, "DownloadBody is a response body");
+            m_status = [&header](){ return header.result(); };
+            m_contentRange = [&header](){ return std::string(header[boost::beast::http::field::content_range]); };
+        }
+
+        void init(const boost::optional<std::uint64_t>& contentLength, boost::beast::error_code& ec);
+
+        template <typename ConstBufferSequence>
+        std::size_t put(const ConstBufferSequence& buffers, boost::beast::error_code& ec) {
+            ec = {};
+            std::size_t putSize {0};
+            for (auto buffer : boost::beast::buffers_range_ref(buffers)) {
+                if (!m_isDiscarding) {
+                    m_body.file->write(m_position, buffer.data(), buffer.size(), ec);
+                    if (ec) {
+                        return putSize;
+                    }
+                    m_position += buffer.size();
+                    m_body.writtenSize += buffer.size();
+                }
+                putSize += buffer.size();
+            }
+            return putSize;
+        }
+
+        void finish(boost::beast::error_code& ec);
+
+    private:
+        value_type& m_body;
+        std::function<boost::beast::http::status()> m_status;
+        std::function<std::string()> m_contentRange;
+
+        std::uint64_t   m_position {0};
+        bool            m_isDiscarding {false};
+    };
+};
+
+}
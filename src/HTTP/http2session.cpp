@@ -0,0 +1,351 @@
+#include "http2session.hpp"
+
+#include <cstring>
+
+#include <nghttp2/nghttp2.h>
+
+namespace HTTP
+{
+
+namespace
+{
+
+// Окна управления потоком: по умолчанию в HTTP/2 это 64 КиБ, чего мало для быстрых ответов
+const uint32_t streamWindowSize {1024 * 1024};
+const int32_t connectionWindowSize {16 * 1024 * 1024};
+
+const std::size_t maxWriteChunkSize {64 * 1024};
+
+beast::error_code protocolError()
+{
+    return beast::error_code(boost::system::errc::protocol_error, boost::system::generic_category());
+}
+
+}
+
+struct Http2Session::Callbacks
+{
+    static int onHeader(nghttp2_session* session, const nghttp2_frame* frame,
+                        const uint8_t* name, size_t nameLength,
+                        const uint8_t* value, size_t valueLength,
+                        uint8_t, void*) {
+        if (frame->hd.type != NGHTTP2_HEADERS) {
+            return 0;
+        }
+
+        auto stream = static_cast<Stream*>(nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (stream && stream->handler.onHeader) {
+            stream->handler.onHeader(std::string(reinterpret_cast<const char*>(name), nameLength),
+                                     std::string(reinterpret_cast<const char*>(value), valueLength));
+        }
+        return 0;
+    }
+
+    static int onDataChunk(nghttp2_session* session, uint8_t, int32_t streamId,
+                           const uint8_t* data, size_t length, void*) {
+        auto stream = static_cast<Stream*>(nghttp2_session_get_stream_user_data(session, streamId));
+        if (!stream || stream->error) {
+            return 0;
+        }
+
+        if (stream->handler.onData && !stream->handler.onData(data, length)) {
+            stream->error = http::error::body_limit;
+            nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, streamId, NGHTTP2_CANCEL);
+        }
+        return 0;
+    }
+
+    static int onFrameReceived(nghttp2_session*, const nghttp2_frame* frame, void* userData) {
+        if (frame->hd.type == NGHTTP2_GOAWAY) {
+            static_cast<Http2Session*>(userData)->m_isClosed = true;
+        }
+        return 0;
+    }
+
+    static int onStreamClose(nghttp2_session*, int32_t streamId, uint32_t errorCode, void* userData) {
+        auto pSession = static_cast<Http2Session*>(userData);
+
+        beast::error_code ec;
+        if (errorCode == NGHTTP2_REFUSED_STREAM) {
+            // Сервер не начинал обрабатывать поток (GOAWAY, лимит потоков): запрос можно повторить
+            ec = net::error::try_again;
+        } else if (errorCode != NGHTTP2_NO_ERROR) {
+            ec = protocolError();
+        }
+        pSession->closeStream(streamId, ec);
+        return 0;
+    }
+
+    static ssize_t readBody(nghttp2_session*, int32_t, uint8_t* buffer, size_t length,
+                            uint32_t* dataFlags, nghttp2_data_source* source, void*) {
+        auto stream = static_cast<Stream*>(source->ptr);
+
+        bool isEof {false};
+        beast::error_code ec;
+        auto readSize = stream->handler.readBody(buffer, length, isEof, ec);
+        if (ec) {
+            stream->error = ec;
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+        if (isEof) {
+            *dataFlags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        return static_cast<ssize_t>(readSize);
+    }
+};
+
+Http2Session::Http2Session(const std::shared_ptr<ClientConnection> &conn) :
+    m_conn {conn}
+{
+    nghttp2_session_callbacks* callbacks {nullptr};
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &Callbacks::onHeader);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &Callbacks::onDataChunk);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Callbacks::onFrameReceived);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Callbacks::onStreamClose);
+    nghttp2_session_client_new(&m_session, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+
+    nghttp2_settings_entry settings[] = {
+        {NGHTTP2_SETTINGS_ENABLE_PUSH, 0},
+        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, streamWindowSize}
+    };
+    nghttp2_submit_settings(m_session, NGHTTP2_FLAG_NONE, settings, std::size(settings));
+    nghttp2_session_set_local_window_size(m_session, NGHTTP2_FLAG_NONE, 0, connectionWindowSize);
+}
+
+Http2Session::~Http2Session()
+{
+    nghttp2_session_del(m_session);
+}
+
+const std::shared_ptr<ClientConnection> &Http2Session::connection() const
+{
+    return m_conn;
+}
+
+void Http2Session::start()
+{
+    net::dispatch(m_conn->executor(), [pSelf = shared_from_this()](){
+        if (pSelf->m_isTerminated) {
+            return;
+        }
+        pSelf->m_isStarted = true;
+        pSelf->flush();
+        pSelf->readNext();
+
+        auto waiters = std::move(pSelf->m_startWaiters);
+        pSelf->m_startWaiters.clear();
+        for (auto& waiter : waiters) {
+            waiter({});
+        }
+    });
+}
+
+void Http2Session::fail(beast::error_code ec)
+{
+    net::dispatch(m_conn->executor(), [pSelf = shared_from_this(), ec](){
+        pSelf->terminate(ec);
+    });
+}
+
+void Http2Session::whenStarted(std::function<void (beast::error_code)> &&cbk)
+{
+    net::post(m_conn->executor(), [pSelf = shared_from_this(), cbk = std::move(cbk)]() mutable {
+        if (pSelf->m_isTerminated) {
+            cbk(pSelf->m_terminateError);
+        } else if (pSelf->m_isStarted) {
+            cbk({});
+        } else {
+            pSelf->m_startWaiters.push_back(std::move(cbk));
+        }
+    });
+}
+
+std::uint64_t Http2Session::submit(HeaderList &&headers, StreamHandler &&handler)
+{
+    // Всегда через очередь: submit может прийти из колбека завершения потока внутри nghttp2
+    auto requestId = ++m_lastRequestId;
+    net::post(m_conn->executor(),
+        [pSelf = shared_from_this(), requestId, headers = std::move(headers), handler = std::move(handler)]() mutable {
+        pSelf->submitStream(requestId, std::move(headers), std::move(handler));
+    });
+    return requestId;
+}
+
+void Http2Session::cancel(std::uint64_t requestId)
+{
+    // После submit в той же очереди: поток к этому моменту уже создан или завершён
+    net::post(m_conn->executor(), [pSelf = shared_from_this(), requestId](){
+        pSelf->cancelStream(requestId);
+    });
+}
+
+bool Http2Session::isClosed() const
+{
+    return m_isClosed;
+}
+
+void Http2Session::submitStream(std::uint64_t requestId, HeaderList &&headers, StreamHandler &&handler)
+{
+    if (m_isTerminated) {
+        handler.onClose(net::error::try_again);
+        return;
+    }
+
+    std::vector<nghttp2_nv> nameValues;
+    nameValues.reserve(headers.size());
+    for (auto& [name, value] : headers) {
+        nameValues.push_back(nghttp2_nv{
+            reinterpret_cast<uint8_t*>(name.data()), reinterpret_cast<uint8_t*>(value.data()),
+            name.size(), value.size(), NGHTTP2_NV_FLAG_NONE});
+    }
+
+    auto stream = std::make_unique<Stream>();
+    stream->handler = std::move(handler);
+    stream->requestId = requestId;
+
+    nghttp2_data_provider bodyProvider;
+    bodyProvider.source.ptr = stream.get();
+    bodyProvider.read_callback = &Callbacks::readBody;
+
+    auto streamId = nghttp2_submit_request(m_session, nullptr, nameValues.data(), nameValues.size(),
+                                           stream->handler.readBody ? &bodyProvider : nullptr, stream.get());
+    if (streamId < 0) {
+        // Кончились идентификаторы потоков или сервер прислал GOAWAY: запрос пойдёт в новую сессию
+        m_isClosed = true;
+        stream->handler.onClose(streamId == NGHTTP2_ERR_STREAM_ID_NOT_AVAILABLE ||
+                                streamId == NGHTTP2_ERR_START_STREAM_NOT_ALLOWED ? net::error::try_again : protocolError());
+        return;
+    }
+    m_streams.emplace(streamId, std::move(stream));
+    m_requestStreams.emplace(requestId, streamId);
+    flush();
+}
+
+void Http2Session::cancelStream(std::uint64_t requestId)
+{
+    auto requestIt = m_requestStreams.find(requestId);
+    if (m_isTerminated || requestIt == m_requestStreams.end()) {
+        return;
+    }
+
+    auto& stream = m_streams.at(requestIt->second);
+    if (!stream->error) {
+        stream->error = net::error::operation_aborted;
+    }
+    nghttp2_submit_rst_stream(m_session, NGHTTP2_FLAG_NONE, requestIt->second, NGHTTP2_CANCEL);
+    flush();
+}
+
+void Http2Session::closeStream(int32_t streamId, beast::error_code ec)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end()) {
+        return;
+    }
+    auto stream = std::move(streamIt->second);
+    m_streams.erase(streamIt);
+    m_requestStreams.erase(stream->requestId);
+
+    stream->handler.onClose(stream->error ? stream->error : ec);
+}
+
+void Http2Session::readNext()
+{
+    m_conn->visit([&](auto& stream){
+        stream.async_read_some(net::buffer(m_readBuffer),
+            [pSelf = shared_from_this()](beast::error_code ec, std::size_t readSize) {
+            if (pSelf->m_isTerminated) {
+                return;
+            }
+            if (ec) {
+                pSelf->terminate(ec);
+                return;
+            }
+
+            auto processed = nghttp2_session_mem_recv(pSelf->m_session, pSelf->m_readBuffer.data(), readSize);
+            if (processed < 0) {
+                pSelf->terminate(protocolError());
+                return;
+            }
+            pSelf->flush();
+
+            if (!pSelf->m_isTerminated) {
+                pSelf->readNext();
+            }
+        });
+    });
+}
+
+void Http2Session::flush()
+{
+    if (!m_isStarted || m_isWriting || m_isTerminated) {
+        return;
+    }
+
+    m_writeBuffer.clear();
+    while (m_writeBuffer.size() < maxWriteChunkSize) {
+        const uint8_t* data {nullptr};
+        auto dataSize = nghttp2_session_mem_send(m_session, &data);
+        if (dataSize < 0) {
+            terminate(protocolError());
+            return;
+        }
+        if (dataSize == 0) {
+            break;
+        }
+        m_writeBuffer.insert(m_writeBuffer.end(), data, data + dataSize);
+    }
+
+    if (m_writeBuffer.empty()) {
+        // После GOAWAY и завершения всех потоков сессии больше нечего делать
+        if (!nghttp2_session_want_read(m_session) && !nghttp2_session_want_write(m_session)) {
+            terminate(net::error::eof);
+        }
+        return;
+    }
+
+    m_isWriting = true;
+    m_conn->visit([&](auto& stream){
+        net::async_write(stream, net::buffer(m_writeBuffer),
+            [pSelf = shared_from_this()](beast::error_code ec, std::size_t) {
+            pSelf->m_isWriting = false;
+            if (pSelf->m_isTerminated) {
+                return;
+            }
+            if (ec) {
+                pSelf->terminate(ec);
+                return;
+            }
+            pSelf->flush();
+        });
+    });
+}
+
+void Http2Session::terminate(beast::error_code ec)
+{
+    if (m_isTerminated) {
+        return;
+    }
+    m_isTerminated = true;
+    m_isClosed = true;
+    m_terminateError = ec;
+
+    auto streams = std::move(m_streams);
+    m_streams.clear();
+    m_requestStreams.clear();
+    for (auto& [streamId, stream] : streams) {
+        stream->handler.onClose(stream->error ? stream->error : ec);
+    }
+
+    auto waiters = std::move(m_startWaiters);
+    m_startWaiters.clear();
+    for (auto& waiter : waiters) {
+        waiter(ec);
+    }
+    m_conn->close();
+}
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <unordered_map>
+
+#include "clientconnection.hpp"
+
+struct nghttp2_session;
+
+namespace HTTP
+{
+
+/**
+ * @brief The Http2Session class Клиентская HTTP/2 сессия (nghttp2) поверх одного соединения.
+ *        Запросы идут в нём независимыми потоками (streams) с управлением потоком данных.
+ *        Все обращения к nghttp2 выполняются в strand соединения
+ */
+class Http2Session : public std::enable_shared_from_this<Http2Session>
+{
+public:
+    using HeaderList = std::vector<std::pair<std::string, std::string> >;
+
+    /**
+     * @brief The StreamHandler struct Обработчики одного потока
+     */
+    struct StreamHandler
+    {
+        std::function<void(const std::string& name, const std::string& value)> onHeader;
+
+        // false -- прервать поток
+        std::function<bool(const uint8_t* data, std::size_t size)> onData;
+        std::function<void(beast::error_code)> onClose;
+
+        // Чтение тела запроса, пустой если тела нет
+        std::function<std::size_t(uint8_t* data, std::size_t size, bool& isEof, beast::error_code& ec)> readBody;
+    };
+
+    explicit Http2Session(const std::shared_ptr<ClientConnection>& conn);
+    ~Http2Session();
+
+    const std::shared_ptr<ClientConnection>& connection() const;
+
+    /**
+     * @brief start Начать обмен после подключения. До этого запросы копятся в сессии
+     */
+    void start();
+
+    /**
+     * @brief fail  Завершить сессию: все потоки завершаются с ошибкой ec
+     * @param ec
+     */
+    void fail(beast::error_code ec);
+
+    /**
+     * @brief whenStarted   Вызвать cbk, когда сессия начнёт обмен (сразу, если уже начала).
+     *                      Если сессия завершится раньше, cbk получит ошибку завершения
+     * @param cbk
+     */
+    void whenStarted(std::function<void(beast::error_code)>&& cbk);
+
+    /**
+     * @brief submit    Отправить запрос новым потоком
+     * @param headers   Заголовки, начиная с псевдозаголовков :method, :scheme, :authority, :path
+     * @param handler
+     * @return          Номер запроса для отмены
+     */
+    std::uint64_t submit(HeaderList&& headers, StreamHandler&& handler);
+
+    /**
+     * @brief cancel    Отменить запрос: поток сбрасывается (RST_STREAM), onClose вызывается с operation_aborted
+     * @param requestId Номер, возвращённый submit
+     */
+    void cancel(std::uint64_t requestId);
+
+    /**
+     * @brief isClosed  Сессия закрыта или сервер прислал GOAWAY: новые запросы нужно отправлять в другую
+     */
+    bool isClosed() const;
+
+private:
+    struct Callbacks;
+    struct Stream
+    {
+        StreamHandler       handler;
+        beast::error_code   error;
+        std::uint64_t       requestId {0};
+    };
+
+    std::shared_ptr<ClientConnection> m_conn;
+    nghttp2_session* m_session {nullptr};
+
+    std::unordered_map<int32_t, std::unique_ptr<Stream> > m_streams;
+    std::unordered_map<std::uint64_t, int32_t> m_requestStreams;
+    std::atomic<std::uint64_t> m_lastRequestId {0};
+
+    std::atomic<bool>       m_isClosed {false};
+    bool                    m_isTerminated {false};
+    bool                    m_isStarted {false};
+    bool                    m_isWriting {false};
+    std::vector<uint8_t>    m_writeBuffer;
+    beast::error_code       m_terminateError;
+    std::vector<std::function<void(beast::error_code)> > m_startWaiters;
+    std::array<uint8_t, 16 * 1024> m_readBuffer;
+
+    void submitStream(std::uint64_t requestId, HeaderList&& headers, StreamHandler&& handler);
+    void cancelStream(std::uint64_t requestId);
+    void closeStream(int32_t streamId, beast::error_code ec);
+    void readNext();
+    void flush();
+    void terminate(beast::error_code ec);
+};
+
+}
@@ -2,6 +2,9 @@
 
 #include <boost/beast.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 namespace HTTP
 {
 
@@ -40,6 +43,61 @@ std::string toString(MethodType meth) {
     return "";
 }
 
+void TimingHistogram::add(std::chrono::microseconds duration)
+{
+    auto value = static_cast<std::uint64_t>(std::max<std::chrono::microseconds::rep>(duration.count(), 0));
+    std::size_t bucket {0};
+    while (bucket + 1 < bucketCount && value >= (std::uint64_t(1) << bucket)) {
+        ++bucket;
+    }
+    ++counts[bucket];
+    ++count;
+    sum += duration;
+    max = std::max(max, duration);
+}
+
+std::chrono::microseconds TimingHistogram::mean() const
+{
+    if (count == 0) {
+        return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(sum.count() / static_cast<std::chrono::microseconds::rep>(count));
+}
+
+std::chrono::microseconds TimingHistogram::percentile(double percent) const
+{
+    if (count == 0) {
+        return std::chrono::microseconds(0);
+    }
+
+    auto rank = static_cast<std::uint64_t>(std::ceil(count * std::clamp(percent, 0.0, 100.0) / 100.0));
+    rank = std::max<std::uint64_t>(rank, 1);
+    std::uint64_t seenCount {0};
+    for (std::size_t bucket = 0; bucket + 1 < bucketCount; ++bucket) {
+        seenCount += counts[bucket];
+        if (seenCount >= rank) {
+            return std::min(max, std::chrono::microseconds(std::int64_t(1) << bucket));
+        }
+    }
+    return max;
+}
+
+void HostTimingStats::add(const RequestTiming &timing)
+{
+    ++requestCount;
+    if (timing.isConnectionReused) {
+        ++reusedConnectionCount;
+    } else {
+        dns.add(timing.dns);
+        connect.add(timing.connect);
+        tlsHandshake.add(timing.tlsHandshake);
+    }
+    requestWrite.add(timing.requestWrite);
+    timeToFirstByte.add(timing.timeToFirstByte);
+    bodyTransfer.add(timing.bodyTransfer);
+    total.add(timing.total);
+}
+
 Packet createErrorPacket(unsigned status)
 {
     Packet res;
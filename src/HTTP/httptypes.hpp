@@ -1,7 +1,11 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <map>
 
 namespace HTTP
 {
@@ -15,6 +19,66 @@ enum MethodType : int {
 
 std::string toString(MethodType meth);
 
+/**
+ * @brief The RequestTiming struct Время этапов запроса клиента. Этапы, которых не было, равны 0:
+ *        у переиспользованного соединения нет DNS, подключения и TLS. В HTTP/2 отправка запроса
+ *        идёт вперемешку с другими потоками и входит в timeToFirstByte
+ */
+struct RequestTiming
+{
+    std::chrono::microseconds dns {0};
+    std::chrono::microseconds connect {0};          // TCP, включая параллельные попытки к разным адресам
+    std::chrono::microseconds tlsHandshake {0};
+    std::chrono::microseconds requestWrite {0};     // Отправка заголовков и тела
+    std::chrono::microseconds timeToFirstByte {0};  // От конца отправки до заголовков ответа: обработка на сервере и сеть
+    std::chrono::microseconds bodyTransfer {0};     // Приём тела ответа
+    std::chrono::microseconds total {0};            // Вся попытка, включая ожидание соединения из пула
+    bool isConnectionReused {false};
+};
+
+/**
+ * @brief The TimingHistogram struct Распределение длительностей по корзинам: в корзину i попадают
+ *        длительности меньше 2^i мкс, в последнюю -- все остальные
+ */
+struct TimingHistogram
+{
+    static constexpr std::size_t bucketCount {28};
+
+    std::array<std::uint64_t, bucketCount> counts {};
+    std::uint64_t count {0};
+    std::chrono::microseconds sum {0};
+    std::chrono::microseconds max {0};
+
+    void add(std::chrono::microseconds duration);
+    std::chrono::microseconds mean() const;
+
+    /**
+     * @brief percentile    Оценка перцентиля сверху: граница корзины, в которую он попал, но не больше max
+     * @param percent       От 0 до 100
+     */
+    std::chrono::microseconds percentile(double percent) const;
+};
+
+/**
+ * @brief The HostTimingStats struct Время этапов успешных запросов к хосту.
+ *        DNS, подключение и TLS учитываются только для запросов на новых соединениях
+ */
+struct HostTimingStats
+{
+    std::uint64_t   requestCount {0};
+    std::uint64_t   reusedConnectionCount {0};
+
+    TimingHistogram dns;
+    TimingHistogram connect;
+    TimingHistogram tlsHandshake;
+    TimingHistogram requestWrite;
+    TimingHistogram timeToFirstByte;
+    TimingHistogram bodyTransfer;
+    TimingHistogram total;
+
+    void add(const RequestTiming& timing);
+};
+
 struct Packet
 {
 
@@ -36,12 +100,92 @@ struct Packet
 
     std::string     body;
     unsigned int    statusCode {0};
+
+    RequestTiming   timing;     // Заполняется в ответах клиента. У ответа из кеша без запроса все этапы равны 0
 };
 Packet createErrorPacket(unsigned status);
 
 using RequestProcessor = std::function<void(Packet&&)>;
 using TargetProcessor = std::function<void(Packet&&, const RequestProcessor&)>;
 
+/**
+ * @brief The MultipartPart struct Часть тела multipart/form-data
+ */
+struct MultipartPart
+{
+    std::string name;
+    std::string fileName;       // Пусто для обычных полей формы
+    std::string contentType {"text/plain"};
+    std::map<std::string, std::string> headers; // Имена заголовков в нижнем регистре
+
+    std::string body;           // Содержимое части, если она не сброшена на диск и не забрана через onPartData
+    std::string savedFilePath;  // Путь к файлу, если часть сброшена на диск
+    std::size_t size {0};
+};
+
+/**
+ * @brief The MultipartHandler struct Обработчик потоковой загрузки multipart/form-data.
+ *        Колбеки onPartBegin и onPartData могут вернуть false для прерывания загрузки
+ */
+struct MultipartHandler
+{
+    std::function<bool(const MultipartPart&)> onPartBegin;
+    std::function<bool(const MultipartPart&, const char*, std::size_t)> onPartData;
+    std::function<void(MultipartPart&&)> onPartEnd;
+    TargetProcessor onComplete;
+
+    std::string spillDirectory;             // Если задан, файловые части пишутся сразу в эту директорию
+    std::size_t maxFieldSize {64 * 1024};   // Ограничение на часть, накапливаемую в памяти
+};
+
+/**
+ * @brief The DownloadOptions struct Параметры загрузки файла клиентом
+ */
+struct DownloadOptions
+{
+    bool        isResumeEnabled {false};        // Докачать существующий файл с его конца (Range)
+    std::size_t segmentCount {1};               // Больше 1 -- файл загружается диапазонами параллельно по разным соединениям
+    std::size_t minSegmentSize {1024 * 1024};   // Диапазоны меньше этого размера не выделяются
+};
+
+/**
+ * @brief The UpstreamHost struct Один из хостов, между которыми клиент распределяет запросы
+ */
+struct UpstreamHost
+{
+    std::string host;
+    uint16_t    port {80};
+};
+
+/**
+ * @brief The RequestPolicy struct Срок выполнения, повторы и дублирование запросов клиента.
+ *        Повторяются и дублируются только идемпотентные запросы (GET, PUT, DELETE)
+ */
+struct RequestPolicy
+{
+    std::chrono::milliseconds timeout {0};          // Срок на весь запрос вместе с повторами: подключение, TLS, отправка и ответ. 0 -- без срока
+    unsigned    maxRetries {0};                     // Повторы при ошибке соединения и ответах 502, 503, 504
+    std::chrono::milliseconds retryBackoff {100};   // Задержка перед повтором удваивается с каждой попыткой, берётся случайно из [0, задержка]
+    std::chrono::milliseconds maxRetryBackoff {2000};
+    bool        isHedgingEnabled {false};           // Если ответа долго нет, отправить дубль запроса в другое соединение, принять первый ответ
+    std::chrono::milliseconds hedgeDelay {0};       // Задержка дубля. 0 -- 95-й перцентиль времени ответа хоста
+};
+
+/**
+ * @brief The BatchOptions struct Параметры пакетной отправки запросов клиентом
+ */
+struct BatchOptions
+{
+    std::size_t maxConcurrency {0};             // Сколько запросов выполняется одновременно. 0 -- без ограничения
+    std::chrono::milliseconds timeout {0};      // Общий срок на весь пакет. 0 -- без срока
+};
+
+// Ход отправки тела: отправлено байт и общий размер (0, если он неизвестен). false -- прервать отправку
+using UploadProgressCallback = std::function<bool(std::uint64_t sentSize, std::uint64_t totalSize)>;
+
+// Источник данных неизвестной длины: заполняет буфер и возвращает число байт, 0 -- конец данных
+using UploadReader = std::function<std::size_t(char* data, std::size_t size)>;
+
 
 
 // Из-за суперстранной истории с методом to_string() в boost::beast
@@ -0,0 +1,171 @@
+#include "loadbalancer.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace HTTP
+{
+
+namespace
+{
+
+// Вес нового замера в сглаженном времени ответа
+const double latencyEwmaWeight {0.3};
+
+const unsigned maxEjectionShift {6};
+
+}
+
+LoadBalancer::LoadBalancer() :
+    m_generator {std::random_device{}()}
+{
+
+}
+
+void LoadBalancer::setUpstreams(const std::vector<HostAddress> &upstreams)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_upstreams.clear();
+    for (const auto& address : upstreams) {
+        UpstreamState upstream {};
+        upstream.address = address;
+        m_upstreams.push_back(std::move(upstream));
+    }
+}
+
+bool LoadBalancer::hasUpstreams() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_upstreams.empty();
+}
+
+std::vector<HostAddress> LoadBalancer::upstreams() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<HostAddress> addresses;
+    for (const auto& upstream : m_upstreams) {
+        addresses.push_back(upstream.address);
+    }
+    return addresses;
+}
+
+void LoadBalancer::setOutlierDetection(std::size_t consecutiveFailures, std::chrono::milliseconds ejectionTime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxConsecutiveFailures = std::max<std::size_t>(consecutiveFailures, 1);
+    m_ejectionTime = ejectionTime;
+}
+
+std::optional<HostAddress> LoadBalancer::pick()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_upstreams.empty()) {
+        return std::nullopt;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::size_t> candidates;
+    for (std::size_t i = 0; i < m_upstreams.size(); ++i) {
+        if (isAvailable(m_upstreams[i], now)) {
+            candidates.push_back(i);
+        }
+    }
+    if (candidates.empty()) {
+        candidates.resize(m_upstreams.size());
+        std::iota(candidates.begin(), candidates.end(), 0);
+    }
+
+    auto chosen = candidates.front();
+    if (candidates.size() > 1) {
+        std::uniform_int_distribution<std::size_t> distribution(0, candidates.size() - 1);
+        auto first = distribution(m_generator);
+        auto second = distribution(m_generator);
+        while (second == first) {
+            second = distribution(m_generator);
+        }
+        chosen = candidates[cost(m_upstreams[candidates[first]]) <= cost(m_upstreams[candidates[second]]) ? first : second];
+    }
+
+    auto& upstream = m_upstreams[chosen];
+    ++upstream.activeRequests;
+    if (upstream.ejectionCount > 0 && upstream.ejectedUntil <= now) {
+        upstream.isProbing = true;
+    }
+    return upstream.address;
+}
+
+bool LoadBalancer::report(const HostAddress &address, bool isSuccess, std::chrono::microseconds latency)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto upstream = findUpstream(address);
+    if (upstream == m_upstreams.end()) {
+        // Список upstream сменился, пока запрос выполнялся
+        return false;
+    }
+
+    if (upstream->activeRequests > 0) {
+        --upstream->activeRequests;
+    }
+    auto isProbe = upstream->isProbing;
+    upstream->isProbing = false;
+
+    if (isSuccess) {
+        upstream->latencyEwma = (upstream->latencyEwma == 0 ?
+                                 latency.count() :
+                                 latencyEwmaWeight * latency.count() + (1 - latencyEwmaWeight) * upstream->latencyEwma);
+        upstream->consecutiveFailures = 0;
+        if (isProbe) {
+            upstream->ejectionCount = 0;
+        }
+        return false;
+    }
+
+    ++upstream->consecutiveFailures;
+    if (!isProbe && (upstream->ejectionCount > 0 || upstream->consecutiveFailures < m_maxConsecutiveFailures)) {
+        return false;
+    }
+
+    // Неудачная проба продлевает исключение вдвое
+    auto ejectionTime = m_ejectionTime * (1u << std::min<std::size_t>(upstream->ejectionCount, maxEjectionShift));
+    upstream->ejectedUntil = std::chrono::steady_clock::now() + ejectionTime;
+    ++upstream->ejectionCount;
+    return true;
+}
+
+void LoadBalancer::release(const HostAddress &address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto upstream = findUpstream(address);
+    if (upstream == m_upstreams.end()) {
+        return;
+    }
+
+    if (upstream->activeRequests > 0) {
+        --upstream->activeRequests;
+    }
+    upstream->isProbing = false;
+}
+
+std::vector<LoadBalancer::UpstreamState>::iterator LoadBalancer::findUpstream(const HostAddress &address)
+{
+    auto hostKey = address.toString();
+    return std::find_if(m_upstreams.begin(), m_upstreams.end(), [&](const UpstreamState& upstream){
+        return upstream.address.toString() == hostKey;
+    });
+}
+
+bool LoadBalancer::isAvailable(const UpstreamState &upstream, std::chrono::steady_clock::time_point now) const
+{
+    if (upstream.ejectionCount == 0) {
+        return true;
+    }
+    return (upstream.ejectedUntil <= now && !upstream.isProbing);
+}
+
+double LoadBalancer::cost(const UpstreamState &upstream) const
+{
+    // Хост без замеров считается быстрым, чтобы на него пошли первые запросы
+    return (upstream.latencyEwma + 1) * (upstream.activeRequests + 1);
+}
+
+}
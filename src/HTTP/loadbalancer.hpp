@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "clientconnection.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The LoadBalancer class Распределение запросов между upstream-хостами клиента.
+ *        Хост выбирается из двух случайных (power of two choices) по числу незавершённых запросов
+ *        и сглаженному времени ответа (EWMA). Хост, подряд ответивший ошибкой заданное число раз,
+ *        исключается на время, после которого на него уходит один пробный запрос
+ */
+class LoadBalancer
+{
+public:
+    LoadBalancer();
+
+    void setUpstreams(const std::vector<HostAddress>& upstreams);
+    bool hasUpstreams() const;
+    std::vector<HostAddress> upstreams() const;
+
+    /**
+     * @brief setOutlierDetection   Параметры исключения хостов
+     * @param consecutiveFailures   Сколько ошибок подряд исключают хост
+     * @param ejectionTime          Время исключения, удваивается при каждой неудачной пробе
+     */
+    void setOutlierDetection(std::size_t consecutiveFailures, std::chrono::milliseconds ejectionTime);
+
+    /**
+     * @brief pick  Выбрать хост для запроса. По завершении запроса нужно вызвать report, при отмене -- release.
+     *              Если исключены все хосты, выбор идёт среди всех, чтобы запросы не отклонялись целиком
+     * @return      std::nullopt, если список upstream пуст
+     */
+    std::optional<HostAddress> pick();
+
+    /**
+     * @brief report    Результат запроса к выбранному хосту
+     * @param address
+     * @param isSuccess false при ошибке соединения или ответе 5xx
+     * @param latency
+     * @return          true, если после этой ошибки хост исключён
+     */
+    bool report(const HostAddress& address, bool isSuccess, std::chrono::microseconds latency);
+
+    /**
+     * @brief release   Запрос к выбранному хосту отменён: завершается без учёта результата и времени ответа.
+     *                  Отменённая проба не держит хост исключённым, следующий выбор пошлёт новую
+     * @param address
+     */
+    void release(const HostAddress& address);
+
+private:
+    struct UpstreamState
+    {
+        HostAddress     address;
+        std::size_t     activeRequests {0};
+        double          latencyEwma {0};        // Микросекунды
+        std::size_t     consecutiveFailures {0};
+        std::size_t     ejectionCount {0};      // Исключений подряд, 0 -- хост здоров
+        std::chrono::steady_clock::time_point ejectedUntil {};
+        bool            isProbing {false};      // Пробный запрос после исключения ещё выполняется
+    };
+
+    mutable std::mutex          m_mutex;
+    std::vector<UpstreamState>  m_upstreams;
+    std::mt19937                m_generator;
+
+    std::size_t                 m_maxConsecutiveFailures {5};
+    std::chrono::milliseconds   m_ejectionTime {10000};
+
+    std::vector<UpstreamState>::iterator findUpstream(const HostAddress& address);
+    bool isAvailable(const UpstreamState& upstream, std::chrono::steady_clock::time_point now) const;
+    double cost(const UpstreamState& upstream) const;
+};
+
+}
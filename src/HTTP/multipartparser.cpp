@@ -0,0 +1,287 @@
+#include "multipartparser.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace HTTP
+{
+
+namespace
+{
+
+std::string_view trimmed(std::string_view str)
+{
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+std::string toLower(std::string_view str)
+{
+    std::string res(str);
+    std::transform(res.begin(), res.end(), res.begin(), [](unsigned char c){ return std::tolower(c); });
+    return res;
+}
+
+std::string unquoted(std::string_view str)
+{
+    str = trimmed(str);
+    if (str.size() >= 2 && str.front() == '"' && str.back() == '"') {
+        str = str.substr(1, str.size() - 2);
+    }
+    return std::string(str);
+}
+
+// Значение параметра вида key=value или key="value" из заголовка с параметрами через ';'
+std::string headerParameter(std::string_view header, std::string_view paramName)
+{
+    std::size_t pos {0};
+    while (pos < header.size()) {
+        bool isQuoted {false};
+        std::size_t end {pos};
+        for (; end < header.size(); ++end) {
+            if (header[end] == '"') {
+                isQuoted = !isQuoted;
+            } else if (header[end] == ';' && !isQuoted) {
+                break;
+            }
+        }
+
+        auto param = trimmed(header.substr(pos, end - pos));
+        auto eqPos = param.find('=');
+        if (eqPos != std::string_view::npos && toLower(trimmed(param.substr(0, eqPos))) == paramName) {
+            return unquoted(param.substr(eqPos + 1));
+        }
+        pos = end + 1;
+    }
+    return {};
+}
+
+}
+
+MultipartParser::MultipartParser(const std::string &boundary) :
+    m_delimiter {"\r\n--" + boundary},
+    m_buffer {"\r\n"} // Первый разделитель идёт без CRLF перед ним
+{
+
+}
+
+std::string MultipartParser::boundaryFromContentType(std::string_view contentType)
+{
+    auto typeEnd = contentType.find(';');
+    if (toLower(trimmed(contentType.substr(0, typeEnd))) != "multipart/form-data" ||
+        typeEnd == std::string_view::npos) {
+        return {};
+    }
+    return headerParameter(contentType.substr(typeEnd + 1), "boundary");
+}
+
+void MultipartParser::setPartBeginCallback(PartBeginCallback &&cbk)
+{
+    m_partBeginCallback = std::move(cbk);
+}
+
+void MultipartParser::setPartDataCallback(PartDataCallback &&cbk)
+{
+    m_partDataCallback = std::move(cbk);
+}
+
+void MultipartParser::setPartEndCallback(PartEndCallback &&cbk)
+{
+    m_partEndCallback = std::move(cbk);
+}
+
+void MultipartParser::setMaxHeaderSize(std::size_t sizeBytes)
+{
+    m_maxHeaderSize = sizeBytes;
+}
+
+bool MultipartParser::feed(const char *data, std::size_t size)
+{
+    if (m_state == State::Error) {
+        return false;
+    }
+    if (m_state == State::Epilogue) {
+        return true;
+    }
+
+    m_buffer.append(data, size);
+
+    std::size_t offset {0};
+    while (m_state != State::Error && m_state != State::Epilogue) {
+        std::string_view rest(m_buffer.data() + offset, m_buffer.size() - offset);
+
+        std::size_t consumed {0};
+        switch (m_state)
+        {
+        case State::Preamble:       consumed = processPreamble(rest); break;
+        case State::AfterDelimiter: consumed = processAfterDelimiter(rest); break;
+        case State::Headers:        consumed = processHeaders(rest); break;
+        case State::Body:           consumed = processBody(rest); break;
+        default:
+            break;
+        }
+
+        if (consumed == 0) {
+            break;
+        }
+        offset += consumed;
+    }
+
+    if (m_state == State::Epilogue) {
+        m_buffer.clear();
+    } else {
+        m_buffer.erase(0, offset);
+    }
+    return (m_state != State::Error);
+}
+
+bool MultipartParser::isDone() const
+{
+    return (m_state == State::Epilogue);
+}
+
+bool MultipartParser::hasError() const
+{
+    return (m_state == State::Error);
+}
+
+const std::string &MultipartParser::errorString() const
+{
+    return m_errorString;
+}
+
+std::size_t MultipartParser::processPreamble(std::string_view data)
+{
+    auto delimiterPos = data.find(m_delimiter);
+    if (delimiterPos == std::string_view::npos) {
+        // Оставляем хвост, который может оказаться началом разделителя
+        return (data.size() >= m_delimiter.size() ? data.size() - m_delimiter.size() + 1 : 0);
+    }
+    m_state = State::AfterDelimiter;
+    return delimiterPos + m_delimiter.size();
+}
+
+std::size_t MultipartParser::processAfterDelimiter(std::string_view data)
+{
+    // Пробельный "transport padding" после разделителя допустим по RFC 2046
+    std::size_t pos {0};
+    while (pos < data.size() && (data[pos] == ' ' || data[pos] == '\t')) {
+        ++pos;
+    }
+    if (data.size() - pos < 2) {
+        return pos;
+    }
+
+    if (data.compare(pos, 2, "--") == 0) {
+        m_state = State::Epilogue;
+    } else if (data.compare(pos, 2, "\r\n") == 0) {
+        m_state = State::Headers;
+    } else {
+        setError("Invalid data after boundary delimiter");
+        return 0;
+    }
+    return pos + 2;
+}
+
+std::size_t MultipartParser::processHeaders(std::string_view data)
+{
+    std::size_t headerEnd {0};
+    std::size_t consumed {0};
+    if (data.compare(0, 2, "\r\n") == 0) {
+        consumed = 2; // Часть без заголовков
+    } else {
+        headerEnd = data.find("\r\n\r\n");
+        if (headerEnd == std::string_view::npos) {
+            if (data.size() > m_maxHeaderSize) {
+                setError("Part headers are too large");
+            }
+            return 0;
+        }
+        consumed = headerEnd + 4;
+    }
+
+    m_currentPart = {};
+    if (!parseHeaders(data.substr(0, headerEnd))) {
+        return 0;
+    }
+
+    if (m_partBeginCallback && !m_partBeginCallback(m_currentPart)) {
+        setError("Part rejected by handler");
+        return 0;
+    }
+    m_state = State::Body;
+    return consumed;
+}
+
+std::size_t MultipartParser::processBody(std::string_view data)
+{
+    auto delimiterPos = data.find(m_delimiter);
+    auto dataSize = delimiterPos;
+    if (delimiterPos == std::string_view::npos) {
+        if (data.size() < m_delimiter.size()) {
+            return 0;
+        }
+        dataSize = data.size() - m_delimiter.size() + 1;
+    }
+
+    if (dataSize > 0) {
+        m_currentPart.size += dataSize;
+        if (m_partDataCallback && !m_partDataCallback(m_currentPart, data.data(), dataSize)) {
+            setError("Part data rejected by handler");
+            return 0;
+        }
+    }
+
+    if (delimiterPos == std::string_view::npos) {
+        return dataSize;
+    }
+
+    if (m_partEndCallback && !m_partEndCallback(m_currentPart)) {
+        setError("Part rejected by handler");
+        return 0;
+    }
+    m_state = State::AfterDelimiter;
+    return delimiterPos + m_delimiter.size();
+}
+
+bool MultipartParser::parseHeaders(std::string_view headerBlock)
+{
+    std::size_t pos {0};
+    while (pos < headerBlock.size()) {
+        auto lineEnd = headerBlock.find("\r\n", pos);
+        if (lineEnd == std::string_view::npos) {
+            lineEnd = headerBlock.size();
+        }
+        auto line = headerBlock.substr(pos, lineEnd - pos);
+        pos = lineEnd + 2;
+
+        auto colonPos = line.find(':');
+        if (colonPos == std::string_view::npos) {
+            setError("Invalid part header line");
+            return false;
+        }
+        m_currentPart.headers[toLower(trimmed(line.substr(0, colonPos)))] = std::string(trimmed(line.substr(colonPos + 1)));
+    }
+
+    if (auto disposition = m_currentPart.headers.find("content-disposition"); disposition != m_currentPart.headers.end()) {
+        m_currentPart.name = headerParameter(disposition->second, "name");
+        m_currentPart.fileName = headerParameter(disposition->second, "filename");
+    }
+    if (auto contentType = m_currentPart.headers.find("content-type"); contentType != m_currentPart.headers.end()) {
+        m_currentPart.contentType = contentType->second;
+    }
+    return true;
+}
+
+void MultipartParser::setError(const std::string &errorString)
+{
+    m_state = State::Error;
+    m_errorString = errorString;
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+
+#include "httptypes.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The MultipartParser class Потоковый разборщик тела multipart/form-data.
+ *        Данные подаются кусками произвольного размера, наружу отдаются заголовки
+ *        и куски тела каждой части. Во внутреннем буфере хранится только
+ *        необработанный хвост (не больше размера разделителя или заголовков части)
+ */
+class MultipartParser
+{
+public:
+    using PartBeginCallback = std::function<bool(MultipartPart&)>;
+    using PartDataCallback  = std::function<bool(MultipartPart&, const char*, std::size_t)>;
+    using PartEndCallback   = std::function<bool(MultipartPart&)>;
+
+    explicit MultipartParser(const std::string& boundary);
+
+    /**
+     * @brief boundaryFromContentType   Достать boundary из значения заголовка Content-Type
+     * @param contentType               Например: multipart/form-data; boundary=----X
+     * @return                          Пустая строка, если тип не multipart/form-data или boundary нет
+     */
+    static std::string boundaryFromContentType(std::string_view contentType);
+
+    void setPartBeginCallback(PartBeginCallback&& cbk);
+    void setPartDataCallback(PartDataCallback&& cbk);
+    void setPartEndCallback(PartEndCallback&& cbk);
+
+    /**
+     * @brief setMaxHeaderSize  Ограничение на размер заголовков одной части
+     * @param sizeBytes
+     */
+    void setMaxHeaderSize(std::size_t sizeBytes);
+
+    /**
+     * @brief feed  Передать очередной кусок тела запроса
+     * @return      false при ошибке формата или если колбек попросил прервать разбор
+     */
+    bool feed(const char* data, std::size_t size);
+
+    bool isDone() const;
+    bool hasError() const;
+    const std::string& errorString() const;
+
+private:
+    enum class State {
+        Preamble,
+        AfterDelimiter,
+        Headers,
+        Body,
+        Epilogue,
+        Error
+    };
+    State       m_state {State::Preamble};
+
+    std::string m_delimiter;
+    std::string m_buffer;
+    std::size_t m_maxHeaderSize {16 * 1024};
+    std::string m_errorString;
+
+    MultipartPart m_currentPart;
+
+    PartBeginCallback   m_partBeginCallback;
+    PartDataCallback    m_partDataCallback;
+    PartEndCallback     m_partEndCallback;
+
+    std::size_t processPreamble(std::string_view data);
+    std::size_t processAfterDelimiter(std::string_view data);
+    std::size_t processHeaders(std::string_view data);
+    std::size_t processBody(std::string_view data);
+
+    bool parseHeaders(std::string_view headerBlock);
+    void setError(const std::string& errorString);
+};
+
+}
@@ -0,0 +1,55 @@
+#include "preparedbody.hpp"
+
+#include <charconv>
+#include <cstring>
+
+namespace HTTP
+{
+
+void RequestTemplate::Data::serialize()
+{
+    head.clear();
+    auto methodString = boost::beast::http::to_string(method);
+    head.append(methodString.data(), methodString.size());
+    head.append(" ");
+    head.append(target);
+    head.append(" HTTP/1.1\r\n");
+    for (const auto& field : fields) {
+        head.append(field.name_string().data(), field.name_string().size());
+        head.append(": ");
+        head.append(field.value().data(), field.value().size());
+        head.append("\r\n");
+    }
+}
+
+std::string_view PreparedBody::value_type::contentLength() const
+{
+    return std::string_view(m_contentLength.data(), m_contentLengthSize);
+}
+
+void PreparedBody::value_type::setData(const std::shared_ptr<const std::string> &bodyData)
+{
+    data = bodyData;
+
+    const char prefix[] = "Content-Length: ";
+    const char suffix[] = "\r\n\r\n";
+    auto begin = m_contentLength.data();
+    auto end = begin + m_contentLength.size();
+
+    auto method = requestTemplate->method;
+    auto isBodyExpected = (method != boost::beast::http::verb::get &&
+                           method != boost::beast::http::verb::head &&
+                           method != boost::beast::http::verb::delete_);
+    if (PreparedBody::size(*this) == 0 && !isBodyExpected) {
+        std::memcpy(begin, suffix + 2, 2);
+        m_contentLengthSize = 2;
+        return;
+    }
+
+    std::memcpy(begin, prefix, sizeof(prefix) - 1);
+    auto result = std::to_chars(begin + sizeof(prefix) - 1, end, PreparedBody::size(*this));
+    std::memcpy(result.ptr, suffix, sizeof(suffix) - 1);
+    m_contentLengthSize = (result.ptr - begin) + sizeof(suffix) - 1;
+}
+
+}
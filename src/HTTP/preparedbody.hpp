@@ -0,0 +1,99 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "client.hpp"
+#include "clientconnection.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The RequestTemplate::Data struct Неизменяемая часть запросов по заготовке
+ */
+struct RequestTemplate::Data
+{
+    HostAddress                 address;
+    boost::beast::http::verb    method;
+    std::string                 target;
+    Packet::BodyType            acceptableType {Packet::BodyType::Undefined};
+
+    boost::beast::http::fields  fields; // Постоянные заголовки, для HTTP/2
+    std::string                 head;   // Строка запроса и постоянные заголовки в виде HTTP/1.1, без завершающей пустой строки
+
+    /**
+     * @brief serialize Сериализовать строку запроса и fields в head
+     */
+    void serialize();
+};
+
+/**
+ * @brief The PreparedBody struct Тело запроса по заготовке. Заголовок берётся из заготовки уже сериализованным,
+ *        данные тела не копируются, а держатся общим буфером до завершения запроса
+ */
+struct PreparedBody
+{
+    struct value_type
+    {
+        std::shared_ptr<const RequestTemplate::Data>    requestTemplate;
+        std::shared_ptr<const std::string>              data;
+
+        /**
+         * @brief contentLength Строка Content-Length с завершающей пустой строкой заголовка.
+         *                      У запроса без тела методом GET, HEAD или DELETE Content-Length не отправляется
+         */
+        std::string_view contentLength() const;
+
+        /**
+         * @brief setData   Задать данные тела и подготовить строку Content-Length. requestTemplate должен быть задан
+         * @param bodyData
+         */
+        void setData(const std::shared_ptr<const std::string>& bodyData);
+
+    private:
+        std::array<char, 48>    m_contentLength {};
+        std::size_t             m_contentLengthSize {0};
+    };
+
+    static std::uint64_t size(const value_type& body) {
+        return (body.data ? body.data->size() : 0);
+    }
+
+    class writer
+    {
+    public:
+        using const_buffers_type = boost::asio::const_buffer;
+
+        template <bool isRequest, typename Fields>
+        writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body) :
+            m_data {body.data} {
+
+        }
+
+        void init(boost::beast::error_code& ec) {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool> > get(boost::beast::error_code& ec) {
+            ec = {};
+            if (m_isDone || !m_data || m_data->empty()) {
+                return boost::none;
+            }
+            m_isDone = true;
+            return {{boost::asio::buffer(*m_data), false}};
+        }
+
+    private:
+        std::shared_ptr<const std::string>  m_data;
+        bool                                m_isDone {false};
+    };
+};
+
+}
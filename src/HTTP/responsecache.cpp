@@ -0,0 +1,285 @@
+#include "responsecache.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace HTTP
+{
+
+namespace http = boost::beast::http;
+
+namespace
+{
+
+std::string_view trimmed(std::string_view value)
+{
+    auto begin = value.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+bool isEqualNoCase(std::string_view first, std::string_view second)
+{
+    return std::equal(first.begin(), first.end(), second.begin(), second.end(), [](unsigned char a, unsigned char b){
+        return std::tolower(a) == std::tolower(b);
+    });
+}
+
+std::optional<long long> parseSeconds(std::string_view value)
+{
+    value = trimmed(value);
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    long long seconds {0};
+    if (value.empty() || std::from_chars(value.data(), value.data() + value.size(), seconds).ec != std::errc() || seconds < 0) {
+        return std::nullopt;
+    }
+    return seconds;
+}
+
+std::string fieldValue(boost::beast::string_view value)
+{
+    return std::string(value.data(), value.size());
+}
+
+// Значение поля запроса, одноимённые поля объединяются через запятую
+std::string requestFieldValue(const ResponseCache::Fields& requestHeaders, const std::string& name)
+{
+    std::string value;
+    auto fieldRange = requestHeaders.equal_range(name);
+    for (auto field = fieldRange.first; field != fieldRange.second; ++field) {
+        if (!value.empty()) {
+            value += ", ";
+        }
+        value += trimmed(std::string_view(field->value().data(), field->value().size()));
+    }
+    return value;
+}
+
+// Поля из Vary ответа со значениями из запроса. std::nullopt -- Vary: *, ответ не подходит никакому запросу
+std::optional<std::vector<std::pair<std::string, std::string> > > varyFields(const ResponseCache::Fields& headers,
+                                                                            const ResponseCache::Fields& requestHeaders)
+{
+    std::vector<std::pair<std::string, std::string> > fields;
+    auto varyRange = headers.equal_range(http::field::vary);
+    for (auto vary = varyRange.first; vary != varyRange.second; ++vary) {
+        std::string_view names(vary->value().data(), vary->value().size());
+        while (!names.empty()) {
+            auto separator = std::min(names.find(','), names.size());
+            auto name = trimmed(names.substr(0, separator));
+            names.remove_prefix(std::min(separator + 1, names.size()));
+            if (name == "*") {
+                return std::nullopt;
+            }
+            if (name.empty()) {
+                continue;
+            }
+
+            std::string fieldName(name);
+            std::transform(fieldName.begin(), fieldName.end(), fieldName.begin(), [](unsigned char c){
+                return static_cast<char>(std::tolower(c));
+            });
+            auto value = requestFieldValue(requestHeaders, fieldName);
+            fields.emplace_back(std::move(fieldName), std::move(value));
+        }
+    }
+    return fields;
+}
+
+}
+
+bool ResponseCache::Entry::isFresh() const
+{
+    return (std::chrono::steady_clock::now() < expiresAt);
+}
+
+bool ResponseCache::Entry::matches(const Fields &requestHeaders) const
+{
+    return std::all_of(varyFields.begin(), varyFields.end(), [&requestHeaders](const auto& field){
+        return requestFieldValue(requestHeaders, field.first) == field.second;
+    });
+}
+
+void ResponseCache::setMaxSize(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxSize = size;
+    evict();
+}
+
+bool ResponseCache::isEnabled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (m_maxSize > 0);
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::find(const std::string &key, const Fields &requestHeaders)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto cachedEntry = m_entries.find(key);
+    if (cachedEntry == m_entries.end() || !cachedEntry->second.entry->matches(requestHeaders)) {
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, cachedEntry->second.lruPosition);
+    return cachedEntry->second.entry;
+}
+
+void ResponseCache::store(const std::string &key, const Fields &requestHeaders, const Fields &headers, const Packet &response)
+{
+    if (response.statusCode != 200) {
+        return;
+    }
+
+    auto fields = varyFields(headers, requestHeaders);
+    if (!fields) {
+        remove(key);
+        return;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->varyFields = std::move(*fields);
+    if (headers.count(http::field::etag)) {
+        entry->etag = fieldValue(headers[http::field::etag]);
+    }
+    if (headers.count(http::field::last_modified)) {
+        entry->lastModified = fieldValue(headers[http::field::last_modified]);
+    }
+
+    auto lifetime = freshnessLifetime(headers, !entry->etag.empty() || !entry->lastModified.empty());
+    if (!lifetime) {
+        remove(key);
+        return;
+    }
+    entry->response = response;
+    entry->maxAge = *lifetime;
+    entry->expiresAt = std::chrono::steady_clock::now() + *lifetime;
+    insert(key, std::move(entry));
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::refresh(const std::string &key, const Fields &requestHeaders,
+                                                                  const Fields &headers)
+{
+    auto cachedEntry = find(key, requestHeaders);
+    if (!cachedEntry) {
+        return nullptr;
+    }
+
+    auto entry = std::make_shared<Entry>(*cachedEntry);
+    if (headers.count(http::field::vary)) {
+        auto fields = varyFields(headers, requestHeaders);
+        if (!fields) {
+            remove(key);
+            return entry;
+        }
+        entry->varyFields = std::move(*fields);
+    }
+    if (headers.count(http::field::etag)) {
+        entry->etag = fieldValue(headers[http::field::etag]);
+    }
+    if (headers.count(http::field::last_modified)) {
+        entry->lastModified = fieldValue(headers[http::field::last_modified]);
+    }
+
+    // Заголовки ответа 304 заменяют сохранённые, без Cache-Control действует прежний срок
+    std::optional<std::chrono::seconds> lifetime {entry->maxAge};
+    if (headers.count(http::field::cache_control)) {
+        lifetime = freshnessLifetime(headers, true);
+    }
+    if (!lifetime) {
+        remove(key);
+        return entry;
+    }
+    entry->maxAge = *lifetime;
+    entry->expiresAt = std::chrono::steady_clock::now() + *lifetime;
+
+    std::shared_ptr<const Entry> result = entry;
+    insert(key, std::move(entry));
+    return result;
+}
+
+void ResponseCache::remove(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto cachedEntry = m_entries.find(key);
+    if (cachedEntry == m_entries.end()) {
+        return;
+    }
+    m_size -= cachedEntry->second.entry->response.body.size();
+    m_lru.erase(cachedEntry->second.lruPosition);
+    m_entries.erase(cachedEntry);
+}
+
+std::optional<std::chrono::seconds> ResponseCache::freshnessLifetime(const Fields &headers, bool hasValidators)
+{
+    std::optional<long long> maxAge;
+    bool isRevalidationRequired {false};
+    auto cacheControlRange = headers.equal_range(http::field::cache_control);
+    for (auto cacheControl = cacheControlRange.first; cacheControl != cacheControlRange.second; ++cacheControl) {
+        std::string_view directives(cacheControl->value().data(), cacheControl->value().size());
+        while (!directives.empty()) {
+            auto separator = std::min(directives.find(','), directives.size());
+            auto directive = trimmed(directives.substr(0, separator));
+            directives.remove_prefix(std::min(separator + 1, directives.size()));
+
+            auto valueBegin = directive.find('=');
+            auto name = trimmed(directive.substr(0, valueBegin));
+            if (isEqualNoCase(name, "no-store")) {
+                return std::nullopt;
+            }
+            if (isEqualNoCase(name, "no-cache")) {
+                isRevalidationRequired = true;
+            } else if (isEqualNoCase(name, "max-age") && valueBegin != std::string_view::npos) {
+                maxAge = parseSeconds(directive.substr(valueBegin + 1));
+            }
+        }
+    }
+
+    // Без явного срока ответ сохраняется, только если его можно проверить условным запросом
+    long long lifetime {0};
+    if (maxAge && !isRevalidationRequired) {
+        lifetime = *maxAge;
+        if (headers.count(http::field::age)) {
+            lifetime -= parseSeconds(fieldValue(headers[http::field::age])).value_or(0);
+        }
+    }
+    if (lifetime <= 0 && !hasValidators) {
+        return std::nullopt;
+    }
+    return std::chrono::seconds(std::max<long long>(lifetime, 0));
+}
+
+void ResponseCache::insert(const std::string &key, std::shared_ptr<const Entry> &&entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto cachedEntry = m_entries.find(key);
+    if (cachedEntry != m_entries.end()) {
+        m_size -= cachedEntry->second.entry->response.body.size();
+        m_lru.erase(cachedEntry->second.lruPosition);
+        m_entries.erase(cachedEntry);
+    }
+    if (entry->response.body.size() > m_maxSize) {
+        return;
+    }
+
+    m_size += entry->response.body.size();
+    m_lru.push_front(key);
+    m_entries[key] = CachedEntry{std::move(entry), m_lru.begin()};
+    evict();
+}
+
+void ResponseCache::evict()
+{
+    while (m_size > m_maxSize && !m_lru.empty()) {
+        auto cachedEntry = m_entries.find(m_lru.back());
+        m_size -= cachedEntry->second.entry->response.body.size();
+        m_entries.erase(cachedEntry);
+        m_lru.pop_back();
+    }
+}
+
+}
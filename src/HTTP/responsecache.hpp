@@ -0,0 +1,112 @@
+#pragma once
+
+#include <boost/beast/http.hpp>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "httptypes.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The ResponseCache class Кеш ответов на GET в памяти клиента (RFC 9111).
+ *        Свежий ответ отдаётся без обращения к серверу, устаревший с ETag или Last-Modified
+ *        проверяется условным запросом: ответ 304 продлевает сохранённый. Вытесняются давно не запрошенные ответы.
+ *        Для target хранится один вариант ответа: при Vary он подходит только запросу с теми же значениями полей
+ */
+class ResponseCache
+{
+public:
+    using Fields = boost::beast::http::fields;
+
+    /**
+     * @brief The Entry struct Сохранённый ответ
+     */
+    struct Entry
+    {
+        Packet          response;       // Распакованное тело, код и тип
+        std::string     etag;
+        std::string     lastModified;
+        std::chrono::seconds maxAge {0};  // Срок свежести из Cache-Control, нужен при продлении ответом 304 без него
+        std::chrono::steady_clock::time_point expiresAt;
+
+        // Поля запроса, перечисленные в Vary, и их значения в запросе, на который пришёл ответ
+        std::vector<std::pair<std::string, std::string> > varyFields;
+
+        bool isFresh() const;
+
+        /**
+         * @brief matches           Подходит ли ответ запросу: поля из Vary совпадают с сохранёнными
+         * @param requestHeaders
+         */
+        bool matches(const Fields& requestHeaders) const;
+    };
+
+    /**
+     * @brief setMaxSize    Наибольший суммарный размер тел в кеше. 0 -- кеш выключен и очищен
+     * @param size
+     */
+    void setMaxSize(std::size_t size);
+    bool isEnabled() const;
+
+    /**
+     * @brief find              Найти ответ для запроса
+     * @param key               Адрес хоста и target
+     * @param requestHeaders    Заголовки запроса, сверяются с полями из Vary сохранённого ответа
+     * @return                  nullptr, если ответа нет или он сохранён для другого варианта запроса
+     */
+    std::shared_ptr<const Entry> find(const std::string& key, const Fields& requestHeaders);
+
+    /**
+     * @brief store             Сохранить ответ 200, если заголовки ответа это разрешают
+     * @param key
+     * @param requestHeaders    Заголовки запроса, из них запоминаются поля, перечисленные в Vary
+     * @param headers           Заголовки ответа
+     * @param response          Ответ с распакованным телом
+     */
+    void store(const std::string& key, const Fields& requestHeaders, const Fields& headers, const Packet& response);
+
+    /**
+     * @brief refresh           Продлить сохранённый ответ по ответу 304
+     * @param key
+     * @param requestHeaders    Заголовки условного запроса
+     * @param headers           Заголовки ответа 304
+     * @return                  Продлённый ответ или nullptr, если его уже вытеснили или заменили другим вариантом
+     */
+    std::shared_ptr<const Entry> refresh(const std::string& key, const Fields& requestHeaders, const Fields& headers);
+
+    /**
+     * @brief remove    Удалить ответ: после изменяющего запроса (POST, PUT, DELETE) он устарел
+     * @param key
+     */
+    void remove(const std::string& key);
+
+private:
+    struct CachedEntry
+    {
+        std::shared_ptr<const Entry>    entry;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    // Срок свежести по Cache-Control: max-age за вычетом Age. std::nullopt -- ответ нельзя сохранять
+    static std::optional<std::chrono::seconds> freshnessLifetime(const Fields& headers, bool hasValidators);
+
+    void insert(const std::string& key, std::shared_ptr<const Entry>&& entry);
+    void evict();
+
+    mutable std::mutex  m_mutex;
+    std::size_t         m_maxSize {0};
+    std::size_t         m_size {0};
+    std::unordered_map<std::string, CachedEntry> m_entries;
+    std::list<std::string> m_lru;    // Недавно запрошенные в начале
+};
+
+}
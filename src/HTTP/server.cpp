@@ -34,12 +34,13 @@ struct Server::Impl
         }
     }
 
-    void handleConnections(std::unordered_map<std::string, std::map<MethodType, TargetProcessor> >& processors) {
+    void handleConnections(std::unordered_map<std::string, std::map<MethodType, TargetProcessor> >& processors,
+                           const std::unordered_map<std::string, MultipartHandler>& uploadHandlers) {
         m_acceptor.async_accept(m_socket,
             [&](beast::error_code ec) {
                 if(ec) {
                     COMPLOG_WARNING("Error accepting connection:", ec.message());
-                    handleConnections(processors);
+                    handleConnections(processors, uploadHandlers);
                     return;
                 }
                 auto pConnection = std::make_shared<ConnectionSession>(m_serverName, std::move(m_socket), ctx);
@@ -75,8 +76,12 @@ struct Server::Impl
                 addMethod(Post);
                 addMethod(Delete);
 
+                if (!uploadHandlers.empty()) {
+                    pConnection->m_uploadHandlers = &uploadHandlers;
+                }
+
                 pConnection->handleRequests();
-                handleConnections(processors);
+                handleConnections(processors, uploadHandlers);
         });
     }
 };
@@ -118,6 +123,12 @@ void Server::setDeleteHandler(const std::string &target, TargetProcessor &&cbk)
     COMPLOG_OK("Registered handler for DELETE", target);
 }
 
+void Server::setUploadHandler(const std::string &target, MultipartHandler &&handler)
+{
+    m_uploadHandlers[target] = std::move(handler);
+    COMPLOG_OK("Registered upload handler for", target);
+}
+
 void Server::start(uint16_t port, uint16_t threadCount)
 {
     COMPLOG_INFO("Starting server [", m_serverName, "]", m_httpsParameters.certFile.empty() ? "(HTTP)" : "(HTTPS)");
@@ -127,7 +138,7 @@ void Server::start(uint16_t port, uint16_t threadCount)
                                threadCount,
                                m_httpsParameters);
 
-    d->handleConnections(m_processors);
+    d->handleConnections(m_processors, m_uploadHandlers);
     try {
         d->m_ioc.run();
     } catch (const std::exception& ex) {
@@ -27,12 +27,21 @@ public:
     void setPutHandler(const std::string& target, TargetProcessor&& cbk);
     void setDeleteHandler(const std::string& target, TargetProcessor&& cbk);
 
+    /**
+     * @brief setUploadHandler  Задать потоковый обработчик для POST/PUT запросов с телом multipart/form-data.
+     *                          Запросы другого типа на этот target уходят в обычные обработчики
+     * @param target
+     * @param handler
+     */
+    void setUploadHandler(const std::string& target, MultipartHandler&& handler);
+
     void start(uint16_t port, uint16_t threadCount = 1);
     void stop();
     bool isRunning() const;
 
 private:
     std::unordered_map<std::string, std::map<MethodType, TargetProcessor> > m_processors;
+    std::unordered_map<std::string, MultipartHandler> m_uploadHandlers;
     SecureConnectionParameters m_httpsParameters;
 
     struct Impl;
@@ -0,0 +1,119 @@
+#include "tlssessioncache.hpp"
+
+#include "clientconnection.hpp"
+
+namespace HTTP
+{
+
+namespace
+{
+
+// Кеш удаляется вместе с SSL_CTX: соединения держат контекст и могут пережить клиента
+void freeCache(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+{
+    delete static_cast<TlsSessionCache*>(ptr);
+}
+
+// Индексы ex_data: кеш в SSL_CTX и адрес хоста в SSL
+int contextIndex()
+{
+    static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &freeCache);
+    return index;
+}
+
+int connectionIndex()
+{
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+}
+
+TlsSessionCache &TlsSessionCache::install(boost::asio::ssl::context &ctx)
+{
+    auto nativeCtx = ctx.native_handle();
+    auto cache = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(nativeCtx, contextIndex()));
+    if (cache) {
+        return *cache;
+    }
+
+    cache = new TlsSessionCache();
+    SSL_CTX_set_ex_data(nativeCtx, contextIndex(), cache);
+
+    // Встроенный кеш OpenSSL на стороне клиента не используется: сессии сохраняются по адресу хоста
+    SSL_CTX_set_session_cache_mode(nativeCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(nativeCtx, &TlsSessionCache::onNewSession);
+    return *cache;
+}
+
+void TlsSessionCache::prepare(SSL *ssl, const HostAddress &address)
+{
+    auto cache = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+    if (!cache) {
+        return;
+    }
+    SSL_set_ex_data(ssl, connectionIndex(), const_cast<HostAddress*>(&address));
+
+    std::lock_guard<std::mutex> lock(cache->m_mutex);
+    auto session = cache->m_sessions.find(address.toString());
+    if (session != cache->m_sessions.end()) {
+        SSL_set_session(ssl, session->second);
+    }
+}
+
+void TlsSessionCache::setMaxSize(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxSize = size;
+}
+
+void TlsSessionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [hostKey, session] : m_sessions) {
+        SSL_SESSION_free(session);
+    }
+    m_sessions.clear();
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+    clear();
+}
+
+int TlsSessionCache::onNewSession(SSL *ssl, SSL_SESSION *session)
+{
+    auto cache = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+    auto address = static_cast<const HostAddress*>(SSL_get_ex_data(ssl, connectionIndex()));
+    if (!cache || !address || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+
+    // Кешируется копия: OpenSSL помечает сессию соединения невозобновляемой,
+    // если соединение закрыто без close_notify, а сервер обычно закрывает соединение первым
+    auto cachedCopy = SSL_SESSION_dup(session);
+    if (!cachedCopy) {
+        return 0;
+    }
+
+    // TLS 1.3 присылает билеты после рукопожатия, каждый новый заменяет предыдущий
+    std::lock_guard<std::mutex> lock(cache->m_mutex);
+    auto hostKey = address->toString();
+    auto cachedSession = cache->m_sessions.find(hostKey);
+    if (cachedSession != cache->m_sessions.end()) {
+        SSL_SESSION_free(cachedSession->second);
+        cachedSession->second = cachedCopy;
+        return 0;
+    }
+
+    if (!cache->m_sessions.empty() && cache->m_sessions.size() >= cache->m_maxSize) {
+        SSL_SESSION_free(cache->m_sessions.begin()->second);
+        cache->m_sessions.erase(cache->m_sessions.begin());
+    }
+    cache->m_sessions.emplace(hostKey, cachedCopy);
+
+    // Ссылка на исходную сессию остаётся у соединения
+    return 0;
+}
+
+}
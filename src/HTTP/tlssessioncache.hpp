@@ -0,0 +1,51 @@
+#pragma once
+
+#include <boost/asio/ssl.hpp>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace HTTP
+{
+
+struct HostAddress;
+
+/**
+ * @brief The TlsSessionCache class Клиентский кеш TLS сессий (и билетов TLS 1.3) по адресу хоста.
+ *        Кеш хранится в SSL_CTX и живёт вместе с ним: повторное подключение к хосту
+ *        возобновляет сессию вместо полного рукопожатия
+ */
+class TlsSessionCache
+{
+public:
+    /**
+     * @brief install   Включить кеш сессий для контекста. Повторный вызов возвращает уже установленный кеш
+     * @param ctx
+     */
+    static TlsSessionCache& install(boost::asio::ssl::context& ctx);
+
+    /**
+     * @brief prepare   Подготовить соединение к рукопожатию: предложить сохранённую сессию хоста
+     *                  и запомнить, к какому хосту относятся новые сессии. Без установленного кеша ничего не делает
+     * @param ssl
+     * @param address   Должен жить, пока живёт ssl
+     */
+    static void prepare(SSL* ssl, const HostAddress& address);
+
+    void setMaxSize(std::size_t size);
+    void clear();
+
+    ~TlsSessionCache();
+
+private:
+    TlsSessionCache() = default;
+
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, SSL_SESSION*> m_sessions;
+    std::size_t m_maxSize {1024};
+};
+
+}
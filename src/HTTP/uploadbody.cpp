@@ -0,0 +1,229 @@
+#include "uploadbody.hpp"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace HTTP
+{
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+
+namespace
+{
+
+// Крупные порции: меньше системных вызовов и записей TLS на гигабайтных файлах
+const std::size_t chunkSize {256 * 1024};
+const std::size_t sendFileChunkSize {4 * 1024 * 1024};
+
+beast::error_code lastSystemError()
+{
+    return beast::error_code(errno, boost::system::system_category());
+}
+
+/**
+ * Отправка файла через sendfile в неблокирующий сокет: при заполнении буфера сокета
+ * ждём готовности на запись и продолжаем с текущего смещения
+ */
+class FileSender : public std::enable_shared_from_this<FileSender>
+{
+public:
+    FileSender(net::ip::tcp::socket& socket,
+               const UploadBody::value_type& source,
+               std::function<void(beast::error_code)>&& cbk) :
+        m_socket {socket},
+        m_source {source},
+        m_callback {std::move(cbk)},
+        m_fileSize {source->size().value_or(0)}
+    {
+
+    }
+
+    void start() {
+        boost::system::error_code ec;
+        m_socket.native_non_blocking(true, ec);
+        if (ec) {
+            finish(ec);
+            return;
+        }
+        send();
+    }
+
+private:
+    net::ip::tcp::socket&   m_socket;
+    UploadBody::value_type  m_source;
+    std::function<void(beast::error_code)> m_callback;
+    std::uint64_t           m_fileSize {0};
+    off_t                   m_offset {0};
+
+    void send() {
+        while (static_cast<std::uint64_t>(m_offset) < m_fileSize) {
+            auto sendSize = std::min<std::uint64_t>(m_fileSize - m_offset, sendFileChunkSize);
+            auto sentSize = ::sendfile(m_socket.native_handle(), m_source->fileDescriptor(), &m_offset, sendSize);
+            if (sentSize < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    m_socket.async_wait(net::ip::tcp::socket::wait_write, [pSelf = shared_from_this()](beast::error_code ec) {
+                        if (ec) {
+                            pSelf->finish(ec);
+                            return;
+                        }
+                        pSelf->send();
+                    });
+                    return;
+                }
+                finish(lastSystemError());
+                return;
+            }
+            if (sentSize == 0) {
+                // Файл стал короче заявленной длины
+                finish(net::error::eof);
+                return;
+            }
+            if (!m_source->addSentSize(static_cast<std::uint64_t>(sentSize))) {
+                finish(net::error::operation_aborted);
+                return;
+            }
+        }
+        finish({});
+    }
+
+    void finish(beast::error_code ec) {
+        boost::system::error_code blockingEc;
+        m_socket.native_non_blocking(false, blockingEc);
+        m_callback(ec);
+    }
+};
+
+}
+
+UploadBody::Source::~Source()
+{
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+void UploadBody::Source::open(const std::string &path, beast::error_code &ec)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1) {
+        ec = lastSystemError();
+        return;
+    }
+
+    struct stat fileStat {};
+    if (::fstat(m_fd, &fileStat) != 0) {
+        ec = lastSystemError();
+        return;
+    }
+    m_isRegularFile = S_ISREG(fileStat.st_mode);
+    if (m_isRegularFile) {
+        m_size = static_cast<std::uint64_t>(fileStat.st_size);
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    ec = {};
+}
+
+void UploadBody::Source::setReader(Reader &&reader)
+{
+    m_reader = std::move(reader);
+}
+
+void UploadBody::Source::setProgressCallback(ProgressCallback &&cbk)
+{
+    m_progressCallback = std::move(cbk);
+}
+
+std::optional<std::uint64_t> UploadBody::Source::size() const
+{
+    return m_size;
+}
+
+int UploadBody::Source::fileDescriptor() const
+{
+    return m_isRegularFile ? m_fd : -1;
+}
+
+std::size_t UploadBody::Source::read(char *data, std::size_t size, beast::error_code &ec)
+{
+    ec = {};
+    if (m_reader) {
+        return m_reader(data, size);
+    }
+
+    // Файл, выросший после открытия, не должен выйти за объявленный Content-Length
+    if (m_size) {
+        size = std::min<std::uint64_t>(size, *m_size - m_readSize);
+    }
+
+    while (true) {
+        auto readSize = ::read(m_fd, data, size);
+        if (readSize >= 0) {
+            m_readSize += static_cast<std::uint64_t>(readSize);
+            return static_cast<std::size_t>(readSize);
+        }
+        if (errno != EINTR) {
+            ec = lastSystemError();
+            return 0;
+        }
+    }
+}
+
+bool UploadBody::Source::rewind()
+{
+    if (!m_isRegularFile || ::lseek(m_fd, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    m_readSize = 0;
+    m_sentSize = 0;
+    return true;
+}
+
+bool UploadBody::Source::addSentSize(std::uint64_t size)
+{
+    m_sentSize += size;
+    return !m_progressCallback || m_progressCallback(m_sentSize, m_size.value_or(0));
+}
+
+std::uint64_t UploadBody::Source::sentSize() const
+{
+    return m_sentSize;
+}
+
+void UploadBody::writer::init(beast::error_code &ec)
+{
+    ec = {};
+    m_buffer.resize(chunkSize);
+}
+
+boost::optional<std::pair<UploadBody::writer::const_buffers_type, bool> > UploadBody::writer::get(beast::error_code &ec)
+{
+    // Ход отправки считается по данным, отданным в поток
+    auto readSize = m_source->read(m_buffer.data(), m_buffer.size(), ec);
+    if (ec) {
+        return boost::none;
+    }
+    if (readSize > 0 && !m_source->addSentSize(readSize)) {
+        ec = net::error::operation_aborted;
+        return boost::none;
+    }
+
+    if (readSize == 0) {
+        return boost::none;
+    }
+    return std::make_pair(const_buffers_type(m_buffer.data(), readSize), true);
+}
+
+void UploadBody::asyncSendFile(net::ip::tcp::socket &socket,
+                               const value_type &source,
+                               std::function<void (beast::error_code)> &&cbk)
+{
+    std::make_shared<FileSender>(socket, source, std::move(cbk))->start();
+}
+
+}
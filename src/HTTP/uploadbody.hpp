@@ -0,0 +1,121 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "httptypes.hpp"
+
+namespace HTTP
+{
+
+/**
+ * @brief The UploadBody struct Тело запроса, которое читается из файла или другого источника по мере отправки.
+ *        Источник неизвестной длины отправляется с Transfer-Encoding: chunked
+ */
+struct UploadBody
+{
+    using ProgressCallback = UploadProgressCallback;
+    using Reader = UploadReader;
+
+    /**
+     * @brief The Source class Источник данных тела
+     */
+    class Source
+    {
+    public:
+        Source() = default;
+        ~Source();
+
+        Source(const Source&) = delete;
+        Source& operator=(const Source&) = delete;
+
+        /**
+         * @brief open  Открыть файл. У обычного файла длина известна, канал или устройство читается до конца
+         * @param path
+         * @param ec
+         */
+        void open(const std::string& path, boost::beast::error_code& ec);
+
+        /**
+         * @brief setReader Источник неизвестной длины: reader заполняет буфер и возвращает число байт, 0 -- конец данных
+         * @param reader
+         */
+        void setReader(Reader&& reader);
+
+        /**
+         * @brief setProgressCallback   Колбек хода отправки. Если он вернул false, отправка прерывается
+         * @param cbk
+         */
+        void setProgressCallback(ProgressCallback&& cbk);
+
+        std::optional<std::uint64_t> size() const;
+
+        /**
+         * @brief fileDescriptor    Дескриптор обычного файла для отправки через sendfile, иначе -1
+         */
+        int fileDescriptor() const;
+
+        std::size_t read(char* data, std::size_t size, boost::beast::error_code& ec);
+
+        /**
+         * @brief rewind    Вернуться к началу для повторной отправки
+         * @return          false, если источник нельзя прочитать заново
+         */
+        bool rewind();
+
+        /**
+         * @brief addSentSize   Учесть отправленные данные и сообщить о ходе отправки
+         * @return              false, если отправку нужно прервать
+         */
+        bool addSentSize(std::uint64_t size);
+        std::uint64_t sentSize() const;
+
+    private:
+        int                             m_fd {-1};
+        bool                            m_isRegularFile {false};
+        std::optional<std::uint64_t>    m_size;
+        Reader                          m_reader;
+        ProgressCallback                m_progressCallback;
+        std::uint64_t                   m_readSize {0};
+        std::uint64_t                   m_sentSize {0};
+    };
+
+    using value_type = std::shared_ptr<Source>;
+
+    class writer
+    {
+    public:
+        using const_buffers_type = boost::asio::const_buffer;
+
+        template <bool isRequest, typename Fields>
+        writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body) :
+            m_source {body} {
+
+        }
+
+        void init(boost::beast::error_code& ec);
+        boost::optional<std::pair<const_buffers_type, bool> > get(boost::beast::error_code& ec);
+
+    private:
+        value_type          m_source;
+        std::vector<char>   m_buffer;
+    };
+
+    /**
+     * @brief asyncSendFile Отправить обычный файл источника в сокет через sendfile, без копирования в пространство пользователя
+     * @param socket        Сокет без TLS
+     * @param source
+     * @param cbk
+     */
+    static void asyncSendFile(boost::asio::ip::tcp::socket& socket,
+                              const value_type& source,
+                              std::function<void(boost::beast::error_code)>&& cbk);
+};
+
+}
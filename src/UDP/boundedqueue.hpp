@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace UDP
+{
+
+/**
+ * @brief The BoundedQueue class Ограниченная очередь без блокировок (Д. Вьюков): у каждой ячейки свой счётчик,
+ *        по которому писатели и читатели занимают её одним compare_exchange позиции. Класть и забирать
+ *        можно из любого числа потоков, память выделяется один раз при создании
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+     * @brief BoundedQueue  Создать очередь
+     * @param capacity      Округляется вверх до степени двойки, не меньше 2
+     */
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t size {2};
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief tryPush   Положить значение в очередь
+     * @param value     Перемещается только при успехе
+     * @return          false, если очередь заполнена
+     */
+    bool tryPush(T& value) {
+        auto position = m_enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = m_cells[position & m_mask];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief tryPop    Забрать самое старое значение
+     * @param value
+     * @return          false, если очередь пуста
+     */
+    bool tryPop(T& value) {
+        auto position = m_dequeuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = m_cells[position & m_mask];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+            if (difference == 0) {
+                if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = m_dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief empty Очередь пуста. При одновременной записи ответ может устареть сразу после возврата
+     */
+    bool empty() const {
+        auto position = m_dequeuePosition.load(std::memory_order_relaxed);
+        return (m_cells[position & m_mask].sequence.load(std::memory_order_acquire) != position + 1);
+    }
+
+    std::size_t capacity() const {
+        return m_mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t>    sequence;
+        T                           value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    std::size_t m_mask {0};
+
+    // Позиции писателей и читателя в разных кеш-линиях
+    alignas(64) std::atomic<std::size_t> m_enqueuePosition {0};
+    alignas(64) std::atomic<std::size_t> m_dequeuePosition {0};
+};
+
+}
@@ -1,27 +1,84 @@
 #include "client.hpp"
 
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <variant>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #include <Components/Logger/Logger.h>
 
+#include "../DNS/resolver.hpp"
+#include "boundedqueue.hpp"
+
 namespace UDP
 {
 
 struct Client::Impl {
+    // Датаграмм за один вызов sendmmsg (UIO_MAXIOV)
+    static constexpr std::size_t maxBatchSize {1024};
+    // Ограничения ядра на один буфер GSO: число датаграмм (UDP_MAX_SEGMENTS) и полезная нагрузка IPv4
+    static constexpr std::size_t maxGsoSegments {64};
+    static constexpr std::size_t maxGsoPayload {65507};
+
+    struct SegmentControl
+    {
+        alignas(cmsghdr) uint8_t data[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
+    // Заголовки для sendmmsg переиспользуются между вызовами одного потока
+    struct SendBatch
+    {
+        std::vector<iovec>          iovecs;
+        std::vector<mmsghdr>        messages;
+        std::vector<SegmentControl> controls;
+    };
+
+    using QueuedMessage = std::variant<std::string, std::vector<uint8_t> >;
+
     std::pair<std::string, uint16_t> host;
 
     boost::asio::io_context ioContext;
     boost::asio::ip::udp::socket socket;
     boost::asio::ip::udp::endpoint serverEndpoint;
+    bool isConnected {false};
 
     ErrorCallback errorCallback;
+
+    // Состояние поддержки UDP_SEGMENT: проверяется первым сегментированным вызовом из любого потока
+    enum class GsoState : int {
+        Unknown,
+        Supported,
+        Unsupported
+    };
+    std::atomic<GsoState> gsoState {GsoState::Unknown};
+
+    // Асинхронная отправка: очередь разбирает поток отправки, он же отправляет её пачками через sendmmsg
+    std::unique_ptr<BoundedQueue<QueuedMessage> > sendQueue;
+    QueueOverflowPolicy overflowPolicy {QueueOverflowPolicy::DropOldest};
+    SendBatch queueBatch;
+    std::thread sendThread;
+    std::atomic<bool> isAsyncRunning {false};
+    std::atomic<bool> isSenderIdle {false};
+    std::atomic<std::size_t> droppedCount {0};
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
     
     Impl() : socket(ioContext) {
         socket.open(boost::asio::ip::udp::v4());
     }
     
     ~Impl() {
+        stopAsyncSend();
         if (socket.is_open()) {
             socket.close();
         }
@@ -33,8 +90,7 @@ struct Client::Impl {
         }
     }
 
-    template <typename SendT>
-    bool sendData(SendT&& iData) {
+    bool isReadyToSend() {
         if (!socket.is_open()) {
             handleError(ErrorType::SendError,
                            "Socket is closed");
@@ -46,20 +102,320 @@ struct Client::Impl {
                            "Host did not set");
             return false;
         }
+        return true;
+    }
+
+    // Подключённый сокет отправляет без поиска маршрута для каждой датаграммы. К широковещательному адресу
+    // можно подключиться только с SO_BROADCAST, без него датаграммы отправляются по адресу
+    void connectSocket() {
+        boost::system::error_code ec;
+        socket.connect(serverEndpoint, ec);
+        isConnected = !ec;
+        if (ec) {
+            // Отключение от прежнего хоста
+            sockaddr unspecified {};
+            unspecified.sa_family = AF_UNSPEC;
+            ::connect(socket.native_handle(), &unspecified, sizeof(unspecified));
+            COMPLOG_DEBUG("[UDP] Socket is not connected to host, sending by address:", ec.message());
+        }
+    }
+
+    template <typename SendT>
+    bool send(SendT&& data) {
+        if (isAsyncRunning.load(std::memory_order_acquire)) {
+            return enqueue(std::forward<SendT>(data));
+        }
+        return sendData(data);
+    }
+
+    template <typename SendT>
+    bool sendData(SendT&& iData) {
+        if (!isReadyToSend()) {
+            return false;
+        }
+
+        auto buffer = boost::asio::buffer(iData.data(), iData.size());
+        boost::system::error_code ec;
+        auto bytesSent = sendBuffer(buffer, ec);
+        if (ec == boost::asio::error::connection_refused) {
+            bytesSent = sendBuffer(buffer, ec);
+        }
+        if (ec) {
+            handleError(ErrorType::SendError, ec.message());
+            return false;
+        }
+        return bytesSent == iData.size();
+    }
+
+    // Подключённый сокет сообщает об ICMP "порт недоступен" на прошлую датаграмму ошибкой следующей отправки.
+    // Без подключения такие ошибки не приходили, поэтому отправка повторяется: ошибка при этом уже снята
+    std::size_t sendBuffer(const boost::asio::const_buffer& buffer, boost::system::error_code& ec) {
+        if (isConnected) {
+            return socket.send(buffer, 0, ec);
+        }
+        return socket.send_to(buffer, serverEndpoint, 0, ec);
+    }
+
+    // Заголовки для count датаграмм на хост, буферы задаются вызывающим
+    void prepareMessages(SendBatch& batch, std::size_t count) {
+        batch.iovecs.resize(count);
+        batch.messages.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            auto& header = batch.messages[i].msg_hdr;
+            batch.messages[i] = mmsghdr{};
+            if (!isConnected) {
+                header.msg_name = serverEndpoint.data();
+                header.msg_namelen = static_cast<socklen_t>(serverEndpoint.size());
+            }
+            header.msg_iov = &batch.iovecs[i];
+            header.msg_iovlen = 1;
+        }
+    }
+
+    // Отправка подготовленных сообщений. Возвращает число отправленных, при ошибке её код остаётся в error
+    std::size_t sendMessages(SendBatch& batch, std::size_t count, int& error) {
+        std::size_t sentCount {0};
+        error = 0;
+        while (sentCount < count) {
+            auto batchSize = std::min(count - sentCount, maxBatchSize);
+            auto result = ::sendmmsg(socket.native_handle(), batch.messages.data() + sentCount, static_cast<unsigned>(batchSize), 0);
+            if (result < 0) {
+                if (errno == EINTR || (errno == ECONNREFUSED && isConnected)) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            sentCount += static_cast<std::size_t>(result);
+        }
+        return sentCount;
+    }
+
+    // sendBatch и sendSegmented вызываются из разных потоков, поэтому заголовки у каждого потока свои
+    static SendBatch& threadBatch() {
+        thread_local SendBatch batch;
+        return batch;
+    }
+
+    template <typename ContainerT>
+    std::size_t sendBatch(const ContainerT& datagrams) {
+        if (!isReadyToSend() || datagrams.empty()) {
+            return 0;
+        }
+
+        auto& batch = threadBatch();
+        prepareMessages(batch, datagrams.size());
+        for (std::size_t i = 0; i < datagrams.size(); ++i) {
+            batch.iovecs[i].iov_base = const_cast<char*>(reinterpret_cast<const char*>(datagrams[i].data()));
+            batch.iovecs[i].iov_len = datagrams[i].size();
+        }
+
+        int error {0};
+        auto sentCount = sendMessages(batch, datagrams.size(), error);
+        if (error) {
+            handleError(ErrorType::SendError, std::string("Batch send failed: ") + std::strerror(error));
+        }
+        return sentCount;
+    }
+
+    // Поддержка UDP_SEGMENT проверяется один раз: старые ядра не знают этот cmsg и отправили бы буфер одной датаграммой.
+    // Одновременные первые вызовы проверяют независимо, результат у них одинаковый
+    bool checkGsoSupport() {
+        auto state = gsoState.load(std::memory_order_relaxed);
+        if (state == GsoState::Unknown) {
+            int segmentSize {0};
+            socklen_t optionLength = sizeof(segmentSize);
+            auto isSupported = (::getsockopt(socket.native_handle(), SOL_UDP, UDP_SEGMENT, &segmentSize, &optionLength) == 0);
+            // Отказ от GSO после EIO в другом потоке не перезаписывается
+            auto expected = GsoState::Unknown;
+            if (gsoState.compare_exchange_strong(expected, isSupported ? GsoState::Supported : GsoState::Unsupported,
+                                                 std::memory_order_relaxed)) {
+                if (!isSupported) {
+                    COMPLOG_WARNING("[UDP] UDP_SEGMENT is not supported, segmented data will be sent by sendmmsg");
+                }
+                return isSupported;
+            }
+            state = expected;
+        }
+        return state == GsoState::Supported;
+    }
+
+    // Отправка частями по chunkSize байт, для GSO -- с размером датаграммы в cmsg каждой части
+    std::size_t sendChunks(const uint8_t* data, std::size_t size, std::size_t chunkSize, uint16_t segmentSize, int& error) {
+        auto count = (size + chunkSize - 1) / chunkSize;
+        auto& batch = threadBatch();
+        prepareMessages(batch, count);
+        if (segmentSize > 0) {
+            batch.controls.resize(count);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            batch.iovecs[i].iov_base = const_cast<uint8_t*>(data + i * chunkSize);
+            batch.iovecs[i].iov_len = std::min(chunkSize, size - i * chunkSize);
+
+            if (segmentSize > 0) {
+                auto& header = batch.messages[i].msg_hdr;
+                header.msg_control = batch.controls[i].data;
+                header.msg_controllen = sizeof(batch.controls[i].data);
+
+                auto control = CMSG_FIRSTHDR(&header);
+                control->cmsg_level = SOL_UDP;
+                control->cmsg_type = UDP_SEGMENT;
+                control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                std::memcpy(CMSG_DATA(control), &segmentSize, sizeof(segmentSize));
+            }
+        }
+        return std::min(sendMessages(batch, count, error) * chunkSize, size);
+    }
+
+    bool sendSegmented(const uint8_t* data, std::size_t size, uint16_t segmentSize) {
+        if (!isReadyToSend()) {
+            return false;
+        }
+        if (segmentSize == 0) {
+            handleError(ErrorType::SendError, "Segment size is zero");
+            return false;
+        }
+        if (size == 0) {
+            return true;
+        }
+
+        std::size_t sentSize {0};
+        int error {0};
+        if (checkGsoSupport()) {
+            auto segmentsPerChunk = std::min(maxGsoSegments, maxGsoPayload / segmentSize);
+            if (segmentsPerChunk > 0) {
+                sentSize = sendChunks(data, size, segmentsPerChunk * segmentSize, segmentSize, error);
+            }
 
-        try {
+            // EIO -- устройство не считает контрольные суммы и не может резать буфер, остаток уходит без GSO
+            if (error == EIO) {
+                COMPLOG_WARNING("[UDP] GSO is not available for the route, falling back to sendmmsg");
+                gsoState.store(GsoState::Unsupported, std::memory_order_relaxed);
+                error = 0;
+            }
+            if (error) {
+                handleError(ErrorType::SendError, std::string("Segmented send failed: ") + std::strerror(error));
+                return false;
+            }
+        }
+
+        if (sentSize < size) {
+            sentSize += sendChunks(data + sentSize, size - sentSize, segmentSize, 0, error);
+            if (error) {
+                handleError(ErrorType::SendError, std::string("Segmented send failed: ") + std::strerror(error));
+                return false;
+            }
+        }
+        return true;
+    }
 
-            size_t bytesSent = socket.send_to(
-                        boost::asio::buffer(iData.data(), iData.size()),
-                serverEndpoint
-            );
+    // Очередь не защищена от одновременных отправителей: enqueue берёт её без блокировок, поэтому пересоздание
+    // допустимо, только пока никто не отправляет (предусловие enableAsyncSend)
+    void startAsyncSend(std::size_t queueCapacity, QueueOverflowPolicy policy) {
+        stopAsyncSend();
+        sendQueue = std::make_unique<BoundedQueue<QueuedMessage> >(queueCapacity);
+        overflowPolicy = policy;
+        isAsyncRunning.store(true, std::memory_order_release);
+        sendThread = std::thread([this]() {
+            runSendQueue();
+        });
+    }
 
-            return bytesSent == iData.size();
+    // Поток отправки досылает всё, что успели положить в очередь
+    void stopAsyncSend() {
+        if (!sendThread.joinable()) {
+            return;
         }
-        catch (const std::exception& e) {
-            handleError(ErrorType::SendError, e.what());
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            isAsyncRunning.store(false, std::memory_order_release);
+        }
+        idleCondition.notify_one();
+        sendThread.join();
+        sendQueue.reset();
+    }
+
+    template <typename SendT>
+    bool enqueue(SendT&& data) {
+        if (host.second == 0) {
+            handleError(ErrorType::SendError,
+                           "Host did not set");
             return false;
         }
+
+        QueuedMessage message(std::forward<SendT>(data));
+        if (!sendQueue->tryPush(message)) {
+            if (overflowPolicy == QueueOverflowPolicy::FailFast) {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            // Место освобождается вытеснением самых старых датаграмм
+            QueuedMessage dropped;
+            do {
+                if (sendQueue->tryPop(dropped)) {
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+            } while (!sendQueue->tryPush(message));
+        }
+        wakeSender();
+        return true;
+    }
+
+    // Мьютекс берётся, только если поток отправки уснул на пустой очереди
+    void wakeSender() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (isSenderIdle.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> lock(idleMutex);
+            }
+            idleCondition.notify_one();
+        }
+    }
+
+    void runSendQueue() {
+        std::vector<QueuedMessage> pending;
+        pending.reserve(maxBatchSize);
+        QueuedMessage message;
+        while (true) {
+            while (pending.size() < maxBatchSize && sendQueue->tryPop(message)) {
+                pending.push_back(std::move(message));
+            }
+            if (!pending.empty()) {
+                sendQueued(pending);
+                pending.clear();
+                continue;
+            }
+            if (!isAsyncRunning.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            // Флаг сна публикуется до проверки очереди: отправитель, положивший датаграмму, увидит его и разбудит поток
+            std::unique_lock<std::mutex> lock(idleMutex);
+            isSenderIdle.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            idleCondition.wait(lock, [this]() {
+                return !sendQueue->empty() || !isAsyncRunning.load(std::memory_order_acquire);
+            });
+            isSenderIdle.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void sendQueued(const std::vector<QueuedMessage>& pending) {
+        prepareMessages(queueBatch, pending.size());
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            std::visit([this, i](const auto& data) {
+                queueBatch.iovecs[i].iov_base = const_cast<char*>(reinterpret_cast<const char*>(data.data()));
+                queueBatch.iovecs[i].iov_len = data.size();
+            }, pending[i]);
+        }
+
+        int error {0};
+        auto sentCount = sendMessages(queueBatch, pending.size(), error);
+        if (error) {
+            droppedCount.fetch_add(pending.size() - sentCount, std::memory_order_relaxed);
+            handleError(ErrorType::SendError, std::string("Queued send failed: ") + std::strerror(error));
+        }
     }
 };
 
@@ -76,22 +432,23 @@ Client::~Client() = default;
 bool Client::setHost(const std::string& host, uint16_t port) {
     try {
         d->host = std::make_pair(host, port);
-        
-        boost::asio::ip::udp::resolver resolver(d->ioContext);
-        boost::asio::ip::udp::resolver::query query(
-            boost::asio::ip::udp::v4(),
-            host,
-            std::to_string(port)
-        );
-        
-        auto endpoints = resolver.resolve(query);
-        if (endpoints.empty()) {
+
+        // Общий резолвер: повторные setHost на тот же хост берутся из кеша
+        DNS::Resolver::Addresses addresses;
+        auto ec = DNS::Resolver::instance().resolve(host, addresses);
+
+        // Сокет открыт как IPv4
+        auto address = std::find_if(addresses.begin(), addresses.end(), [](const auto& addr){
+            return addr.is_v4();
+        });
+        if (ec || address == addresses.end()) {
             d->handleError(ErrorType::ResolutionError,
                               "Failed to resolve host: " + host);
             return false;
         }
-        
-        d->serverEndpoint = *endpoints.begin();
+
+        d->serverEndpoint = boost::asio::ip::udp::endpoint(*address, port);
+        d->connectSocket();
         return true;
     }
     catch (const std::exception& e) {
@@ -104,6 +461,11 @@ bool Client::enableBroadcast(bool enable) {
     try {
         boost::asio::socket_base::broadcast option(enable);
         d->socket.set_option(option);
+
+        // Подключение к широковещательному адресу зависит от SO_BROADCAST
+        if (d->host.second != 0) {
+            d->connectSocket();
+        }
         return true;
     }
     catch (const std::exception& e) {
@@ -114,22 +476,62 @@ bool Client::enableBroadcast(bool enable) {
 }
 
 bool Client::sendData(std::string&& data) {
-    return d->sendData(data);
+    return d->send(std::move(data));
 }
 
 bool Client::sendData(const std::string &data)
 {
-    return d->sendData(data);
+    return d->send(data);
 }
 
 bool Client::sendByteData(std::vector<uint8_t> &&data)
 {
-    return d->sendData(data);
+    return d->send(std::move(data));
 }
 
 bool Client::sendByteData(const std::vector<uint8_t> &data)
 {
-    return d->sendData(data);
+    return d->send(data);
+}
+
+std::size_t Client::sendBatch(const std::vector<std::string> &datagrams)
+{
+    return d->sendBatch(datagrams);
+}
+
+std::size_t Client::sendByteBatch(const std::vector<std::vector<uint8_t> > &datagrams)
+{
+    return d->sendBatch(datagrams);
+}
+
+bool Client::sendSegmented(const std::string &data, uint16_t segmentSize)
+{
+    return d->sendSegmented(reinterpret_cast<const uint8_t*>(data.data()), data.size(), segmentSize);
+}
+
+bool Client::sendByteSegmented(const std::vector<uint8_t> &data, uint16_t segmentSize)
+{
+    return d->sendSegmented(data.data(), data.size(), segmentSize);
+}
+
+void Client::enableAsyncSend(std::size_t queueCapacity, QueueOverflowPolicy policy)
+{
+    d->startAsyncSend(queueCapacity, policy);
+}
+
+void Client::disableAsyncSend()
+{
+    d->stopAsyncSend();
+}
+
+bool Client::isAsyncSendEnabled() const
+{
+    return d->isAsyncRunning.load(std::memory_order_acquire);
+}
+
+std::size_t Client::droppedCount() const
+{
+    return d->droppedCount.load(std::memory_order_relaxed);
 }
 
 void Client::setErrorCallback(ErrorCallback callback) {
@@ -6,6 +6,14 @@
 namespace UDP
 {
 
+/**
+ * @brief The QueueOverflowPolicy enum Поведение асинхронной отправки при заполненной очереди
+ */
+enum class QueueOverflowPolicy : short {
+    DropOldest,     // Вытеснить самые старые датаграммы, новая всегда ставится в очередь
+    FailFast        // Отбросить новую датаграмму, отправка возвращает false
+};
+
 /**
  * @brief The Client class  Инстанция UDP клиента
  */
@@ -15,7 +23,8 @@ public:
     ~Client();
 
     /**
-     * @brief setHost   Задать хост, которому будут отправляться датаграммы
+     * @brief setHost   Задать хост, которому будут отправляться датаграммы. Сокет подключается (connect) к хосту,
+     *                  чтобы ядро не искало маршрут при каждой отправке. Задаётся, пока асинхронная отправка выключена
      * @param host      Для broadcast режима 255.255.255.255 или эквивалент
      * @param port
      * @return          true в случае успешного задания
@@ -30,21 +39,70 @@ public:
     bool enableBroadcast(bool enable = true);
 
     /**
-     * @brief sendData  Отправить данные на хост
+     * @brief sendData  Отправить данные на хост. В асинхронном режиме данные ставятся в очередь
      * @param data
-     * @return          true при успешной отправке
+     * @return          true при успешной отправке или постановке в очередь
      */
     bool sendData(std::string&& data);
     bool sendData(const std::string& data);
 
     /**
-     * @brief sendByteData  Отправить байтовые данные на хост
+     * @brief sendByteData  Отправить байтовые данные на хост. В асинхронном режиме данные ставятся в очередь
      * @param data
-     * @return              true при успешной отправке
+     * @return              true при успешной отправке или постановке в очередь
      */
     bool sendByteData(std::vector<uint8_t>&& data);
     bool sendByteData(const std::vector<uint8_t>& data);
 
+    /**
+     * @brief sendBatch Отправить датаграммы на хост пачкой: вызовом sendmmsg уходит до 1024 датаграмм за раз
+     * @param datagrams
+     * @return          Число отправленных датаграмм. При ошибке отправка прекращается, остальные не отправляются.
+     *                  Можно вызывать одновременно из нескольких потоков
+     */
+    std::size_t sendBatch(const std::vector<std::string>& datagrams);
+    std::size_t sendByteBatch(const std::vector<std::vector<uint8_t> >& datagrams);
+
+    /**
+     * @brief sendSegmented Отправить данные на хост датаграммами по segmentSize байт (последняя может быть короче).
+     *                      Ядру передаётся один буфер с UDP_SEGMENT (GSO), и оно само режет его на датаграммы:
+     *                      до 64 датаграмм за один проход по сетевому стеку. Без поддержки GSO в ядре
+     *                      данные режутся здесь и отправляются через sendmmsg.
+     *                      segmentSize не должен превышать MTU пути за вычетом заголовков IP и UDP.
+     *                      Можно вызывать одновременно из нескольких потоков
+     * @param data
+     * @param segmentSize
+     * @return              true при успешной отправке всех датаграмм
+     */
+    bool sendSegmented(const std::string& data, uint16_t segmentSize);
+    bool sendByteSegmented(const std::vector<uint8_t>& data, uint16_t segmentSize);
+
+    /**
+     * @brief enableAsyncSend   Включить асинхронную отправку: sendData и sendByteData кладут датаграмму в ограниченную
+     *                          очередь без блокировок и сразу возвращаются, а отдельный поток отправляет накопленное
+     *                          пачками через sendmmsg. Отправлять можно из любого числа потоков, вызывающий поток
+     *                          не ждёт сокет. Ошибки отправки передаются в колбек из потока отправки.
+     *                          sendBatch и sendSegmented остаются синхронными. Повторный вызов пересоздаёт очередь,
+     *                          дослав накопленное: как и disableAsyncSend, он делается, когда другие потоки уже
+     *                          не отправляют, иначе они положат датаграмму в удалённую очередь
+     * @param queueCapacity     Число датаграмм в очереди, округляется вверх до степени двойки
+     * @param policy            Поведение при заполненной очереди
+     */
+    void enableAsyncSend(std::size_t queueCapacity = 65536, QueueOverflowPolicy policy = QueueOverflowPolicy::DropOldest);
+
+    /**
+     * @brief disableAsyncSend  Дослать очередь, остановить поток отправки и вернуться к синхронной отправке.
+     *                          Вызывается, когда другие потоки уже не отправляют
+     */
+    void disableAsyncSend();
+    bool isAsyncSendEnabled() const;
+
+    /**
+     * @brief droppedCount  Число датаграмм, отброшенных асинхронной отправкой: вытесненных, не принятых в очередь
+     *                      или не отправленных из-за ошибки
+     */
+    std::size_t droppedCount() const;
+
     /**
      * @brief setErrorCallback  Задать колбек для обработки ошибок
      * @param callback
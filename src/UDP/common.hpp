@@ -25,4 +25,17 @@ enum ErrorType : short {
 using ErrorCallback = std::function<void(ErrorType, const std::string&)>;
 using RequestProcessor = std::function<void(std::vector<uint8_t>&&)>;
 
+/**
+ * @brief The DatagramView struct Датаграмма в приёмном буфере сервера, без копирования.
+ *        Действительна только во время вызова обработчика
+ */
+struct DatagramView
+{
+    const uint8_t*  data {nullptr};
+    std::size_t     size {0};
+};
+
+// Датаграммы, принятые сервером за одно пробуждение потока
+using BatchProcessor = std::function<void(const std::vector<DatagramView>&)>;
+
 }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace UDP
+{
+
+/**
+ * @brief The Datagram class Принятая датаграмма в буфере из пула сервера, без копирования.
+ *        Копии ссылаются на один буфер, он возвращается в пул при удалении последней копии.
+ *        Датаграммы, принятые с GRO одним сообщением, ссылаются на части общего буфера и держат его целиком.
+ *        Копировать и удалять можно из любого потока
+ */
+class Datagram
+{
+public:
+    Datagram() = default;
+    Datagram(const Datagram& other);
+    Datagram(Datagram&& other) noexcept;
+    Datagram& operator=(const Datagram& other);
+    Datagram& operator=(Datagram&& other) noexcept;
+    ~Datagram();
+
+    const uint8_t* data() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    /**
+     * @brief reset Отпустить буфер, не дожидаясь удаления объекта
+     */
+    void reset();
+
+private:
+    friend class DatagramPool;
+    struct Buffer;
+
+    Buffer*     m_buffer {nullptr};
+    std::size_t m_offset {0};
+    std::size_t m_size {0};
+};
+
+using DatagramProcessor = std::function<void(Datagram&&)>;
+
+}
@@ -0,0 +1,143 @@
+#include "datagrampool.hpp"
+
+#include <algorithm>
+
+namespace UDP
+{
+
+Datagram::Datagram(const Datagram &other) :
+    m_buffer {other.m_buffer},
+    m_offset {other.m_offset},
+    m_size {other.m_size}
+{
+    if (m_buffer) {
+        m_buffer->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Datagram::Datagram(Datagram &&other) noexcept :
+    m_buffer {other.m_buffer},
+    m_offset {other.m_offset},
+    m_size {other.m_size}
+{
+    other.m_buffer = nullptr;
+    other.m_offset = 0;
+    other.m_size = 0;
+}
+
+Datagram &Datagram::operator=(const Datagram &other)
+{
+    if (this != &other) {
+        Datagram copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Datagram &Datagram::operator=(Datagram &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_buffer = other.m_buffer;
+        m_offset = other.m_offset;
+        m_size = other.m_size;
+        other.m_buffer = nullptr;
+        other.m_offset = 0;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+Datagram::~Datagram()
+{
+    reset();
+}
+
+const uint8_t *Datagram::data() const
+{
+    return m_buffer ? m_buffer->data.get() + m_offset : nullptr;
+}
+
+std::size_t Datagram::size() const
+{
+    return m_size;
+}
+
+bool Datagram::empty() const
+{
+    return (m_size == 0);
+}
+
+void Datagram::reset()
+{
+    if (m_buffer && m_buffer->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        DatagramPool::release(m_buffer);
+    }
+    m_buffer = nullptr;
+    m_offset = 0;
+    m_size = 0;
+}
+
+Datagram DatagramPool::acquire(std::size_t size)
+{
+    auto sizeClass = static_cast<std::size_t>(std::lower_bound(classSizes.begin(), classSizes.end(), size) - classSizes.begin());
+    sizeClass = std::min(sizeClass, classSizes.size() - 1);
+
+    Datagram::Buffer* buffer {nullptr};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& freeBuffers = m_freeBuffers[sizeClass];
+        if (!freeBuffers.empty()) {
+            buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        } else {
+            auto newBuffer = std::make_unique<Datagram::Buffer>();
+            newBuffer->sizeClass = sizeClass;
+            newBuffer->data = std::make_unique<uint8_t[]>(classSizes[sizeClass]);
+            buffer = newBuffer.get();
+            m_buffers.push_back(std::move(newBuffer));
+
+            // Список свободных вмещает все буферы класса: возврат не выделяет память
+            freeBuffers.reserve(m_buffers.size());
+        }
+    }
+
+    buffer->pool = shared_from_this();
+    buffer->refCount.store(1, std::memory_order_relaxed);
+
+    Datagram datagram;
+    datagram.m_buffer = buffer;
+    datagram.m_size = classSizes[sizeClass];
+    return datagram;
+}
+
+uint8_t *DatagramPool::writableData(Datagram &datagram)
+{
+    return datagram.m_buffer ? datagram.m_buffer->data.get() : nullptr;
+}
+
+std::size_t DatagramPool::capacity(const Datagram &datagram)
+{
+    return datagram.m_buffer ? classSizes[datagram.m_buffer->sizeClass] : 0;
+}
+
+void DatagramPool::resize(Datagram &datagram, std::size_t size)
+{
+    datagram.m_size = std::min(size, capacity(datagram) - datagram.m_offset);
+}
+
+void DatagramPool::slice(Datagram &datagram, std::size_t offset, std::size_t size)
+{
+    datagram.m_offset = std::min(datagram.m_offset + offset, capacity(datagram));
+    resize(datagram, size);
+}
+
+void DatagramPool::release(Datagram::Buffer *buffer)
+{
+    // Ссылка на пул снимается после возврата: если она последняя, пул удаляется вместе с буферами
+    auto pool = std::move(buffer->pool);
+    std::lock_guard<std::mutex> lock(pool->m_mutex);
+    pool->m_freeBuffers[buffer->sizeClass].push_back(buffer);
+}
+
+}
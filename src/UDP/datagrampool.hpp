@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "datagram.hpp"
+
+namespace UDP
+{
+
+class DatagramPool;
+
+struct Datagram::Buffer
+{
+    std::atomic<unsigned>           refCount {0};
+    std::shared_ptr<DatagramPool>   pool;           // Задан, пока буфер выдан: пул живёт до возврата всех буферов
+    std::size_t                     sizeClass {0};
+    std::unique_ptr<uint8_t[]>      data;
+};
+
+/**
+ * @brief The DatagramPool class Пул буферов датаграмм по классам размера: 2 КБ (датаграмма в кадре Ethernet),
+ *        9 КБ (jumbo-кадры) и 64 КБ. Буферы создаются по мере надобности и дальше переиспользуются,
+ *        поэтому после разгона приём идёт без выделения памяти. Выдаются в потоке приёма, возвращаются из любого потока
+ */
+class DatagramPool : public std::enable_shared_from_this<DatagramPool>
+{
+public:
+    static constexpr std::array<std::size_t, 3> classSizes {2048, 9216, 65536};
+
+    /**
+     * @brief acquire   Взять буфер наименьшего класса, вмещающего size байт
+     * @return          Датаграмма размером с весь буфер
+     */
+    Datagram acquire(std::size_t size);
+
+    // Запись в буфер датаграммы: на приёме она ещё никому не отдана
+    static uint8_t* writableData(Datagram& datagram);
+    static std::size_t capacity(const Datagram& datagram);
+    static void resize(Datagram& datagram, std::size_t size);
+    // Сузить датаграмму до части буфера, начиная с offset относительно текущего начала
+    static void slice(Datagram& datagram, std::size_t offset, std::size_t size);
+
+    static void release(Datagram::Buffer* buffer);
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Datagram::Buffer> > m_buffers;
+    std::array<std::vector<Datagram::Buffer*>, classSizes.size()> m_freeBuffers;
+};
+
+}
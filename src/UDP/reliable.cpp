@@ -0,0 +1,346 @@
+#include "reliable.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <tuple>
+
+#include <Components/Logger/Logger.h>
+
+#include "reliableconnection.hpp"
+
+namespace UDP
+{
+
+struct ReliableEndpoint::Impl {
+    using Clock = ReliableConnection::Clock;
+
+    struct Peer
+    {
+        std::unique_ptr<ReliableConnection> connection;
+        Reply       reply;
+        uint32_t    localEpoch {0};
+        uint32_t    remoteEpoch {0};    // 0 -- от узла ещё ничего не приходило
+        Clock::time_point lastActivity;
+    };
+
+    // Датаграмма, задержанная эмуляцией канала
+    struct DelayedDatagram
+    {
+        Clock::time_point       time;
+        uint64_t                order {0};
+        Reply                   reply;
+        std::vector<uint8_t>    data;
+
+        bool operator>(const DelayedDatagram& other) const {
+            return std::tie(time, order) > std::tie(other.time, other.order);
+        }
+    };
+
+    // Без событий поток таймеров просыпается не реже этого
+    static constexpr std::chrono::milliseconds idleInterval {100};
+
+    ReliableConfig config;
+    Server server;
+    Clock::time_point startTime;
+
+    mutable std::mutex mutex;
+    std::condition_variable timerCondition;
+    std::map<boost::asio::ip::udp::endpoint, Peer> peers;
+    Clock::time_point plannedWake;
+    bool isWakeRequested {false};
+    bool isRunning {false};
+    std::thread timerThread;
+
+    LinkConditions linkConditions;
+    std::priority_queue<DelayedDatagram, std::vector<DelayedDatagram>, std::greater<DelayedDatagram> > delayedDatagrams;
+    uint64_t delayedOrder {0};
+    std::mt19937 random {std::random_device{}()};
+
+    ReliableMessageProcessor messageProcessor;
+    PeerLostCallback peerLostCallback;
+
+    ~Impl() {
+        stop();
+    }
+
+    // nullptr -- узел новый, а предел узлов достигнут
+    Peer* peerFor(const boost::asio::ip::udp::endpoint& endpoint, Clock::time_point now) {
+        auto it = peers.find(endpoint);
+        if (it == peers.end()) {
+            if (peers.size() >= std::max<std::size_t>(config.maxPeers, 1)) {
+                return nullptr;
+            }
+
+            // Эпоха своя у каждого заведённого узла: забытый по простою узел заводится с новой,
+            // и другая сторона сбрасывает прежний обмен
+            it = peers.emplace(endpoint, Peer{}).first;
+            auto& peer = it->second;
+            peer.localEpoch = std::uniform_int_distribution<uint32_t>(1, UINT32_MAX)(random);
+            peer.connection = std::make_unique<ReliableConnection>(config, peer.localEpoch, startTime);
+            peer.reply = server.replyTo(endpoint);
+        }
+        it->second.lastActivity = now;
+        return &it->second;
+    }
+
+    bool isIdleExpired(const Peer& peer, Clock::time_point now) const {
+        return config.peerIdleTimeout.count() > 0 && now - peer.lastActivity >= config.peerIdleTimeout &&
+               peer.connection->isIdle();
+    }
+
+    // Датаграммы отправляются под мьютексом: порядок отправки из разных потоков совпадает с порядком формирования,
+    // иначе перестановки выглядели бы для узла как потери
+    void flush(Peer& peer, Clock::time_point now) {
+        ReliableConnection::Datagrams datagrams;
+        peer.connection->update(now, datagrams);
+        for (auto& datagram : datagrams) {
+            route(peer.reply, std::move(datagram), now);
+        }
+        wakeTimerBefore(peer.connection->nextDeadline());
+    }
+
+    // Эмуляция канала: датаграмма отбрасывается, задерживается или отправляется сразу
+    void route(const Reply& reply, std::vector<uint8_t>&& datagram, Clock::time_point now) {
+        if (linkConditions.lossRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < linkConditions.lossRate) {
+            return;
+        }
+        if (linkConditions.delay.count() == 0 && linkConditions.jitter.count() == 0) {
+            reply.send(std::move(datagram));
+            return;
+        }
+
+        auto delay = linkConditions.delay;
+        if (linkConditions.jitter.count() > 0) {
+            delay += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, linkConditions.jitter.count())(random));
+        }
+        delayedDatagrams.push(DelayedDatagram{now + delay, delayedOrder++, reply, std::move(datagram)});
+        wakeTimerBefore(now + delay);
+    }
+
+    void wakeTimerBefore(Clock::time_point deadline) {
+        if (deadline < plannedWake) {
+            plannedWake = deadline;
+            isWakeRequested = true;
+            timerCondition.notify_one();
+        }
+    }
+
+    void notifyLost(const std::vector<boost::asio::ip::udp::endpoint>& lostPeers) {
+        for (const auto& endpoint : lostPeers) {
+            COMPLOG_WARNING("[UDP] Reliable peer lost:", endpoint.address().to_string(), endpoint.port());
+            if (peerLostCallback) {
+                peerLostCallback(endpoint);
+            }
+        }
+    }
+
+    void receive(std::vector<uint8_t>&& data, const Reply& reply) {
+        uint32_t remoteEpoch {0};
+        if (!ReliableConnection::readEpoch(data.data(), data.size(), remoteEpoch)) {
+            return;
+        }
+
+        std::vector<ReliableConnection::Message> messages;
+        std::vector<boost::asio::ip::udp::endpoint> lostPeers;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto now = Clock::now();
+            auto peer = peerFor(reply.sender(), now);
+            if (!peer) {
+                return;
+            }
+
+            // Другая эпоха -- узел перезапущен или забыл этот, состояние обмена с прежним экземпляром теряет смысл
+            if (peer->remoteEpoch != remoteEpoch) {
+                if (peer->remoteEpoch != 0) {
+                    peer->connection = std::make_unique<ReliableConnection>(config, peer->localEpoch, startTime);
+                    lostPeers.push_back(reply.sender());
+                }
+                peer->remoteEpoch = remoteEpoch;
+            }
+            peer->connection->input(data.data(), data.size(), now, messages);
+            flush(*peer, now);
+        }
+        notifyLost(lostPeers);
+
+        if (messageProcessor) {
+            for (auto& message : messages) {
+                messageProcessor(reply.sender(), std::move(message.data), message.channel);
+            }
+        }
+    }
+
+    bool send(const boost::asio::ip::udp::endpoint& endpoint, std::vector<uint8_t>&& message, uint8_t channel, Delivery delivery) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!isRunning) {
+            return false;
+        }
+
+        auto now = Clock::now();
+        auto peer = peerFor(endpoint, now);
+        if (!peer || !peer->connection->send(std::move(message), channel, delivery)) {
+            return false;
+        }
+        flush(*peer, now);
+        return true;
+    }
+
+    // Повторы по таймауту, отложенные подтверждения и задержанные эмуляцией датаграммы
+    void runTimers() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (isRunning) {
+            auto now = Clock::now();
+            plannedWake = now + idleInterval;
+
+            std::vector<boost::asio::ip::udp::endpoint> lostPeers;
+            for (auto it = peers.begin(); it != peers.end();) {
+                flush(it->second, now);
+                if (it->second.connection->isBroken()) {
+                    lostPeers.push_back(it->first);
+                    it = peers.erase(it);
+                } else if (isIdleExpired(it->second, now)) {
+                    it = peers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            while (!delayedDatagrams.empty() && delayedDatagrams.top().time <= now) {
+                auto& delayed = const_cast<DelayedDatagram&>(delayedDatagrams.top());
+                delayed.reply.send(std::move(delayed.data));
+                delayedDatagrams.pop();
+            }
+            if (!delayedDatagrams.empty()) {
+                plannedWake = std::min(plannedWake, delayedDatagrams.top().time);
+            }
+            isWakeRequested = false;
+
+            if (!lostPeers.empty()) {
+                lock.unlock();
+                notifyLost(lostPeers);
+                lock.lock();
+            }
+
+            // Отправка и приём в других потоках будят раньше, если их срок ближе запланированного
+            timerCondition.wait_until(lock, plannedWake, [this]() {
+                return isWakeRequested || !isRunning;
+            });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isRunning = false;
+        }
+        timerCondition.notify_one();
+        if (timerThread.joinable()) {
+            timerThread.join();
+        }
+        server.stop();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        peers.clear();
+        delayedDatagrams = {};
+    }
+};
+
+ReliableEndpoint::ReliableEndpoint() : d(std::make_unique<Impl>())
+{
+    d->server.setReplyProcessor([this](std::vector<uint8_t>&& data, const Reply& reply) {
+        d->receive(std::move(data), reply);
+    });
+}
+
+ReliableEndpoint::~ReliableEndpoint()
+{
+    d->stop();
+}
+
+bool ReliableEndpoint::start(uint16_t port)
+{
+    if (isWorking()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->startTime = Impl::Clock::now();
+    }
+
+    d->server.setReceiveBatchSize(16, std::clamp<std::size_t>(d->config.mtu, 256, 65507));
+    if (!d->server.start(port)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->isRunning = true;
+    d->timerThread = std::thread([this]() {
+        d->runTimers();
+    });
+    return true;
+}
+
+bool ReliableEndpoint::isWorking() const
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->isRunning;
+}
+
+void ReliableEndpoint::stop()
+{
+    d->stop();
+}
+
+uint16_t ReliableEndpoint::port() const
+{
+    return d->server.port();
+}
+
+void ReliableEndpoint::setConfig(const ReliableConfig &config)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->config = config;
+}
+
+void ReliableEndpoint::setLinkConditions(const LinkConditions &conditions)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->linkConditions = conditions;
+    d->linkConditions.lossRate = std::clamp(conditions.lossRate, 0.0, 1.0);
+}
+
+bool ReliableEndpoint::send(const boost::asio::ip::udp::endpoint &peer, std::vector<uint8_t> &&message, uint8_t channel, Delivery delivery)
+{
+    return d->send(peer, std::move(message), channel, delivery);
+}
+
+bool ReliableEndpoint::send(const boost::asio::ip::udp::endpoint &peer, const std::string &message, uint8_t channel, Delivery delivery)
+{
+    return d->send(peer, std::vector<uint8_t>(message.begin(), message.end()), channel, delivery);
+}
+
+void ReliableEndpoint::setMessageProcessor(ReliableMessageProcessor &&processor)
+{
+    d->messageProcessor = std::move(processor);
+}
+
+void ReliableEndpoint::setPeerLostCallback(PeerLostCallback &&callback)
+{
+    d->peerLostCallback = std::move(callback);
+}
+
+std::map<boost::asio::ip::udp::endpoint, ReliableStats> ReliableEndpoint::stats() const
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    std::map<boost::asio::ip::udp::endpoint, ReliableStats> result;
+    for (const auto& [endpoint, peer] : d->peers) {
+        result.emplace(endpoint, peer.connection->stats());
+    }
+    return result;
+}
+
+}
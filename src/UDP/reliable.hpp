@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+
+#include "server.hpp"
+
+namespace UDP
+{
+
+/**
+ * @brief The Delivery enum Порядок доставки сообщений канала
+ */
+enum class Delivery : uint8_t {
+    Ordered,    // В порядке отправки внутри канала: потеря задерживает только следующие сообщения этого канала
+    Unordered   // Сразу после приёма всех фрагментов сообщения
+};
+
+/**
+ * @brief The ReliableConfig struct Параметры надёжной доставки. Одинаковые на обоих узлах
+ */
+struct ReliableConfig
+{
+    std::size_t mtu {1200};                     // Размер датаграммы, сообщения длиннее режутся на фрагменты
+    std::size_t sendWindow {1024};              // Фрагментов в полёте, не больше
+    std::size_t receiveWindow {1024};           // Номеров фрагментов, принимаемых после первого непринятого
+    std::size_t sendQueueLimit {65536};         // Фрагментов в очереди на отправку, сверх неё send возвращает false
+    std::size_t maxMessageSize {16 * 1024 * 1024};  // Байт в сообщении, не больше: ограничивает и память на сборку сообщений узла
+
+    std::chrono::milliseconds initialRto {200};
+    std::chrono::milliseconds minRto {30};
+    std::chrono::milliseconds maxRto {10000};
+    std::chrono::milliseconds ackDelay {5};     // Задержка подтверждения ради объединения, при пропуске -- без задержки
+
+    unsigned fastRetransmitThreshold {3};       // Фрагмент потерян, если подтверждён отправленный на столько позже
+    unsigned maxTransmissions {20};             // После стольких отправок без подтверждения узел считается потерянным
+    std::size_t initialCongestionWindow {10};
+    bool isCongestionControlEnabled {true};     // false -- окно ограничено только окнами отправки и приёма
+
+    std::size_t maxPeers {4096};                // Узлов одновременно, датаграммы новых узлов сверх предела отбрасываются
+    std::chrono::milliseconds peerIdleTimeout {60000};  // Узел без обмена и без неподтверждённых данных забывается, 0 -- никогда
+};
+
+/**
+ * @brief The LinkConditions struct Условия канала для проверки на loopback: применяются к датаграммам,
+ *        которые отправляет этот узел
+ */
+struct LinkConditions
+{
+    double lossRate {0.0};                      // Доля отбрасываемых датаграмм, 0..1
+    std::chrono::microseconds delay {0};
+    std::chrono::microseconds jitter {0};       // К задержке добавляется случайное значение до jitter, датаграммы переставляются
+};
+
+/**
+ * @brief The ReliableStats struct Состояние обмена с узлом
+ */
+struct ReliableStats
+{
+    std::chrono::microseconds smoothedRtt {0};
+    std::chrono::microseconds rttVariance {0};
+    std::chrono::microseconds rto {0};
+    std::size_t congestionWindow {0};
+    std::size_t peerWindow {0};
+    std::size_t inFlight {0};
+    std::size_t queued {0};
+
+    std::size_t sentSegments {0};
+    std::size_t retransmittedSegments {0};
+    std::size_t fastRetransmits {0};
+    std::size_t timeouts {0};
+    std::size_t receivedSegments {0};
+    std::size_t duplicateSegments {0};
+    std::size_t deliveredMessages {0};
+};
+
+using ReliableMessageProcessor = std::function<void(const boost::asio::ip::udp::endpoint&, std::vector<uint8_t>&&, uint8_t channel)>;
+using PeerLostCallback = std::function<void(const boost::asio::ip::udp::endpoint&)>;
+
+/**
+ * @brief The ReliableEndpoint class   Надёжная доставка сообщений поверх UDP::Server, в духе KCP и QUIC.
+ *                                      С каждым узлом ведётся своя нумерация фрагментов, подтверждения выборочные (SACK),
+ *                                      таймаут повтора по оценке RTT, быстрый повтор и управление перегрузкой
+ *                                      (медленный старт и уменьшение окна вдвое при потере), окно приёма узла ограничивает
+ *                                      отправку. Каналы 0..255 не блокируют друг друга, в отличие от одного потока TCP.
+ *                                      Узел заводится при первой отправке или приёме, соединение не устанавливается.
+ *                                      Узел без обмена дольше peerIdleTimeout забывается, при следующем обмене
+ *                                      другая сторона сбрасывает состояние, как при перезапуске
+ */
+class ReliableEndpoint
+{
+public:
+    ReliableEndpoint();
+    ~ReliableEndpoint();
+
+    /**
+     * @brief start Запустить узел
+     * @param port  0 -- порт выбирается системой
+     * @return      true при успешном запуске
+     */
+    bool start(uint16_t port);
+    bool isWorking() const;
+    void stop();
+    uint16_t port() const;
+
+    /**
+     * @brief setConfig Задать параметры доставки. Задаётся до start
+     * @param config
+     */
+    void setConfig(const ReliableConfig& config);
+
+    /**
+     * @brief setLinkConditions Эмулировать потери и задержку исходящих датаграмм
+     * @param conditions
+     */
+    void setLinkConditions(const LinkConditions& conditions);
+
+    /**
+     * @brief send      Поставить сообщение в очередь узлу и отправить, сколько позволяют окна
+     * @param peer
+     * @param message
+     * @param channel
+     * @param delivery  Порядок доставки, задаётся отправителем для каждого сообщения
+     * @return          false, если узел не запущен, очередь отправки заполнена, сообщение длиннее maxMessageSize
+     *                  или достигнут предел узлов
+     */
+    bool send(const boost::asio::ip::udp::endpoint& peer, std::vector<uint8_t>&& message,
+              uint8_t channel = 0, Delivery delivery = Delivery::Ordered);
+    bool send(const boost::asio::ip::udp::endpoint& peer, const std::string& message,
+              uint8_t channel = 0, Delivery delivery = Delivery::Ordered);
+
+    /**
+     * @brief setMessageProcessor   Задать обработчик принятых сообщений. Вызывается из потока приёма по одному
+     * @param processor
+     */
+    void setMessageProcessor(ReliableMessageProcessor&& processor);
+
+    /**
+     * @brief setPeerLostCallback   Задать колбек потери узла: фрагмент не подтверждён за maxTransmissions отправок
+     *                              или узел перезапущен. Неподтверждённые сообщения узлу отбрасываются
+     * @param callback
+     */
+    void setPeerLostCallback(PeerLostCallback&& callback);
+
+    /**
+     * @brief stats Состояние обмена с каждым узлом
+     */
+    std::map<boost::asio::ip::udp::endpoint, ReliableStats> stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
+
+}
@@ -0,0 +1,591 @@
+#include "reliableconnection.hpp"
+
+#include <algorithm>
+
+namespace UDP
+{
+
+namespace
+{
+
+constexpr uint8_t protocolVersion {1};
+constexpr std::size_t packetHeaderSize {5};
+
+constexpr uint8_t dataFrame {1};
+constexpr uint8_t ackFrame {2};
+constexpr std::size_t dataFrameHeaderSize {21};
+constexpr std::size_t ackFrameHeaderSize {18};
+constexpr std::size_t ackRangeSize {8};
+constexpr std::size_t maxAckRanges {16};
+
+constexpr uint8_t orderedFlag {0x01};
+
+void writeU16(std::vector<uint8_t>& data, uint16_t value)
+{
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+void writeU32(std::vector<uint8_t>& data, uint32_t value)
+{
+    writeU16(data, static_cast<uint16_t>(value >> 16));
+    writeU16(data, static_cast<uint16_t>(value));
+}
+
+uint16_t readU16(const uint8_t* data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t readU32(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(readU16(data)) << 16) | readU16(data + 2);
+}
+
+// Номер по младшим 32 битам: ближайший к ожидаемому
+uint64_t expand(uint32_t value, uint64_t reference)
+{
+    auto difference = static_cast<int32_t>(value - static_cast<uint32_t>(reference));
+    auto result = static_cast<int64_t>(reference) + difference;
+    return (result < 0 ? 0 : static_cast<uint64_t>(result));
+}
+
+}
+
+ReliableConnection::ReliableConnection(const ReliableConfig &config, uint32_t localEpoch, Clock::time_point startTime) :
+    m_config {config},
+    m_localEpoch {localEpoch},
+    m_startTime {startTime}
+{
+    // Датаграмма вмещает хотя бы подтверждение со всеми диапазонами
+    m_config.mtu = std::clamp<std::size_t>(m_config.mtu, 256, 65507);
+    m_config.sendWindow = std::max<std::size_t>(m_config.sendWindow, 1);
+    m_config.receiveWindow = std::max<std::size_t>(m_config.receiveWindow, 1);
+    m_maxPayload = std::min<std::size_t>(m_config.mtu - packetHeaderSize - dataFrameHeaderSize, UINT16_MAX);
+
+    // Сообщение длиннее не отправляется, такие фрагменты от узла не принимаются
+    m_maxFragmentCount = std::max<std::size_t>(std::min<std::size_t>({(m_config.maxMessageSize + m_maxPayload - 1) / m_maxPayload,
+                                                                      m_config.sendQueueLimit, UINT16_MAX}), 1);
+    // Узел с теми же параметрами держит несобранными одно сообщение, начатое до окна приёма, и фрагменты в окне
+    m_maxBufferedBytes = m_config.maxMessageSize + m_config.receiveWindow * m_maxPayload +
+                         (m_config.receiveWindow + 2 * m_maxFragmentCount) * sizeof(std::vector<uint8_t>);
+
+    m_congestionWindow = std::max<std::size_t>(m_config.initialCongestionWindow, 1);
+    m_slowStartThreshold = m_config.sendWindow;
+    m_peerWindow = m_config.receiveWindow;
+    m_rto = m_config.initialRto;
+}
+
+bool ReliableConnection::readEpoch(const uint8_t *data, std::size_t size, uint32_t &epoch)
+{
+    if (size < packetHeaderSize || data[0] != protocolVersion) {
+        return false;
+    }
+    epoch = readU32(data + 1);
+    return true;
+}
+
+bool ReliableConnection::send(std::vector<uint8_t> &&message, uint8_t channel, Delivery delivery)
+{
+    auto fragmentCount = std::max<std::size_t>((message.size() + m_maxPayload - 1) / m_maxPayload, 1);
+    if (message.size() > m_config.maxMessageSize || fragmentCount > m_maxFragmentCount ||
+        m_sendQueue.size() + fragmentCount > m_config.sendQueueLimit) {
+        return false;
+    }
+
+    auto isOrdered = (delivery == Delivery::Ordered);
+    auto messageSequence = m_messageSequences[channel][isOrdered ? 1 : 0]++;
+    auto data = std::make_shared<const std::vector<uint8_t> >(std::move(message));
+    for (std::size_t i = 0; i < fragmentCount; ++i) {
+        Segment segment;
+        segment.message = data;
+        segment.offset = i * m_maxPayload;
+        segment.length = static_cast<uint16_t>(std::min(m_maxPayload, data->size() - segment.offset));
+        segment.channel = channel;
+        segment.flags = (isOrdered ? orderedFlag : 0);
+        segment.messageSequence = static_cast<uint32_t>(messageSequence);
+        segment.fragmentIndex = static_cast<uint16_t>(i);
+        segment.fragmentCount = static_cast<uint16_t>(fragmentCount);
+        m_sendQueue.push_back(std::move(segment));
+    }
+    return true;
+}
+
+void ReliableConnection::input(const uint8_t *data, std::size_t size, Clock::time_point now, std::vector<Message> &messages)
+{
+    uint32_t epoch {0};
+    if (!readEpoch(data, size, epoch)) {
+        return;
+    }
+
+    std::size_t offset {packetHeaderSize};
+    while (offset < size) {
+        auto frame = data + offset;
+        auto remaining = size - offset;
+        if (frame[0] == dataFrame) {
+            if (remaining < dataFrameHeaderSize || remaining < dataFrameHeaderSize + readU16(frame + 19)) {
+                return;
+            }
+            handleData(frame, frame + dataFrameHeaderSize, now, messages);
+            offset += dataFrameHeaderSize + readU16(frame + 19);
+        } else if (frame[0] == ackFrame) {
+            if (remaining < ackFrameHeaderSize || remaining < ackFrameHeaderSize + frame[17] * ackRangeSize) {
+                return;
+            }
+            handleAck(frame, now);
+            offset += ackFrameHeaderSize + frame[17] * ackRangeSize;
+        } else {
+            return;
+        }
+    }
+}
+
+void ReliableConnection::update(Clock::time_point now, Datagrams &output)
+{
+    if (m_isBroken) {
+        return;
+    }
+
+    // Таймауты проверяются, только когда подошёл самый ранний из них
+    if (now >= m_earliestResend) {
+        uint64_t timedOutOrder {0};
+        m_earliestResend = Clock::time_point::max();
+        for (auto& [sequence, segment] : m_inFlight) {
+            if (segment.isLost) {
+                continue;
+            }
+            if (now < segment.resendTime) {
+                m_earliestResend = std::min(m_earliestResend, segment.resendTime);
+                continue;
+            }
+            if (segment.transmissions >= m_config.maxTransmissions) {
+                m_isBroken = true;
+                return;
+            }
+            timedOutOrder = std::max(timedOutOrder, segment.transmitOrder);
+            segment.isLost = true;
+            ++m_lostCount;
+        }
+
+        // У каждого фрагмента свой таймаут, окно сбрасывается один раз на фрагменты, отправленные до прошлого сброса
+        if (timedOutOrder > m_recoveryOrder) {
+            ++m_stats.timeouts;
+            onTimeout();
+        }
+    }
+
+    auto isDataReady = (m_lostCount > 0 || canSendNew());
+    auto isAckDue = m_isAckPending && (m_isAckImmediate || now >= m_ackDeadline || isDataReady);
+    if (!isAckDue && !isDataReady) {
+        return;
+    }
+
+    // Кадры складываются в датаграммы до MTU
+    std::vector<uint8_t> datagram;
+    auto reserve = [this, &datagram, &output](std::size_t frameSize) {
+        if (!datagram.empty() && datagram.size() + frameSize > m_config.mtu) {
+            output.push_back(std::move(datagram));
+            datagram.clear();
+        }
+        if (datagram.empty()) {
+            datagram.reserve(m_config.mtu);
+            datagram.push_back(protocolVersion);
+            writeU32(datagram, m_localEpoch);
+        }
+    };
+
+    if (isAckDue) {
+        reserve(ackFrameHeaderSize + maxAckRanges * ackRangeSize);
+        writeAck(datagram, now);
+    }
+
+    // Повторы не ограничены окном: фрагменты уже учтены в полёте
+    if (m_lostCount > 0) {
+        for (auto& [sequence, segment] : m_inFlight) {
+            if (segment.isLost) {
+                reserve(dataFrameHeaderSize + segment.length);
+                writeData(datagram, segment, now);
+                ++m_stats.retransmittedSegments;
+            }
+        }
+        m_lostCount = 0;
+    }
+
+    while (canSendNew()) {
+        auto segment = std::move(m_sendQueue.front());
+        m_sendQueue.pop_front();
+        segment.sequence = m_nextSequence++;
+
+        auto& sent = m_inFlight.emplace(segment.sequence, std::move(segment)).first->second;
+        reserve(dataFrameHeaderSize + sent.length);
+        writeData(datagram, sent, now);
+    }
+
+    if (datagram.size() > packetHeaderSize) {
+        output.push_back(std::move(datagram));
+    }
+}
+
+ReliableConnection::Clock::time_point ReliableConnection::nextDeadline() const
+{
+    auto deadline = m_earliestResend;
+    if (m_isAckPending) {
+        deadline = std::min(deadline, m_ackDeadline);
+    }
+    return deadline;
+}
+
+bool ReliableConnection::isBroken() const
+{
+    return m_isBroken;
+}
+
+bool ReliableConnection::isIdle() const
+{
+    return m_sendQueue.empty() && m_inFlight.empty() && !m_isAckPending;
+}
+
+ReliableStats ReliableConnection::stats() const
+{
+    auto result = m_stats;
+    result.smoothedRtt = m_smoothedRtt;
+    result.rttVariance = m_rttVariance;
+    result.rto = m_rto;
+    result.congestionWindow = m_congestionWindow;
+    result.peerWindow = m_peerWindow;
+    result.inFlight = m_inFlight.size();
+    result.queued = m_sendQueue.size();
+    return result;
+}
+
+uint32_t ReliableConnection::timestamp(Clock::time_point time) const
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(time - m_startTime).count());
+}
+
+bool ReliableConnection::canSendNew() const
+{
+    if (m_sendQueue.empty()) {
+        return false;
+    }
+
+    // Узел принимает номера не дальше окна от первого неподтверждённого, сколько бы после него ни было
+    // подтверждено выборочно: иначе фрагменты за окном отбрасывались бы и считались потерянными
+    if (m_nextSequence >= m_sendUnacknowledged + std::max<std::size_t>(m_peerWindow, 1)) {
+        return false;
+    }
+
+    auto limit = m_config.sendWindow;
+    if (m_config.isCongestionControlEnabled) {
+        limit = std::min(limit, std::max<std::size_t>(m_congestionWindow, 1));
+    }
+    return m_inFlight.size() < limit;
+}
+
+void ReliableConnection::writeAck(std::vector<uint8_t> &datagram, Clock::time_point now)
+{
+    auto ackDelay = std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastReceiveTime).count();
+
+    datagram.push_back(ackFrame);
+    writeU32(datagram, static_cast<uint32_t>(m_receiveNext));
+    writeU32(datagram, m_echoTimestamp);
+    writeU32(datagram, static_cast<uint32_t>(std::clamp<int64_t>(ackDelay, 0, UINT32_MAX)));
+    writeU32(datagram, static_cast<uint32_t>(m_config.receiveWindow));
+
+    // Диапазоны от ближайших к пропуску: по ним отправитель находит потери
+    auto countPosition = datagram.size();
+    datagram.push_back(0);
+    uint8_t rangeCount {0};
+    for (auto it = m_receivedAhead.begin(); it != m_receivedAhead.end() && rangeCount < maxAckRanges; ++rangeCount) {
+        auto start = *it;
+        auto end = start + 1;
+        for (++it; it != m_receivedAhead.end() && *it == end; ++it) {
+            ++end;
+        }
+        writeU32(datagram, static_cast<uint32_t>(start));
+        writeU32(datagram, static_cast<uint32_t>(end));
+    }
+    datagram[countPosition] = rangeCount;
+
+    m_isAckPending = false;
+    m_isAckImmediate = false;
+    m_unacknowledgedCount = 0;
+}
+
+void ReliableConnection::writeData(std::vector<uint8_t> &datagram, Segment &segment, Clock::time_point now)
+{
+    segment.transmitOrder = m_nextTransmitOrder++;
+    segment.isLost = false;
+    ++segment.transmissions;
+
+    // Таймаут удваивается с каждым повтором фрагмента
+    auto backoff = std::min<unsigned>(segment.transmissions - 1, 10);
+    segment.resendTime = now + std::min<std::chrono::microseconds>(m_rto * (1u << backoff), m_config.maxRto);
+    m_earliestResend = std::min(m_earliestResend, segment.resendTime);
+    ++m_stats.sentSegments;
+
+    datagram.push_back(dataFrame);
+    datagram.push_back(segment.channel);
+    datagram.push_back(segment.flags);
+    writeU32(datagram, static_cast<uint32_t>(segment.sequence));
+    writeU32(datagram, timestamp(now));
+    writeU32(datagram, segment.messageSequence);
+    writeU16(datagram, segment.fragmentIndex);
+    writeU16(datagram, segment.fragmentCount);
+    writeU16(datagram, segment.length);
+    auto payload = segment.message->data() + segment.offset;
+    datagram.insert(datagram.end(), payload, payload + segment.length);
+}
+
+void ReliableConnection::handleData(const uint8_t *frame, const uint8_t *payload, Clock::time_point now, std::vector<Message> &messages)
+{
+    auto channel = frame[1];
+    auto isOrdered = ((frame[2] & orderedFlag) != 0);
+    auto sequence = expand(readU32(frame + 3), m_receiveNext);
+    ++m_stats.receivedSegments;
+
+    // Подтверждение объединяется для двух фрагментов или ждёт ackDelay. Без задержки -- при пропуске,
+    // его заполнении и повторе: отправителю нужно быстрее узнать о потере
+    m_echoTimestamp = readU32(frame + 7);
+    m_lastReceiveTime = now;
+    if (!m_isAckPending) {
+        m_isAckPending = true;
+        m_ackDeadline = now + m_config.ackDelay;
+    }
+    if (++m_unacknowledgedCount >= 2) {
+        m_isAckImmediate = true;
+    }
+
+    if (sequence < m_receiveNext || m_receivedAhead.count(sequence) > 0) {
+        ++m_stats.duplicateSegments;
+        m_isAckImmediate = true;
+        return;
+    }
+    if (sequence >= m_receiveNext + m_config.receiveWindow) {
+        m_isAckImmediate = true;
+        return;
+    }
+    // Обмен начинается с нулевого номера. До него фрагмент может быть хвостом обмена, который узел вёл
+    // с прежним экземпляром этого узла: не принимается, а подтверждение сообщает узлу новую эпоху
+    if (m_receiveNext == 0 && sequence != 0) {
+        m_isAckImmediate = true;
+        return;
+    }
+
+    uint64_t messageSequence = readU32(frame + 11);
+    if (isOrdered) {
+        messageSequence = expand(static_cast<uint32_t>(messageSequence), m_nextOrdered[channel]);
+    }
+    auto fragmentIndex = readU16(frame + 15);
+    auto fragmentCount = readU16(frame + 17);
+    auto length = readU16(frame + 19);
+    auto key = MessageKey {channel, isOrdered, messageSequence};
+
+    // Узел с теми же параметрами таких фрагментов не присылает: фрагмент не принимается и не подтверждается
+    if (length > m_maxPayload || fragmentCount > m_maxFragmentCount || (fragmentCount > 1 && fragmentIndex >= fragmentCount)) {
+        return;
+    }
+    auto partial = m_partialMessages.find(key);
+    if (partial != m_partialMessages.end() &&
+        (partial->second.fragments.size() != fragmentCount || !partial->second.fragments[fragmentIndex].empty())) {
+        return;
+    }
+
+    // Память на сборку сообщений ограничена: фрагмент сверх предела не принимается, узел повторит его позже.
+    // Фрагмент, завершающий сообщение, её освобождает
+    std::size_t bufferedSize {0};
+    if (fragmentCount > 1) {
+        if (partial == m_partialMessages.end()) {
+            bufferedSize = length + fragmentCount * sizeof(std::vector<uint8_t>);
+        } else if (partial->second.receivedCount + 1 < fragmentCount) {
+            bufferedSize = length;
+        }
+    } else if (isOrdered && messageSequence != m_nextOrdered[channel]) {
+        bufferedSize = length;
+    }
+    if (m_bufferedBytes + bufferedSize > m_maxBufferedBytes) {
+        return;
+    }
+
+    if (sequence == m_receiveNext) {
+        ++m_receiveNext;
+        if (!m_receivedAhead.empty()) {
+            m_isAckImmediate = true;
+        }
+        while (!m_receivedAhead.empty() && *m_receivedAhead.begin() == m_receiveNext) {
+            m_receivedAhead.erase(m_receivedAhead.begin());
+            ++m_receiveNext;
+        }
+    } else {
+        m_receivedAhead.insert(sequence);
+        m_isAckImmediate = true;
+    }
+
+    if (fragmentCount <= 1) {
+        completeMessage(channel, isOrdered, messageSequence, std::vector<uint8_t>(payload, payload + length), messages);
+        return;
+    }
+
+    if (partial == m_partialMessages.end()) {
+        partial = m_partialMessages.emplace(key, PartialMessage{}).first;
+        partial->second.fragments.resize(fragmentCount);
+        partial->second.bufferedSize = fragmentCount * sizeof(std::vector<uint8_t>);
+        m_bufferedBytes += partial->second.bufferedSize;
+    }
+    partial->second.fragments[fragmentIndex].assign(payload, payload + length);
+    partial->second.bufferedSize += length;
+    m_bufferedBytes += length;
+    if (++partial->second.receivedCount < fragmentCount) {
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    for (const auto& fragment : partial->second.fragments) {
+        data.insert(data.end(), fragment.begin(), fragment.end());
+    }
+    m_bufferedBytes -= partial->second.bufferedSize;
+    m_partialMessages.erase(partial);
+    completeMessage(channel, isOrdered, messageSequence, std::move(data), messages);
+}
+
+void ReliableConnection::handleAck(const uint8_t *frame, Clock::time_point now)
+{
+    auto reference = m_sendUnacknowledged;
+    auto cumulative = expand(readU32(frame + 1), reference);
+    auto echoTimestamp = readU32(frame + 5);
+    auto ackDelay = std::chrono::microseconds(readU32(frame + 9));
+    m_peerWindow = readU32(frame + 13);
+
+    std::size_t acknowledgedCount {0};
+    uint64_t largestOrder {0};
+    auto acknowledge = [this, &acknowledgedCount, &largestOrder](std::map<uint64_t, Segment>::iterator it) {
+        if (it->second.isLost) {
+            --m_lostCount;
+        }
+
+        // Подтверждение повторённого фрагмента могло прийти на первую отправку: по его номеру отправки
+        // более ранние фрагменты ошибочно считались бы потерянными
+        if (it->second.transmissions == 1) {
+            largestOrder = std::max(largestOrder, it->second.transmitOrder);
+        }
+        ++acknowledgedCount;
+        return m_inFlight.erase(it);
+    };
+
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end() && it->first < cumulative;) {
+        it = acknowledge(it);
+    }
+    for (uint8_t i = 0; i < frame[17]; ++i) {
+        auto range = frame + ackFrameHeaderSize + i * ackRangeSize;
+        auto start = expand(readU32(range), reference);
+        auto end = expand(readU32(range + 4), reference);
+        for (auto it = m_inFlight.lower_bound(start); it != m_inFlight.end() && it->first < end;) {
+            it = acknowledge(it);
+        }
+    }
+    m_sendUnacknowledged = (m_inFlight.empty() ? m_nextSequence : m_inFlight.begin()->first);
+    if (acknowledgedCount == 0) {
+        return;
+    }
+
+    // RTT по метке отправки фрагмента, на который пришло подтверждение: повторы не искажают оценку
+    auto rtt = std::chrono::microseconds(static_cast<uint32_t>(timestamp(now) - echoTimestamp));
+    if (rtt > ackDelay) {
+        rtt -= ackDelay;
+    }
+    updateRtt(rtt);
+    onAcknowledged(acknowledgedCount);
+
+    // Быстрый повтор: подтверждён фрагмент, отправленный на fastRetransmitThreshold отправок позже
+    m_largestAckedOrder = std::max(m_largestAckedOrder, largestOrder);
+    for (auto& [sequence, segment] : m_inFlight) {
+        if (!segment.isLost && segment.transmitOrder + m_config.fastRetransmitThreshold <= m_largestAckedOrder) {
+            segment.isLost = true;
+            ++m_lostCount;
+            ++m_stats.fastRetransmits;
+            onLoss(segment.transmitOrder);
+        }
+    }
+}
+
+void ReliableConnection::completeMessage(uint8_t channel, bool isOrdered, uint64_t sequence, std::vector<uint8_t> &&data,
+                                         std::vector<Message> &messages)
+{
+    if (isOrdered && sequence != m_nextOrdered[channel]) {
+        auto size = data.size();
+        if (m_pendingOrdered.emplace(std::make_pair(channel, sequence), std::move(data)).second) {
+            m_bufferedBytes += size;
+        }
+        return;
+    }
+
+    messages.push_back(Message{std::move(data), channel});
+    ++m_stats.deliveredMessages;
+    if (!isOrdered) {
+        return;
+    }
+
+    // Сообщения канала, ждавшие пропущенное
+    ++m_nextOrdered[channel];
+    for (auto it = m_pendingOrdered.find({channel, m_nextOrdered[channel]}); it != m_pendingOrdered.end();
+         it = m_pendingOrdered.find({channel, m_nextOrdered[channel]})) {
+        m_bufferedBytes -= it->second.size();
+        messages.push_back(Message{std::move(it->second), channel});
+        ++m_stats.deliveredMessages;
+        m_pendingOrdered.erase(it);
+        ++m_nextOrdered[channel];
+    }
+}
+
+void ReliableConnection::updateRtt(std::chrono::microseconds sample)
+{
+    // RFC 6298, к таймауту добавляется задержка подтверждения узла, как в QUIC
+    if (!m_hasRttSample) {
+        m_smoothedRtt = sample;
+        m_rttVariance = sample / 2;
+        m_hasRttSample = true;
+    } else {
+        auto error = (m_smoothedRtt > sample ? m_smoothedRtt - sample : sample - m_smoothedRtt);
+        m_rttVariance = (3 * m_rttVariance + error) / 4;
+        m_smoothedRtt = (7 * m_smoothedRtt + sample) / 8;
+    }
+
+    auto rto = m_smoothedRtt + std::max<std::chrono::microseconds>(4 * m_rttVariance, std::chrono::milliseconds(1)) + m_config.ackDelay;
+    m_rto = std::clamp<std::chrono::microseconds>(rto, m_config.minRto, m_config.maxRto);
+}
+
+void ReliableConnection::onAcknowledged(std::size_t count)
+{
+    if (m_congestionWindow < m_slowStartThreshold) {
+        m_congestionWindow += count;
+    } else {
+        m_windowGrowth += count;
+        if (m_windowGrowth >= m_congestionWindow) {
+            m_windowGrowth -= m_congestionWindow;
+            ++m_congestionWindow;
+        }
+    }
+    m_congestionWindow = std::min(m_congestionWindow, m_config.sendWindow);
+}
+
+void ReliableConnection::onLoss(uint64_t transmitOrder)
+{
+    // Окно уменьшается один раз на потери в пределах одного окна отправки
+    if (transmitOrder <= m_recoveryOrder) {
+        return;
+    }
+    m_slowStartThreshold = std::max<std::size_t>(m_congestionWindow / 2, 2);
+    m_congestionWindow = m_slowStartThreshold;
+    m_windowGrowth = 0;
+    m_recoveryOrder = m_nextTransmitOrder - 1;
+}
+
+void ReliableConnection::onTimeout()
+{
+    m_slowStartThreshold = std::max<std::size_t>(m_congestionWindow / 2, 2);
+    m_congestionWindow = 1;
+    m_windowGrowth = 0;
+    m_recoveryOrder = m_nextTransmitOrder - 1;
+}
+
+}
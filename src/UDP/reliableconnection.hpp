@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include "reliable.hpp"
+
+namespace UDP
+{
+
+/**
+ * @brief The ReliableConnection class  Протокол надёжной доставки с одним узлом, без сокета и таймеров:
+ *                                      датаграммы узла передаются в input, датаграммы для отправки забираются
+ *                                      из update, который вызывается по приходу, отправке и к nextDeadline.
+ *                                      Не потокобезопасен.
+ *
+ *  Датаграмма: версия (1) | эпоха отправителя (4) | кадры. Кадр данных: тип | канал | флаги | номер фрагмента (4) |
+ *  метка времени отправки (4) | номер сообщения в канале (4) | индекс и число фрагментов (2 + 2) | длина (2) | данные.
+ *  Кадр подтверждения: тип | все номера до (4) | метка последнего принятого фрагмента (4) | задержка подтверждения (4) |
+ *  окно приёма от первого непринятого (4) | число диапазонов (1) | диапазоны [начало, конец) принятых после пропуска (4 + 4).
+ *  Номера передаются младшими 32 битами и восстанавливаются по ближайшему ожидаемому
+ */
+class ReliableConnection
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Datagrams = std::vector<std::vector<uint8_t> >;
+
+    struct Message
+    {
+        std::vector<uint8_t>    data;
+        uint8_t                 channel {0};
+    };
+
+    /**
+     * @brief ReliableConnection
+     * @param config
+     * @param localEpoch    Случайный номер обмена с узлом: по его смене другая сторона узнаёт о перезапуске или забытом узле
+     * @param startTime     Начало отсчёта меток времени
+     */
+    ReliableConnection(const ReliableConfig& config, uint32_t localEpoch, Clock::time_point startTime);
+
+    /**
+     * @brief readEpoch Проверить заголовок датаграммы и прочитать эпоху отправителя
+     * @return          false, если датаграмма не этого протокола
+     */
+    static bool readEpoch(const uint8_t* data, std::size_t size, uint32_t& epoch);
+
+    bool send(std::vector<uint8_t>&& message, uint8_t channel, Delivery delivery);
+    void input(const uint8_t* data, std::size_t size, Clock::time_point now, std::vector<Message>& messages);
+    void update(Clock::time_point now, Datagrams& output);
+
+    /**
+     * @brief nextDeadline  Время следующего вызова update: повтор по таймауту или отложенное подтверждение
+     */
+    Clock::time_point nextDeadline() const;
+
+    /**
+     * @brief isBroken  Фрагмент отправлен maxTransmissions раз без подтверждения
+     */
+    bool isBroken() const;
+
+    /**
+     * @brief isIdle    Нечего отправлять, ждать подтверждения и подтверждать
+     */
+    bool isIdle() const;
+    ReliableStats stats() const;
+
+private:
+    struct Segment
+    {
+        std::shared_ptr<const std::vector<uint8_t> > message;  // Фрагменты сообщения ссылаются на общий буфер
+        std::size_t         offset {0};
+        uint16_t            length {0};
+        uint8_t             channel {0};
+        uint8_t             flags {0};
+        uint32_t            messageSequence {0};
+        uint16_t            fragmentIndex {0};
+        uint16_t            fragmentCount {1};
+
+        uint64_t            sequence {0};
+        uint64_t            transmitOrder {0};  // Номер отправки: растёт и при повторах, как номер пакета QUIC
+        Clock::time_point   resendTime;
+        unsigned            transmissions {0};
+        bool                isLost {false};
+    };
+
+    struct PartialMessage
+    {
+        std::vector<std::vector<uint8_t> >  fragments;
+        std::size_t                         receivedCount {0};
+        std::size_t                         bufferedSize {0};   // Учтено в m_bufferedBytes
+    };
+
+    using MessageKey = std::tuple<uint8_t, bool, uint64_t>;    // Канал, упорядоченность, номер сообщения
+
+    uint32_t timestamp(Clock::time_point time) const;
+    bool canSendNew() const;
+
+    void writeAck(std::vector<uint8_t>& datagram, Clock::time_point now);
+    void writeData(std::vector<uint8_t>& datagram, Segment& segment, Clock::time_point now);
+
+    void handleData(const uint8_t* frame, const uint8_t* payload, Clock::time_point now, std::vector<Message>& messages);
+    void handleAck(const uint8_t* frame, Clock::time_point now);
+    void completeMessage(uint8_t channel, bool isOrdered, uint64_t sequence, std::vector<uint8_t>&& data,
+                         std::vector<Message>& messages);
+
+    void updateRtt(std::chrono::microseconds sample);
+    void onAcknowledged(std::size_t count);
+    void onLoss(uint64_t transmitOrder);
+    void onTimeout();
+
+    ReliableConfig      m_config;
+    uint32_t            m_localEpoch {0};
+    Clock::time_point   m_startTime;
+    std::size_t         m_maxPayload {0};
+    std::size_t         m_maxFragmentCount {0};
+    std::size_t         m_maxBufferedBytes {0};
+
+    // Отправка
+    std::deque<Segment>             m_sendQueue;
+    std::map<uint64_t, Segment>     m_inFlight;
+    std::size_t                     m_lostCount {0};                            // Ждут повтора
+    Clock::time_point               m_earliestResend {Clock::time_point::max()}; // Не позже самого раннего таймаута
+    std::array<std::array<uint64_t, 2>, 256> m_messageSequences {};
+    uint64_t            m_nextSequence {0};
+    uint64_t            m_sendUnacknowledged {0};
+    uint64_t            m_nextTransmitOrder {1};
+    uint64_t            m_largestAckedOrder {0};
+    uint64_t            m_recoveryOrder {0};     // Потери отправленного до него не уменьшают окно повторно
+    std::size_t         m_congestionWindow {0};
+    std::size_t         m_slowStartThreshold {0};
+    std::size_t         m_windowGrowth {0};
+    std::size_t         m_peerWindow {0};
+
+    bool                        m_hasRttSample {false};
+    std::chrono::microseconds   m_smoothedRtt {0};
+    std::chrono::microseconds   m_rttVariance {0};
+    std::chrono::microseconds   m_rto {0};
+    bool                        m_isBroken {false};
+
+    // Приём
+    uint64_t                    m_receiveNext {0};      // Все фрагменты до него приняты
+    std::set<uint64_t>          m_receivedAhead;        // Принятые после пропуска
+    std::map<MessageKey, PartialMessage> m_partialMessages;
+    std::array<uint64_t, 256>   m_nextOrdered {};
+    std::map<std::pair<uint8_t, uint64_t>, std::vector<uint8_t> > m_pendingOrdered;
+    std::size_t                 m_bufferedBytes {0};    // Несобранные сообщения и ждущие предыдущих в канале
+
+    bool                m_isAckPending {false};
+    bool                m_isAckImmediate {false};
+    Clock::time_point   m_ackDeadline;
+    std::size_t         m_unacknowledgedCount {0};
+    uint32_t            m_echoTimestamp {0};
+    Clock::time_point   m_lastReceiveTime;
+
+    ReliableStats       m_stats;
+};
+
+}
@@ -1,70 +1,479 @@
 #include "server.hpp"
 
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <cstring>
 #include <thread>
 #include <iostream>
+#include <mutex>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #include <Components/Logger/Logger.h>
 
+#include "datagrampool.hpp"
+
 namespace UDP
 {
 
+namespace
+{
+
+using ReusePortOption = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+using IncomingCpuOption = boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_INCOMING_CPU>;
+using GroOption = boost::asio::detail::socket_option::boolean<SOL_UDP, UDP_GRO>;
+
+}
+
+struct Reply::Channel
+{
+    std::mutex mutex;
+    boost::asio::ip::udp::socket* socket {nullptr};     // nullptr после остановки сервера
+    boost::asio::io_context* ioContext {nullptr};
+    std::atomic<std::size_t> postedCount {0};           // Отправки из других потоков, ещё не выполненные в потоке сокета
+
+    bool send(const boost::asio::ip::udp::endpoint& endpoint, std::vector<uint8_t>&& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!socket) {
+            return false;
+        }
+
+        // Сокет принадлежит одному потоку: из него отправка выполняется сразу, из других -- ставится в очередь.
+        // Пока в очереди есть датаграммы, отправки из потока сокета встают за ними: порядок отправки сохраняется
+        if (ioContext->get_executor().running_in_this_thread() && postedCount.load(std::memory_order_acquire) == 0) {
+            sendNow(socket, endpoint, std::move(data));
+            return true;
+        }
+
+        postedCount.fetch_add(1, std::memory_order_acq_rel);
+        boost::asio::post(*ioContext, [this, socket = socket, endpoint, data = std::move(data)]() mutable {
+            postedCount.fetch_sub(1, std::memory_order_acq_rel);
+            sendNow(socket, endpoint, std::move(data));
+        });
+        return true;
+    }
+
+    static void sendNow(boost::asio::ip::udp::socket* socket, const boost::asio::ip::udp::endpoint& endpoint, std::vector<uint8_t>&& data) {
+        auto buffer = boost::asio::buffer(data);
+        socket->async_send_to(buffer, endpoint, [data = std::move(data)](boost::system::error_code error, std::size_t) {
+            if (error && error != boost::asio::error::operation_aborted) {
+                COMPLOG_ERROR("[UDP] Failed to send reply:", error.message());
+            }
+        });
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        socket = nullptr;
+    }
+};
+
+const boost::asio::ip::udp::endpoint &Reply::sender() const
+{
+    return m_sender;
+}
+
+bool Reply::send(std::vector<uint8_t> &&data) const
+{
+    return m_channel && m_channel->send(m_sender, std::move(data));
+}
+
+bool Reply::send(const std::string &data) const
+{
+    return send(std::vector<uint8_t>(data.begin(), data.end()));
+}
+
 struct Server::Impl {
-    std::array<char, 65507> datagramBuffer;
+    // Склеенная при GRO датаграмма занимает до 64 КБ
+    static constexpr std::size_t groBufferSize {DatagramPool::classSizes.back()};
+
+    struct SegmentControl
+    {
+        alignas(cmsghdr) uint8_t data[CMSG_SPACE(sizeof(int))];
+    };
+
+    // Буферы для recvmmsg: по слоту фиксированного размера на датаграмму, заголовки сообщений готовятся один раз
+    struct ReceiveBatch
+    {
+        std::vector<uint8_t>            storage;
+        std::vector<iovec>              iovecs;
+        std::vector<sockaddr_storage>   senders;
+        std::vector<mmsghdr>            messages;
+        std::vector<DatagramView>       datagrams;
+        std::vector<Datagram>           buffers;    // Буферы из пула, в которые принимаются датаграммы
+        std::vector<SegmentControl>     controls;   // cmsg с размером датаграмм, склеенных GRO
+
+        void init(std::size_t batchSize, std::size_t slotSize) {
+            storage.resize(batchSize * slotSize);
+            iovecs.resize(batchSize);
+            senders.resize(batchSize);
+            messages.resize(batchSize);
+            datagrams.reserve(batchSize);
+            for (std::size_t i = 0; i < batchSize; ++i) {
+                iovecs[i].iov_base = storage.data() + i * slotSize;
+                iovecs[i].iov_len = slotSize;
+
+                messages[i] = mmsghdr{};
+                messages[i].msg_hdr.msg_iov = &iovecs[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+                messages[i].msg_hdr.msg_name = &senders[i];
+            }
+        }
 
-    boost::asio::io_context ioContext;
-    boost::asio::ip::udp::socket socket;
-    boost::asio::ip::udp::endpoint senderEndpoint;
+        // Приём в буферы пула: датаграмма до 2 КБ ложится прямо в буфер, остаток более длинной -- в storage.
+        // При GRO принимается сразу в буферы 64 КБ
+        void initPooled(DatagramPool& pool, std::size_t batchSize, std::size_t maxDatagramSize, bool isGroEnabled) {
+            auto bufferSize = (isGroEnabled ? groBufferSize : DatagramPool::classSizes.front());
+            auto spillSize = (maxDatagramSize > bufferSize ? maxDatagramSize - bufferSize : 0);
+            storage.resize(batchSize * spillSize);
+            iovecs.resize(batchSize * 2);
+            senders.resize(batchSize);
+            messages.resize(batchSize);
+            buffers.resize(batchSize);
+            for (std::size_t i = 0; i < batchSize; ++i) {
+                buffers[i] = pool.acquire(bufferSize);
+                iovecs[2 * i].iov_base = DatagramPool::writableData(buffers[i]);
+                iovecs[2 * i].iov_len = DatagramPool::capacity(buffers[i]);
+                iovecs[2 * i + 1].iov_base = storage.data() + i * spillSize;
+                iovecs[2 * i + 1].iov_len = spillSize;
+
+                messages[i] = mmsghdr{};
+                messages[i].msg_hdr.msg_iov = &iovecs[2 * i];
+                messages[i].msg_hdr.msg_iovlen = (spillSize > 0 ? 2 : 1);
+                messages[i].msg_hdr.msg_name = &senders[i];
+            }
+        }
+
+        void initControls() {
+            controls.resize(messages.size());
+            for (std::size_t i = 0; i < messages.size(); ++i) {
+                messages[i].msg_hdr.msg_control = controls[i].data;
+            }
+        }
+    };
+
+    // Приёмный сокет со своим потоком и буфером
+    struct Receiver
+    {
+        std::array<char, 65507> datagramBuffer;
+        ReceiveBatch batch;
+        std::shared_ptr<DatagramPool> pool;
+        std::shared_ptr<Reply::Channel> replyChannel {std::make_shared<Reply::Channel>()};
+
+        boost::asio::io_context ioContext;
+        boost::asio::ip::udp::socket socket;
+        boost::asio::ip::udp::endpoint senderEndpoint;
+
+        std::thread ioThread;
+
+        Receiver() : socket(ioContext) {}
+    };
+
+    std::vector<std::unique_ptr<Receiver> > receivers;
 
     RequestProcessor requestProcessor;
-    std::thread ioThread;
+    BatchProcessor batchProcessor;
+    DatagramProcessor datagramProcessor;
+    ReplyProcessor replyProcessor;
+    bool isCpuAffinityEnabled {false};
+    bool isGroEnabled {false};
+    std::size_t receiveBatchSize {1};
+    std::size_t maxDatagramSize {65507};
 
     std::atomic<bool> isRunning {false};
-    
-    Impl() : socket(ioContext), isRunning(false) {}
-    
+    std::atomic<uint16_t> port {0};
+
     ~Impl() {
         stop();
     }
-    
-    void startReceive() {
-        socket.async_receive_from(
-            boost::asio::buffer(datagramBuffer),
-            senderEndpoint,
-            [this](boost::system::error_code error, std::size_t bytesReceived) {
-                if (!error && bytesReceived > 0 && requestProcessor) {
-                    std::vector<uint8_t> data(bytesReceived);
-                    std::copy(datagramBuffer.data(), datagramBuffer.data() + bytesReceived, data.data());
-                    requestProcessor(std::move(data));
+
+    void startReceive(Receiver& receiver) {
+        receiver.socket.async_receive_from(
+            boost::asio::buffer(receiver.datagramBuffer),
+            receiver.senderEndpoint,
+            [this, &receiver](boost::system::error_code error, std::size_t bytesReceived) {
+                if (!error && bytesReceived > 0) {
+                    deliver(receiver, reinterpret_cast<const uint8_t*>(receiver.datagramBuffer.data()), bytesReceived, receiver.senderEndpoint);
+                }
+
+                if (isRunning.load(std::memory_order_acquire)) {
+                    startReceive(receiver);
+                }
+            }
+        );
+    }
+
+    // Пакетный приём: по готовности сокета датаграммы забираются вызовами recvmmsg, пока очередь сокета
+    // заполняет весь пакет. Чтение неблокирующее, ожидание -- через io_context
+    void startBatchReceive(Receiver& receiver) {
+        receiver.socket.async_wait(boost::asio::ip::udp::socket::wait_read,
+            [this, &receiver](boost::system::error_code error) {
+                if (error == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!error) {
+                    receiveBatches(receiver);
                 }
-                
+
                 if (isRunning.load(std::memory_order_acquire)) {
-                    startReceive();
+                    startBatchReceive(receiver);
                 }
             }
         );
     }
-    
-    void run() {
+
+    void receiveBatches(Receiver& receiver) {
+        auto& batch = receiver.batch;
+        int count {0};
+        do {
+            // Длины адреса отправителя и cmsg -- входные и выходные параметры, их нужно восстанавливать перед каждым вызовом
+            for (auto& message : batch.messages) {
+                message.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+                message.msg_hdr.msg_controllen = (batch.controls.empty() ? 0 : sizeof(SegmentControl::data));
+            }
+            count = ::recvmmsg(receiver.socket.native_handle(), batch.messages.data(), batch.messages.size(), MSG_DONTWAIT, nullptr);
+            if (count < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    COMPLOG_ERROR("[UDP] Receive error:", std::strerror(errno));
+                }
+                return;
+            }
+            deliverBatch(receiver, static_cast<std::size_t>(count));
+        } while (static_cast<std::size_t>(count) == batch.messages.size() && isRunning.load(std::memory_order_acquire));
+    }
+
+    void deliver(Receiver& receiver, const uint8_t* data, std::size_t size, const boost::asio::ip::udp::endpoint& sender) {
+        if (batchProcessor) {
+            receiver.batch.datagrams.assign(1, DatagramView{data, size});
+            batchProcessor(receiver.batch.datagrams);
+            return;
+        }
+        if (replyProcessor) {
+            Reply reply;
+            reply.m_channel = receiver.replyChannel;
+            reply.m_sender = sender;
+            replyProcessor(std::vector<uint8_t>(data, data + size), reply);
+            return;
+        }
+        if (requestProcessor) {
+            requestProcessor(std::vector<uint8_t>(data, data + size));
+        }
+    }
+
+    // Размер датаграмм, склеенных GRO в одно сообщение. 0 -- сообщение содержит одну датаграмму
+    static std::size_t segmentSize(const msghdr& header) {
+        for (auto control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(const_cast<msghdr*>(&header), control)) {
+            if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO) {
+                int size {0};
+                std::memcpy(&size, CMSG_DATA(control), sizeof(size));
+                return static_cast<std::size_t>(std::max(size, 0));
+            }
+        }
+        return 0;
+    }
+
+    // Обход датаграмм сообщения: склеенное GRO режется по размеру из cmsg, последняя датаграмма может быть короче
+    template <typename HandlerT>
+    static void forEachDatagram(const mmsghdr& message, const uint8_t* data, HandlerT&& handler) {
+        auto size = static_cast<std::size_t>(message.msg_len);
+        auto datagramSize = segmentSize(message.msg_hdr);
+        if (datagramSize == 0) {
+            datagramSize = size;
+        }
+        for (std::size_t offset = 0; offset < size; offset += datagramSize) {
+            handler(data + offset, std::min(datagramSize, size - offset));
+        }
+    }
+
+    void deliverBatch(Receiver& receiver, std::size_t count) {
+        if (datagramProcessor) {
+            deliverPooled(receiver, count);
+            return;
+        }
+
+        auto& batch = receiver.batch;
+        batch.datagrams.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto& message = batch.messages[i];
+            if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+                COMPLOG_WARNING("[UDP] Datagram is larger than receive buffer, dropped");
+                continue;
+            }
+            forEachDatagram(message, static_cast<const uint8_t*>(batch.iovecs[i].iov_base), [&batch](const uint8_t* data, std::size_t size) {
+                batch.datagrams.push_back(DatagramView{data, size});
+            });
+        }
+
+        if (batchProcessor) {
+            if (!batch.datagrams.empty()) {
+                batchProcessor(batch.datagrams);
+            }
+            return;
+        }
+        if (replyProcessor) {
+            Reply reply;
+            reply.m_channel = receiver.replyChannel;
+            for (std::size_t i = 0; i < count; ++i) {
+                const auto& message = batch.messages[i];
+                if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+                    continue;
+                }
+                std::memcpy(reply.m_sender.data(), &batch.senders[i], message.msg_hdr.msg_namelen);
+                reply.m_sender.resize(message.msg_hdr.msg_namelen);
+                forEachDatagram(message, static_cast<const uint8_t*>(batch.iovecs[i].iov_base), [this, &reply](const uint8_t* data, std::size_t size) {
+                    replyProcessor(std::vector<uint8_t>(data, data + size), reply);
+                });
+            }
+            return;
+        }
+        if (requestProcessor) {
+            for (const auto& datagram : batch.datagrams) {
+                requestProcessor(std::vector<uint8_t>(datagram.data, datagram.data + datagram.size));
+            }
+        }
+    }
+
+    // Буфер с датаграммой отдаётся обработчику, на его место берётся свободный из пула
+    void deliverPooled(Receiver& receiver, std::size_t count) {
+        auto& batch = receiver.batch;
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto& message = batch.messages[i];
+            if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+                COMPLOG_WARNING("[UDP] Datagram is larger than receive buffer, dropped");
+                continue;
+            }
+            if (message.msg_len == 0) {
+                continue;
+            }
+
+            auto& buffer = batch.buffers[i];
+            auto bufferSize = DatagramPool::capacity(buffer);
+            auto datagramSize = segmentSize(message.msg_hdr);
+            if (datagramSize > 0 && datagramSize < message.msg_len) {
+                // Склеенные GRO датаграммы отдаются срезами принятого буфера, без копирования
+                Datagram received = std::move(buffer);
+                buffer = receiver.pool->acquire(bufferSize);
+                batch.iovecs[2 * i].iov_base = DatagramPool::writableData(buffer);
+                for (std::size_t offset = 0; offset < message.msg_len; offset += datagramSize) {
+                    Datagram datagram(received);
+                    DatagramPool::slice(datagram, offset, std::min<std::size_t>(datagramSize, message.msg_len - offset));
+                    datagramProcessor(std::move(datagram));
+                }
+                continue;
+            }
+
+            Datagram datagram;
+            if (bufferSize > DatagramPool::classSizes.front() && message.msg_len <= DatagramPool::classSizes.front()) {
+                // Одиночная короткая датаграмма из буфера GRO копируется в маленький буфер, чтобы не занимать 64 КБ
+                datagram = receiver.pool->acquire(message.msg_len);
+                std::memcpy(DatagramPool::writableData(datagram), batch.iovecs[2 * i].iov_base, message.msg_len);
+            } else if (message.msg_len <= bufferSize) {
+                datagram = std::move(buffer);
+                buffer = receiver.pool->acquire(bufferSize);
+                batch.iovecs[2 * i].iov_base = DatagramPool::writableData(buffer);
+            } else {
+                // Длинная датаграмма собирается в буфер подходящего класса
+                datagram = receiver.pool->acquire(message.msg_len);
+                auto data = DatagramPool::writableData(datagram);
+                std::memcpy(data, batch.iovecs[2 * i].iov_base, bufferSize);
+                std::memcpy(data + bufferSize, batch.iovecs[2 * i + 1].iov_base, message.msg_len - bufferSize);
+            }
+            DatagramPool::resize(datagram, message.msg_len);
+            datagramProcessor(std::move(datagram));
+        }
+    }
+
+    void run(Receiver& receiver) {
         try {
-            ioContext.run();
+            receiver.ioContext.run();
         }
         catch (const std::exception& e) {
             COMPLOG_ERROR("[UDP] Server error:", e.what());
         }
     }
-    
+
+    // Сокеты открываются все до запуска потоков: при ошибке привязки любого из них сервер не запускается.
+    // При порте 0 остальные сокеты привязываются к порту, выбранному системой для первого
+    void openReceivers(uint16_t requestedPort, uint16_t threadCount) {
+        auto bindPort = requestedPort;
+        for (uint16_t i = 0; i < threadCount; ++i) {
+            auto receiver = std::make_unique<Receiver>();
+            receiver->socket.open(boost::asio::ip::udp::v4());
+            if (threadCount > 1) {
+                receiver->socket.set_option(ReusePortOption(true));
+            }
+            if (isCpuAffinityEnabled) {
+                receiver->socket.set_option(IncomingCpuOption(cpuIndex(i)));
+            }
+            receiver->socket.bind(
+                boost::asio::ip::udp::endpoint(
+                    boost::asio::ip::address_v4::any(),
+                    bindPort
+                )
+            );
+            bindPort = receiver->socket.local_endpoint().port();
+            if (datagramProcessor) {
+                receiver->pool = std::make_shared<DatagramPool>();
+                receiver->batch.initPooled(*receiver->pool, receiveBatchSize, maxDatagramSize, isGroEnabled);
+            } else if (isBatchReceive()) {
+                receiver->batch.init(receiveBatchSize, (isGroEnabled ? groBufferSize : maxDatagramSize));
+            }
+            if (isGroEnabled) {
+                // Без поддержки в ядре датаграммы просто приходят по одной
+                boost::system::error_code ec;
+                receiver->socket.set_option(GroOption(true), ec);
+                if (ec) {
+                    COMPLOG_WARNING("[UDP] Failed to enable UDP_GRO:", ec.message());
+                }
+                receiver->batch.initControls();
+            }
+            receiver->replyChannel->socket = &receiver->socket;
+            receiver->replyChannel->ioContext = &receiver->ioContext;
+            receivers.push_back(std::move(receiver));
+        }
+        port.store(bindPort, std::memory_order_release);
+    }
+
+    // Приём через recvmmsg: пакетами, в буферы пула или с GRO, которому нужны cmsg
+    bool isBatchReceive() const {
+        return (receiveBatchSize > 1 || datagramProcessor || isGroEnabled);
+    }
+
+    static unsigned cpuIndex(uint16_t receiverIndex) {
+        return receiverIndex % std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    static void pinToCpu(std::thread& thread, unsigned cpu) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet) != 0) {
+            COMPLOG_WARNING("[UDP] Failed to pin receive thread to CPU", cpu);
+        }
+    }
+
     void stop() {
         isRunning.store(false, std::memory_order_release);
-        ioContext.stop();
-        
-        if (ioThread.joinable()) {
-            ioThread.join();
+        for (auto& receiver : receivers) {
+            receiver->replyChannel->close();
+            receiver->ioContext.stop();
         }
-        
-        if (socket.is_open()) {
-            socket.close();
+
+        for (auto& receiver : receivers) {
+            if (receiver->ioThread.joinable()) {
+                receiver->ioThread.join();
+            }
+
+            if (receiver->socket.is_open()) {
+                boost::system::error_code ec;
+                receiver->socket.close(ec);
+            }
         }
+        receivers.clear();
+        port.store(0, std::memory_order_release);
     }
 };
 
@@ -77,32 +486,38 @@ Server::~Server() {
     d->stop();
 }
 
-bool Server::start(uint16_t port) {
+bool Server::start(uint16_t port, uint16_t threadCount) {
     try {
         if (d->isRunning.load(std::memory_order_acquire)) {
             return false;
         }
-        
-        d->socket.open(boost::asio::ip::udp::v4());
-        d->socket.bind(
-            boost::asio::ip::udp::endpoint(
-                boost::asio::ip::address_v4::any(),
-                port
-            )
-        );
-        
+
+        threadCount = std::max<uint16_t>(threadCount, 1);
+        d->openReceivers(port, threadCount);
+
         d->isRunning.store(true, std::memory_order_release);
-        d->startReceive();
-        
-        d->ioThread = std::thread([this]() {
-            d->run();
-        });
-        
-        COMPLOG_OK("[UDP] Started server on port", port);
+        for (uint16_t i = 0; i < threadCount; ++i) {
+            auto& receiver = *d->receivers[i];
+            if (d->isBatchReceive()) {
+                d->startBatchReceive(receiver);
+            } else {
+                d->startReceive(receiver);
+            }
+
+            receiver.ioThread = std::thread([this, &receiver]() {
+                d->run(receiver);
+            });
+            if (d->isCpuAffinityEnabled) {
+                Impl::pinToCpu(receiver.ioThread, Impl::cpuIndex(i));
+            }
+        }
+
+        COMPLOG_OK("[UDP] Started server on port", d->port.load(), "threads:", threadCount);
         return true;
     }
     catch (const std::exception& e) {
         COMPLOG_ERROR("[UDP] Failed to start server:", e.what());
+        d->stop();
         return false;
     }
 }
@@ -116,8 +531,54 @@ void Server::stop() {
     d->stop();
 }
 
+uint16_t Server::port() const
+{
+    return d->port.load(std::memory_order_acquire);
+}
+
+void Server::setCpuAffinityEnabled(bool isEnabled)
+{
+    d->isCpuAffinityEnabled = isEnabled;
+}
+
+void Server::setGroEnabled(bool isEnabled)
+{
+    d->isGroEnabled = isEnabled;
+}
+
 void Server::setRequestProcessor(RequestProcessor &&processor) {
     d->requestProcessor = std::move(processor);
 }
 
+void Server::setReplyProcessor(ReplyProcessor &&processor)
+{
+    d->replyProcessor = std::move(processor);
+}
+
+Reply Server::replyTo(const boost::asio::ip::udp::endpoint &endpoint) const
+{
+    Reply reply;
+    if (!d->receivers.empty()) {
+        reply.m_channel = d->receivers.front()->replyChannel;
+    }
+    reply.m_sender = endpoint;
+    return reply;
+}
+
+void Server::setReceiveBatchSize(std::size_t batchSize, std::size_t maxDatagramSize)
+{
+    d->receiveBatchSize = std::max<std::size_t>(batchSize, 1);
+    d->maxDatagramSize = std::clamp<std::size_t>(maxDatagramSize, 1, 65507);
+}
+
+void Server::setBatchProcessor(BatchProcessor &&processor)
+{
+    d->batchProcessor = std::move(processor);
+}
+
+void Server::setDatagramProcessor(DatagramProcessor &&processor)
+{
+    d->datagramProcessor = std::move(processor);
+}
+
 }
@@ -3,10 +3,42 @@
 #include <memory>
 
 #include "common.hpp"
+#include "datagram.hpp"
 
 namespace UDP
 {
 
+/**
+ * @brief The Reply class   Ответ отправителю датаграммы с того сокета сервера, на который она пришла.
+ *                          Отправка асинхронная: из обработчика датаграмма уходит сразу, без переключения потоков,
+ *                          из других потоков -- через поток сокета. Копирование дешёвое, копию можно хранить
+ *                          и отвечать позже; после остановки сервера send возвращает false
+ */
+class Reply
+{
+public:
+    Reply() = default;
+
+    const boost::asio::ip::udp::endpoint& sender() const;
+
+    /**
+     * @brief send  Отправить датаграмму отправителю
+     * @param data
+     * @return      false, если сервер остановлен
+     */
+    bool send(std::vector<uint8_t>&& data) const;
+    bool send(const std::string& data) const;
+
+private:
+    friend class Server;
+    struct Channel;
+
+    std::shared_ptr<Channel>        m_channel;
+    boost::asio::ip::udp::endpoint  m_sender;
+};
+
+using ReplyProcessor = std::function<void(std::vector<uint8_t>&&, const Reply&)>;
+
 /**
  * @brief The Server class  Инстанция UDP сервера
  */
@@ -15,16 +47,88 @@ public:
     Server();
     ~Server();
 
-    bool start(uint16_t port);
+    /**
+     * @brief start         Запустить сервер
+     * @param port          0 -- порт выбирается системой
+     * @param threadCount   Число приёмных сокетов, у каждого свой поток и буфер. Больше 1 -- сокеты открываются
+     *                      на одном порту с SO_REUSEPORT, и ядро распределяет датаграммы между ними по хешу
+     *                      адресов отправителя и получателя: датаграммы одного отправителя приходят в один поток
+     * @return              true при успешном запуске
+     */
+    bool start(uint16_t port, uint16_t threadCount = 1);
     bool isWorking() const;
     void stop();
 
     /**
-     * @brief setRequestProcessor   Задать обработчик для запросов
+     * @brief port  Порт, на котором работает сервер. 0, если сервер не запущен
+     */
+    uint16_t port() const;
+
+    /**
+     * @brief setCpuAffinityEnabled Привязать поток i-го сокета к процессору i (по кругу) и задать сокету SO_INCOMING_CPU,
+     *                              чтобы датаграммы обрабатывались на том же ядре, что и прерывания сетевой карты.
+     *                              Задаётся до start, по умолчанию выключено
+     * @param isEnabled
+     */
+    void setCpuAffinityEnabled(bool isEnabled);
+
+    /**
+     * @brief setGroEnabled Включить UDP_GRO на сокетах: ядро склеивает датаграммы одного потока в одно сообщение до 64 КБ,
+     *                      что снижает затраты ядра на датаграмму при больших потоках (в том числе от GSO-отправителя,
+     *                      см. Client::sendSegmented). Сервер режет сообщение обратно, и обработчик получает датаграммы
+     *                      по одной. Приём идёт через recvmmsg в буферы по 64 КБ на датаграмму пакета.
+     *                      Задаётся до start, по умолчанию выключено
+     * @param isEnabled
+     */
+    void setGroEnabled(bool isEnabled);
+
+    /**
+     * @brief setRequestProcessor   Задать обработчик для запросов. При нескольких потоках вызывается из них одновременно
      * @param processor
      */
     void setRequestProcessor(RequestProcessor&& processor);
-    
+
+    /**
+     * @brief setReplyProcessor Задать обработчик, которому вместе с датаграммой передаётся адрес отправителя
+     *                          и способ ответить ему (обнаружение, синхронизация времени, небольшие RPC).
+     *                          Если задан, используется вместо setRequestProcessor
+     * @param processor
+     */
+    void setReplyProcessor(ReplyProcessor&& processor);
+
+    /**
+     * @brief replyTo   Канал отправки на произвольный адрес с сокета сервера (первого, если их несколько):
+     *                  для протоколов поверх сервера, которые начинают обмен сами. Запрашивается у запущенного сервера
+     * @param endpoint
+     * @return          Reply, send которого возвращает false, если сервер не запущен
+     */
+    Reply replyTo(const boost::asio::ip::udp::endpoint& endpoint) const;
+
+    /**
+     * @brief setReceiveBatchSize   Принимать до batchSize датаграмм за одно пробуждение одним вызовом recvmmsg
+     *                              в заранее выделенные буферы. Задаётся до start. 1 -- по одной датаграмме (по умолчанию)
+     * @param batchSize
+     * @param maxDatagramSize       Размер буфера под датаграмму, более длинные отбрасываются
+     */
+    void setReceiveBatchSize(std::size_t batchSize, std::size_t maxDatagramSize = 65507);
+
+    /**
+     * @brief setBatchProcessor Задать обработчик датаграмм, принятых за одно пробуждение. Датаграммы не копируются
+     *                          и действительны только во время вызова. Если задан, используется вместо setRequestProcessor
+     * @param processor
+     */
+    void setBatchProcessor(BatchProcessor&& processor);
+
+    /**
+     * @brief setDatagramProcessor  Задать обработчик датаграмм в буферах из пула. Датаграмма принимается прямо в буфер
+     *                              (2 КБ, более длинные собираются в буфер большего класса) и не копируется,
+     *                              обработчик может хранить её сколько нужно: буфер вернётся в пул при её удалении.
+     *                              После разгона приём идёт без выделения памяти. Задаётся до start,
+     *                              если задан -- используется вместо остальных обработчиков
+     * @param processor
+     */
+    void setDatagramProcessor(DatagramProcessor&& processor);
+
 private:
     struct Impl;
     std::unique_ptr<Impl> d;